@@ -0,0 +1,292 @@
+#include "attribution.h"
+#include <string.h>
+
+/**
+ * Create the attribution layer of a cache
+ *
+ * @param regionBits Regions are 2^regionBits bytes, e.g. 12 for pages
+ * @param C1, C2, S, B The geometry of the cache, as for cache_init
+ * @return The attribution state, or NULL if memory could not be allocated
+ */
+attribution_t *attribution_create(uint64_t regionBits, uint64_t C1, uint64_t C2, uint64_t S, uint64_t B)
+{
+	attribution_t *attr = calloc(1, sizeof(attribution_t));
+	if (!attr) {
+		return NULL;
+	}
+	attr->regionBits = regionBits;
+	attr->C1 = C1;
+	attr->C2 = C2;
+	attr->S = S;
+	attr->B = B;
+	attr->regionCapacity = 1024;
+	attr->regionKeys = malloc(sizeof(uint64_t) * attr->regionCapacity);
+	attr->regions = malloc(sizeof(attribution_counts) * attr->regionCapacity);
+	attr->sets = calloc(1ull << (C2 - B - S), sizeof(attribution_counts));
+	/* One set count only: C == B gives a single fully associative stack */
+	attr->distance = stackdist_create(B, B);
+	if (!attr->regionKeys || !attr->regions || !attr->sets || !attr->distance ||
+			hashmap_init(&attr->regionIndex, 1024)) {
+		attribution_destroy(attr);
+		return NULL;
+	}
+	return attr;
+}
+
+void attribution_destroy(attribution_t *attr)
+{
+	if (!attr) {
+		return;
+	}
+	hashmap_free(&attr->regionIndex);
+	free(attr->regionKeys);
+	free(attr->regions);
+	free(attr->sets);
+	stackdist_destroy(attr->distance);
+	free(attr);
+}
+
+/**
+ * The counters of the region holding an address, created on first use
+ */
+static attribution_counts *attribution_region(attribution_t *attr, uint64_t address)
+{
+	uint64_t region = address >> attr->regionBits;
+	int inserted;
+	uint64_t *slot = hashmap_put(&attr->regionIndex, region, attr->regionCount, &inserted);
+	if (!slot) {
+		perror("attribution");
+		exit(1);
+	}
+	if (inserted) {
+		if (attr->regionCount == attr->regionCapacity) {
+			size_t capacity = attr->regionCapacity * 2;
+			uint64_t *keys = realloc(attr->regionKeys, sizeof(uint64_t) * capacity);
+			if (keys) {
+				attr->regionKeys = keys;
+			}
+			attribution_counts *regions = realloc(attr->regions, sizeof(attribution_counts) * capacity);
+			if (regions) {
+				attr->regions = regions;
+			}
+			if (!keys || !regions) {
+				perror("attribution");
+				exit(1);
+			}
+			attr->regionCapacity = capacity;
+		}
+		attr->regionKeys[attr->regionCount] = region;
+		memset(attr->regions + attr->regionCount, 0, sizeof(attribution_counts));
+		attr->regionCount++;
+	}
+	return attr->regions + *slot;
+}
+
+/**
+ * Add one access to the counters of its region, its L2 set and the total
+ */
+static void attribution_count(attribution_counts *counts, int l1Miss, int l2Miss, attribution_class_t l1Class, attribution_class_t l2Class)
+{
+	counts->accesses++;
+	if (l1Miss) {
+		counts->l1_misses++;
+		counts->l1_3c[l1Class]++;
+	}
+	if (l2Miss) {
+		counts->l2_misses++;
+		counts->l2_3c[l2Class]++;
+	}
+}
+
+/**
+ * Record the outcome of one access
+ *
+ * @param attr The attribution state
+ * @param address The address of the access
+ * @param l1Miss Whether it missed in the L1
+ * @param l2Miss Whether it missed in the L2
+ */
+void attribution_access(attribution_t *attr, uint64_t address, int l1Miss, int l2Miss)
+{
+	uint64_t distance = stackdist_access(attr->distance, address);
+	attribution_class_t l1Class = MISS_COMPULSORY;
+	attribution_class_t l2Class = MISS_COMPULSORY;
+	if (distance != UINT64_MAX) {
+		l1Class = distance >= (1ull << (attr->C1 - attr->B)) ? MISS_CAPACITY : MISS_CONFLICT;
+		l2Class = distance >= (1ull << (attr->C2 - attr->B)) ? MISS_CAPACITY : MISS_CONFLICT;
+	}
+
+	uint64_t set = (address >> attr->B) & ((1ull << (attr->C2 - attr->B - attr->S)) - 1);
+	attribution_count(attribution_region(attr, address), l1Miss, l2Miss, l1Class, l2Class);
+	attribution_count(attr->sets + set, l1Miss, l2Miss, l1Class, l2Class);
+	attribution_count(&attr->total, l1Miss, l2Miss, l1Class, l2Class);
+}
+
+/**
+ * Record a write-back to memory
+ *
+ * @param blockAddress The address of the written block without its offset (address >> B)
+ */
+void attribution_write_back(attribution_t *attr, uint64_t blockAddress)
+{
+	uint64_t set = blockAddress & ((1ull << (attr->C2 - attr->B - attr->S)) - 1);
+	attribution_region(attr, blockAddress << attr->B)->write_backs++;
+	attr->sets[set].write_backs++;
+	attr->total.write_backs++;
+}
+
+/* Sorting helpers; qsort has no context argument, so they compare pointers into the counter arrays */
+static int attribution_by_l2_misses(const void *a, const void *b)
+{
+	const attribution_counts *x = *(const attribution_counts * const *)a;
+	const attribution_counts *y = *(const attribution_counts * const *)b;
+	if (x->l2_misses != y->l2_misses) {
+		return x->l2_misses < y->l2_misses ? 1 : -1;
+	}
+	return x < y ? -1 : x > y;
+}
+
+static int attribution_by_key(const void *a, const void *b)
+{
+	uint64_t x = **(const uint64_t * const *)a;
+	uint64_t y = **(const uint64_t * const *)b;
+	return x < y ? -1 : x > y;
+}
+
+static void attribution_print_counts(const attribution_counts *c, FILE *fout)
+{
+	fprintf(fout, "%" PRIu64 " accesses, %" PRIu64 " L1 misses, %" PRIu64 " L2 misses, %" PRIu64 " writebacks\n",
+			c->accesses, c->l1_misses, c->l2_misses, c->write_backs);
+}
+
+/**
+ * Print the 3C totals and the regions and L2 sets with the most L2 misses
+ *
+ * @param top How many regions and sets to list
+ */
+void attribution_print_summary(const attribution_t *attr, size_t top, FILE *fout)
+{
+	const attribution_counts *t = &attr->total;
+	uint64_t sets = 1ull << (attr->C2 - attr->B - attr->S);
+	fprintf(fout, "\nAttribution Statistics\n");
+	fprintf(fout, "Region size: %" PRIu64 "\n", (uint64_t)1 << attr->regionBits);
+	fprintf(fout, "Regions: %zu\n", attr->regionCount);
+	fprintf(fout, "L1 compulsory misses: %" PRIu64 "\n", t->l1_3c[MISS_COMPULSORY]);
+	fprintf(fout, "L1 capacity misses: %" PRIu64 "\n", t->l1_3c[MISS_CAPACITY]);
+	fprintf(fout, "L1 conflict misses: %" PRIu64 "\n", t->l1_3c[MISS_CONFLICT]);
+	fprintf(fout, "L2 compulsory misses: %" PRIu64 "\n", t->l2_3c[MISS_COMPULSORY]);
+	fprintf(fout, "L2 capacity misses: %" PRIu64 "\n", t->l2_3c[MISS_CAPACITY]);
+	fprintf(fout, "L2 conflict misses: %" PRIu64 "\n", t->l2_3c[MISS_CONFLICT]);
+
+	size_t count = attr->regionCount > sets ? attr->regionCount : sets;
+	const attribution_counts **order = malloc(sizeof(attribution_counts *) * count);
+	if (!order) {
+		return;
+	}
+	for (size_t i = 0; i < attr->regionCount; i++) {
+		order[i] = attr->regions + i;
+	}
+	qsort(order, attr->regionCount, sizeof(attribution_counts *), attribution_by_l2_misses);
+	fprintf(fout, "Top regions by L2 misses\n");
+	for (size_t i = 0; i < top && i < attr->regionCount; i++) {
+		fprintf(fout, "0x%" PRIx64 ": ", attr->regionKeys[order[i] - attr->regions] << attr->regionBits);
+		attribution_print_counts(order[i], fout);
+	}
+
+	for (uint64_t i = 0; i < sets; i++) {
+		order[i] = attr->sets + i;
+	}
+	qsort(order, sets, sizeof(attribution_counts *), attribution_by_l2_misses);
+	fprintf(fout, "Top L2 sets by L2 misses\n");
+	for (size_t i = 0; i < top && i < sets; i++) {
+		fprintf(fout, "%td: ", order[i] - attr->sets);
+		attribution_print_counts(order[i], fout);
+	}
+	free(order);
+}
+
+/**
+ * The regions in ascending address order, as pointers into regionKeys
+ */
+static const uint64_t **attribution_sorted_regions(const attribution_t *attr)
+{
+	const uint64_t **keys = malloc(sizeof(uint64_t *) * (attr->regionCount ? attr->regionCount : 1));
+	if (!keys) {
+		return NULL;
+	}
+	for (size_t i = 0; i < attr->regionCount; i++) {
+		keys[i] = attr->regionKeys + i;
+	}
+	qsort(keys, attr->regionCount, sizeof(uint64_t *), attribution_by_key);
+	return keys;
+}
+
+static void attribution_csv_row(const char *kind, const char *id, const attribution_counts *c, FILE *fout)
+{
+	fprintf(fout, "%s,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",", kind, id,
+			c->accesses, c->l1_misses, c->l2_misses, c->write_backs);
+	fprintf(fout, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+			c->l1_3c[0], c->l1_3c[1], c->l1_3c[2], c->l2_3c[0], c->l2_3c[1], c->l2_3c[2]);
+}
+
+/**
+ * Write the per-region and per-L2-set counters as one CSV table. The kind
+ * column tells the two apart; region ids are base addresses, set ids indices.
+ */
+void attribution_write_csv(const attribution_t *attr, FILE *fout)
+{
+	const uint64_t **keys = attribution_sorted_regions(attr);
+	if (!keys) {
+		perror("attribution");
+		return;
+	}
+	char id[32];
+	fprintf(fout, "kind,id,accesses,l1_misses,l2_misses,write_backs,"
+			"l1_compulsory,l1_capacity,l1_conflict,l2_compulsory,l2_capacity,l2_conflict\n");
+	for (size_t i = 0; i < attr->regionCount; i++) {
+		snprintf(id, sizeof(id), "0x%" PRIx64, *keys[i] << attr->regionBits);
+		attribution_csv_row("region", id, attr->regions + (keys[i] - attr->regionKeys), fout);
+	}
+	for (uint64_t set = 0; set < (1ull << (attr->C2 - attr->B - attr->S)); set++) {
+		snprintf(id, sizeof(id), "%" PRIu64, set);
+		attribution_csv_row("set", id, attr->sets + set, fout);
+	}
+	free(keys);
+}
+
+static void attribution_json_counts(const attribution_counts *c, FILE *fout)
+{
+	fprintf(fout, "\"accesses\": %" PRIu64 ", \"l1_misses\": %" PRIu64 ", \"l2_misses\": %" PRIu64
+			", \"write_backs\": %" PRIu64 ", ", c->accesses, c->l1_misses, c->l2_misses, c->write_backs);
+	fprintf(fout, "\"l1_3c\": [%" PRIu64 ", %" PRIu64 ", %" PRIu64 "], \"l2_3c\": [%" PRIu64 ", %" PRIu64 ", %" PRIu64 "]}",
+			c->l1_3c[0], c->l1_3c[1], c->l1_3c[2], c->l2_3c[0], c->l2_3c[1], c->l2_3c[2]);
+}
+
+/**
+ * Write the counters as a JSON document with "total", "regions" and "sets".
+ * The *_3c arrays hold the compulsory, capacity and conflict misses.
+ */
+void attribution_write_json(const attribution_t *attr, FILE *fout)
+{
+	const uint64_t **keys = attribution_sorted_regions(attr);
+	if (!keys) {
+		perror("attribution");
+		return;
+	}
+	fprintf(fout, "{\"region_bits\": %" PRIu64 ", \"C1\": %" PRIu64 ", \"C2\": %" PRIu64 ", \"S\": %" PRIu64 ", \"B\": %" PRIu64 ",\n",
+			attr->regionBits, attr->C1, attr->C2, attr->S, attr->B);
+	fprintf(fout, " \"total\": {");
+	attribution_json_counts(&attr->total, fout);
+	fprintf(fout, ",\n \"regions\": [");
+	for (size_t i = 0; i < attr->regionCount; i++) {
+		fprintf(fout, "%s\n  {\"base\": \"0x%" PRIx64 "\", ", i ? "," : "", *keys[i] << attr->regionBits);
+		attribution_json_counts(attr->regions + (keys[i] - attr->regionKeys), fout);
+	}
+	fprintf(fout, "],\n \"sets\": [");
+	for (uint64_t set = 0; set < (1ull << (attr->C2 - attr->B - attr->S)); set++) {
+		fprintf(fout, "%s\n  {\"set\": %" PRIu64 ", ", set ? "," : "", set);
+		attribution_json_counts(attr->sets + set, fout);
+	}
+	fprintf(fout, "]}\n");
+	free(keys);
+}
@@ -0,0 +1,56 @@
+#ifndef ATTRIBUTION_H
+#define ATTRIBUTION_H
+
+#include <stdio.h>
+#include "hashmap.h"
+#include "stackdist.h"
+
+/**
+ * Counters of one address region or one L2 set. Misses are split into the
+ * 3C classes: compulsory (first touch of the block), capacity (a fully
+ * associative LRU cache of the same size would miss too) and conflict.
+ */
+typedef struct attribution_counts_t {
+	uint64_t accesses;
+	uint64_t l1_misses;
+	uint64_t l2_misses;
+	uint64_t write_backs; /* Blocks of the region written back to memory */
+	uint64_t l1_3c[3]; /* Indexed by attribution_class_t */
+	uint64_t l2_3c[3];
+} attribution_counts;
+
+typedef enum attribution_class_t {
+	MISS_COMPULSORY,
+	MISS_CAPACITY,
+	MISS_CONFLICT
+} attribution_class_t;
+
+/**
+ * Miss attribution of one cache. Regions are aligned 2^regionBits byte
+ * ranges and are created as the trace touches them; L2 sets are a fixed array.
+ */
+typedef struct attribution_t {
+	uint64_t regionBits;
+	uint64_t C1, C2, S, B;
+
+	hashmap_t regionIndex; /* Region number -> index into regions */
+	uint64_t *regionKeys; /* Region number of every entry of regions */
+	attribution_counts *regions;
+	size_t regionCount;
+	size_t regionCapacity;
+
+	attribution_counts *sets; /* One per L2 set */
+	attribution_counts total;
+
+	stackdist_t *distance; /* Fully associative stack distances for the 3C split */
+} attribution_t;
+
+attribution_t *attribution_create(uint64_t regionBits, uint64_t C1, uint64_t C2, uint64_t S, uint64_t B);
+void attribution_access(attribution_t *attr, uint64_t address, int l1Miss, int l2Miss);
+void attribution_write_back(attribution_t *attr, uint64_t blockAddress);
+void attribution_print_summary(const attribution_t *attr, size_t top, FILE *fout);
+void attribution_write_csv(const attribution_t *attr, FILE *fout);
+void attribution_write_json(const attribution_t *attr, FILE *fout);
+void attribution_destroy(attribution_t *attr);
+
+#endif
@@ -0,0 +1,367 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "cachesim.h"
+#include "tracegen.h"
+
+/* Allowed slowdown against the baseline in percent, unless -t says otherwise */
+#define BENCH_TOLERANCE 40
+
+/* Iterations of the calibration loop per run */
+#define CALIBRATION_ITERATIONS (1 << 21)
+
+/* Words of the calibration table, 16MB like the footprints below */
+#define CALIBRATION_WORDS (1 << 21)
+
+void print_help_and_exit(void) {
+    printf("cachebench [OPTIONS]\n");
+    printf("Times cache_access on synthetic traces for several geometries\n");
+    printf("  -n N\t\tAccesses per run (default 2097152)\n");
+    printf("  -r N\t\tRuns per case, the fastest counts (default 5)\n");
+    printf("  -c file\tCompare against a baseline and fail on regressions\n");
+    printf("  -t P\t\tAllowed slowdown against the baseline in percent (default %d)\n", BENCH_TOLERANCE);
+    printf("  -u file\tWrite the results as a new baseline\n");
+    printf("  -h\t\tThis helpful output\n");
+    exit(0);
+}
+
+typedef struct bench_pattern_t {
+    const char* name;
+    tracegen_config_t config;
+} bench_pattern_t;
+
+/* 16MB footprints, far larger than any L2 below */
+static const bench_pattern_t PATTERNS[] = {
+    { "sequential", { TRACEGEN_SEQUENTIAL, 0x10000000, 1 << 24, 8, 0.3, 0, 1 } },
+    { "strided", { TRACEGEN_STRIDED, 0x10000000, 1 << 24, 256, 0.3, 0, 1 } },
+    { "random", { TRACEGEN_RANDOM, 0x10000000, 1 << 24, 8, 0.3, 0, 1 } },
+    { "ptrchase", { TRACEGEN_POINTER_CHASE, 0x10000000, 1 << 24, 64, 0.3, 0, 1 } },
+    { "zipf", { TRACEGEN_ZIPF, 0x10000000, 1 << 24, 64, 0.3, 0.99, 1 } },
+};
+
+/* The defaults, two more specialized kernels and one generic geometry */
+static const uint64_t GEOMETRIES[][4] = {
+    { 10, 15, 3, 5 },
+    { 12, 17, 3, 6 },
+    { 8, 12, 0, 4 },
+    { 13, 19, 4, 6 },
+};
+
+#define PATTERN_COUNT (sizeof(PATTERNS) / sizeof(PATTERNS[0]))
+#define GEOMETRY_COUNT (sizeof(GEOMETRIES) / sizeof(GEOMETRIES[0]))
+
+/* Extra attempts of a case that looks like a regression */
+#define BENCH_RETRIES 2
+
+/*
+ * What a benchmark process reports back. The cost is ns_per_access over the
+ * ns per iteration of a calibration loop timed in the same process, so that
+ * it compares across machines and clock speeds where raw times do not.
+ * cache_rss_kb is how far the simulation raised the peak RSS of the process.
+ */
+typedef struct bench_result_t {
+    double ns_per_access;
+    double cost;
+    long cache_rss_kb;
+    int ok;
+} bench_result_t;
+
+typedef struct bench_baseline_t {
+    char pattern[32];
+    uint64_t c1, c2, s, b;
+    double cost;
+} bench_baseline_t;
+
+bench_result_t run_case(const bench_pattern_t* pattern, const uint64_t* geometry, size_t n, int runs);
+bench_result_t measure(const bench_pattern_t* pattern, const uint64_t* geometry, size_t n, int runs);
+int load_baseline(const char* path, bench_baseline_t** baseline, size_t* count);
+const bench_baseline_t* find_baseline(const bench_baseline_t* baseline, size_t count, const char* pattern, const uint64_t* geometry);
+
+int main(int argc, char* argv[]) {
+    int opt;
+    size_t n = 1 << 21;
+    int runs = 5;
+    const char* compare_path = NULL;
+    const char* update_path = NULL;
+    double tolerance = BENCH_TOLERANCE;
+
+    while(-1 != (opt = getopt(argc, argv, "n:r:c:t:u:h"))) {
+        switch(opt) {
+            case 'n':
+                n = strtoull(optarg, NULL, 10);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            case 'c':
+                compare_path = optarg;
+                break;
+            case 't':
+                tolerance = atof(optarg);
+                break;
+            case 'u':
+                update_path = optarg;
+                break;
+            case 'h':
+            default:
+                print_help_and_exit();
+                break;
+        }
+    }
+    if (n == 0 || runs < 1) {
+        print_help_and_exit();
+    }
+
+    bench_baseline_t* baseline = NULL;
+    size_t baseline_count = 0;
+    if (compare_path && load_baseline(compare_path, &baseline, &baseline_count)) {
+        perror(compare_path);
+        return 1;
+    }
+    FILE* fout = NULL;
+    if (update_path) {
+        fout = fopen(update_path, "w");
+        if (!fout) {
+            perror(update_path);
+            return 1;
+        }
+        fprintf(fout, "# pattern C1 C2 S B cost (ns/access over ns/iteration of the calibration loop), written by cachebench -u\n");
+    }
+
+    printf("%-12s %3s %3s %2s %2s %12s %10s %8s %14s", "pattern", "C1", "C2", "S", "B", "Maccesses/s", "ns/access", "cost", "cache RSS (KB)");
+    printf(compare_path ? " %10s\n" : "\n", "baseline");
+    int regressions = 0;
+    int failures = 0;
+    for (size_t p = 0; p < PATTERN_COUNT; p++) {
+        for (size_t g = 0; g < GEOMETRY_COUNT; g++) {
+            const uint64_t* geometry = GEOMETRIES[g];
+            bench_result_t result = run_case(&PATTERNS[p], geometry, n, runs);
+            if (!result.ok) {
+                fprintf(stderr, "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 ": benchmark failed\n",
+                        PATTERNS[p].name, geometry[0], geometry[1], geometry[2], geometry[3]);
+                failures++;
+                continue;
+            }
+            const bench_baseline_t* base = NULL;
+            if (compare_path) {
+                base = find_baseline(baseline, baseline_count, PATTERNS[p].name, geometry);
+                /* Give a slow case another chance before blaming the code for noise */
+                double limit = base ? base->cost * (1 + tolerance / 100) : 0;
+                for (int retry = 0; base && retry < BENCH_RETRIES && result.cost > limit; retry++) {
+                    bench_result_t again = run_case(&PATTERNS[p], geometry, n, runs);
+                    if (again.ok && again.cost < result.cost) {
+                        result = again;
+                    }
+                }
+            }
+            printf("%-12s %3" PRIu64 " %3" PRIu64 " %2" PRIu64 " %2" PRIu64 " %12.2f %10.2f %8.2f %14ld",
+                   PATTERNS[p].name, geometry[0], geometry[1], geometry[2], geometry[3],
+                   1e3 / result.ns_per_access, result.ns_per_access, result.cost, result.cache_rss_kb);
+            if (compare_path) {
+                if (!base) {
+                    printf(" %10s", "-");
+                } else {
+                    printf(" %10.2f", base->cost);
+                    if (result.cost > base->cost * (1 + tolerance / 100)) {
+                        printf("  REGRESSION");
+                        regressions++;
+                    }
+                }
+            }
+            printf("\n");
+            fflush(stdout);
+            if (fout) {
+                fprintf(fout, "%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %.4f\n",
+                        PATTERNS[p].name, geometry[0], geometry[1], geometry[2], geometry[3], result.cost);
+            }
+        }
+    }
+
+    if (fout) {
+        fclose(fout);
+    }
+    free(baseline);
+    if (regressions) {
+        printf("%d case(s) more than %.0f%% slower than the baseline\n", regressions, tolerance);
+    }
+    return regressions || failures ? 1 : 0;
+}
+
+/**
+ * Run one case in its own process, so that the peak RSS belongs to this case
+ * alone. The trace is generated before the clock starts.
+ */
+bench_result_t run_case(const bench_pattern_t* pattern, const uint64_t* geometry, size_t n, int runs) {
+    bench_result_t result;
+    memset(&result, 0, sizeof(result));
+    int fds[2];
+    if (pipe(fds)) {
+        return result;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return result;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        result = measure(pattern, geometry, n, runs);
+        ssize_t written = write(fds[1], &result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (read(fds[0], &result, sizeof(result)) != sizeof(result)) {
+        result.ok = 0;
+    }
+    close(fds[0]);
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        result.ok = 0;
+    }
+    return result;
+}
+
+static double elapsed_ns(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) * 1e9 + (double)(end->tv_nsec - start->tv_nsec);
+}
+
+/**
+ * Time a fixed loop of random read-modify-writes to a 16MB table, a mix of
+ * arithmetic and cache misses much like the simulator's own. Its speed moves
+ * with the machine, not with the code under test.
+ *
+ * @return ns per iteration
+ */
+static double calibrate(uint64_t* table) {
+    uint64_t x = 1;
+    uint64_t sum = 0;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint64_t i = 0; i < CALIBRATION_ITERATIONS; i++) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        uint64_t j = (x >> 33) & (CALIBRATION_WORDS - 1);
+        table[j] += x;
+        sum += table[(j * 7) & (CALIBRATION_WORDS - 1)];
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    table[0] = sum;
+    return elapsed_ns(&start, &end) / CALIBRATION_ITERATIONS;
+}
+
+bench_result_t measure(const bench_pattern_t* pattern, const uint64_t* geometry, size_t n, int runs) {
+    bench_result_t result;
+    memset(&result, 0, sizeof(result));
+    char* rw = malloc(n);
+    uint64_t* address = malloc(sizeof(uint64_t) * n);
+    uint64_t* table = calloc(CALIBRATION_WORDS, sizeof(uint64_t));
+    tracegen_t* gen = tracegen_create(&pattern->config);
+    if (!rw || !address || !table || !gen) {
+        return result;
+    }
+    tracegen_fill(gen, rw, address, n);
+    tracegen_destroy(gen);
+
+    /*
+     * The peak RSS so far is the harness: the trace arrays and the calibration
+     * table, whose pages a first calibration run touches. Only the growth past
+     * it is the cache's.
+     */
+    calibrate(table);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long harness_kb = usage.ru_maxrss;
+
+    /* The calibration runs alternate with the case, so both see the same machine state */
+    double best = 0;
+    double best_calibration = 0;
+    for (int run = 0; run < runs; run++) {
+        double calibration = calibrate(table);
+        if (run == 0 || calibration < best_calibration) {
+            best_calibration = calibration;
+        }
+
+        struct cache_stats_t stats;
+        memset(&stats, 0, sizeof(struct cache_stats_t));
+        stats.l1_access_time = 2;
+        stats.l2_access_time = 10;
+        stats.memory_access_time = 100;
+
+        struct timespec start, end;
+        cache_init(geometry[0], geometry[1], geometry[2], geometry[3]);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < n; i++) {
+            cache_access(rw[i], address[i], &stats);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        cache_cleanup(&stats);
+
+        double ns = elapsed_ns(&start, &end) / (double)n;
+        if (run == 0 || ns < best) {
+            best = ns;
+        }
+    }
+    free(rw);
+    free(address);
+    free(table);
+
+    getrusage(RUSAGE_SELF, &usage);
+    result.ns_per_access = best;
+    result.cost = best / best_calibration;
+    result.cache_rss_kb = usage.ru_maxrss - harness_kb;
+    result.ok = 1;
+    return result;
+}
+
+/**
+ * Read a baseline written with -u. Lines starting with # are comments.
+ */
+int load_baseline(const char* path, bench_baseline_t** baseline, size_t* count) {
+    FILE* fin = fopen(path, "r");
+    if (!fin) {
+        return -1;
+    }
+    size_t capacity = 32;
+    *baseline = malloc(sizeof(bench_baseline_t) * capacity);
+    *count = 0;
+    char line[256];
+    while (*baseline && fgets(line, sizeof(line), fin)) {
+        bench_baseline_t entry;
+        if (line[0] == '#' || sscanf(line, "%31s %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %lf", entry.pattern,
+                                     &entry.c1, &entry.c2, &entry.s, &entry.b, &entry.cost) != 6) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            bench_baseline_t* grown = realloc(*baseline, sizeof(bench_baseline_t) * capacity);
+            if (!grown) {
+                free(*baseline);
+                *baseline = NULL;
+                break;
+            }
+            *baseline = grown;
+        }
+        (*baseline)[(*count)++] = entry;
+    }
+    fclose(fin);
+    return *baseline ? 0 : -1;
+}
+
+const bench_baseline_t* find_baseline(const bench_baseline_t* baseline, size_t count, const char* pattern, const uint64_t* geometry) {
+    for (size_t i = 0; i < count; i++) {
+        const bench_baseline_t* entry = baseline + i;
+        if (!strcmp(entry->pattern, pattern) && entry->c1 == geometry[0] && entry->c2 == geometry[1] &&
+            entry->s == geometry[2] && entry->b == geometry[3]) {
+            return entry;
+        }
+    }
+    return NULL;
+}
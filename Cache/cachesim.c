@@ -1,9 +1,23 @@
 #include "cachesim.h"
+#include "replacement.h"
+#include "tagstore.h"
+#include "prefetch.h"
+#include "timing.h"
+#include "writebuf.h"
+#include "attribution.h"
+#include "checkpoint.h"
+#include "kernels.h"
 # include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <errno.h>
 
 #define TRUE 1
 #define FALSE 0
 
+/* Forces the access path into its callers so that constant geometries fold */
+#define CACHE_INLINE static inline __attribute__((always_inline))
+
 /**
  * The stuct that you may use to store the metadata for each block in the L1 and L2 caches
  */
@@ -11,7 +25,8 @@ typedef struct block_t {
 	uint64_t tag; // The tag stored in that block
 	uint8_t valid; // Valid bit
 	uint8_t dirty; // Dirty bit
-	unsigned int counter;
+	uint8_t prefetched; // Brought in by the prefetcher and not used yet
+	uint64_t counter;
 } block;
 
 
@@ -25,9 +40,113 @@ typedef struct config_t {
 	uint64_t C2; /* Size of cache L2 */
 	uint64_t S; /* Set associativity of L2 */
 	uint64_t B; /* Block size of both caches */
+	uint64_t S1; /* Set associativity of L1 */
+	uint64_t lanes; /* L2 tags compared at once, 0 to use the tag store's runtime pick (see tag_store_scan) */
 } config;
 
 
+/**
+ * Counters of one sampled set group, used to compute confidence intervals
+ */
+typedef struct sample_counts_t {
+	uint64_t accesses;
+	uint64_t l1_misses;
+	uint64_t l2_misses;
+} sample_counts;
+
+
+/**
+ * Simulates one access, either for any geometry or specialized for one (see kernels.h)
+ */
+typedef void (*cache_kernel_fn)(struct cache_ctx *ctx, char rw, uint64_t address, struct cache_stats_t *stats);
+typedef void (*cache_batch_fn)(struct cache_ctx *ctx, const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats);
+
+
+/**
+ * Everything one simulated L1/L2 pair needs. Nothing in the simulator touches
+ * state outside of its context, so any number of them can be live at once and
+ * different contexts can be driven from different threads.
+ */
+struct cache_ctx {
+	block *cache1;
+	tag_store cache2;
+	config cacheConfig;
+	uint64_t mainCounter; /* 64 bits so that LRU ages never wrap on long traces */
+	repl_state repl; /* L2 replacement policy and its metadata */
+	cache_kernel_fn simulate; /* Access path for cacheConfig */
+	cache_batch_fn simulateBatch; /* The same for an array of accesses */
+
+	cache_inclusion_t inclusion; /* How the L2 relates to the L1, see cache_set_inclusion */
+	block *victim; /* Fully associative victim cache, tags are whole block addresses */
+	uint64_t victimEntries; /* 0 when there is no victim cache */
+	prefetch_state prefetch1; /* L1 and L2 prefetchers, see cache_set_prefetcher */
+	prefetch_state prefetch2;
+	cache_write_t write1; /* Write policies, see cache_set_write_policy */
+	cache_write_t write2;
+	cache_allocate_t allocate1;
+	cache_allocate_t allocate2;
+	writebuf_state *writeBuffer; /* See cache_set_write_buffer. NULL when off */
+	timing_state *timing; /* Cycle model, see cache_set_timing. NULL when off */
+	attribution_t *attribution; /* Miss attribution, see cache_set_attribution. NULL when off */
+
+	/* Set sampling, see cache_set_sampling. sampleCluster is NULL when every set is simulated */
+	uint32_t *sampleCluster; /* Set group -> index into samples, or SAMPLE_SKIP */
+	sample_counts *samples;
+	uint64_t sampleGroups; /* Number of set groups, a power of two */
+	uint64_t sampleCount; /* Number of groups that are simulated */
+};
+
+#define SAMPLE_SKIP UINT32_MAX
+
+/* Sections of a cache checkpoint, see cache_checkpoint_save */
+enum {
+	CKPT_CONFIG,
+	CKPT_SCALARS,
+	CKPT_STATS,
+	CKPT_L1,
+	CKPT_L2_TAGS,
+	CKPT_L2_VALID,
+	CKPT_L2_DIRTY,
+	CKPT_L2_AGE,
+	CKPT_L2_PREFETCHED,
+	CKPT_REPL_META,
+	CKPT_REPL_PLRU,
+	CKPT_VICTIM,
+	CKPT_PREFETCH1_STRIDES,
+	CKPT_PREFETCH1_STREAMS,
+	CKPT_PREFETCH2_STRIDES,
+	CKPT_PREFETCH2_STREAMS
+};
+
+/**
+ * Everything that decides the layout of a checkpoint. A checkpoint is only
+ * restored into a cache whose configuration matches exactly.
+ */
+typedef struct checkpoint_config_t {
+	uint64_t C1, C2, S, B, S1;
+	uint64_t inclusion;
+	uint64_t policy;
+	uint64_t victimEntries;
+	uint64_t prefetchType[2];
+	uint64_t prefetchDegree[2];
+	uint64_t prefetchLatency[2];
+	uint64_t write[2];
+	uint64_t allocate[2];
+} checkpoint_config;
+
+typedef struct checkpoint_scalars_t {
+	uint64_t mainCounter;
+	uint64_t rng;
+	uint64_t prefetchClock[2];
+} checkpoint_scalars;
+
+/* How many records ahead of the current one a batch prefetches */
+#define CACHE_PREFETCH_DISTANCE 8
+
+/* Two-sided 95% normal quantile used for the sampling confidence intervals */
+#define SAMPLE_Z95 1.959964
+
+
 /****** Do not modify the below function headers ******/
 static uint64_t get_tag(uint64_t address, uint64_t C, uint64_t B, uint64_t S);
 static uint64_t get_index(uint64_t address, uint64_t C, uint64_t B, uint64_t S);
@@ -37,20 +156,35 @@ static uint64_t convert_tag_l1(uint64_t l2_tag, uint64_t l2_index, uint64_t C1,
 static uint64_t convert_index_l1(uint64_t l2_tag, uint64_t l2_index, uint64_t C1, uint64_t C2, uint64_t B, uint64_t S);
 
 /****** You may add Globals and other function headers that you may need below this line ******/
-void writeL2(uint64_t tag2, uint64_t index2, unsigned int blockSet, struct cache_stats_t *stats);
-void updateInitialStats(char rw, struct cache_stats_t *stats);
-void L1HIT(volatile block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1);
-void updateL1Stats(struct cache_stats_t *stats, char rw);
-void updateL2Stats(struct cache_stats_t *stats, char rw);
-void L1MISSED(volatile block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1, struct cache_stats_t *stats);
-void updateL1Cache(volatile block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1);
-void writeL1toL2(char rw, uint64_t addressIndex1, uint64_t addressTag1, volatile block* L1BLOCK);
-void evictL2(volatile block* LRUblock, uint64_t addressIndex2, struct cache_stats_t *stats);
+static int cache_ctx_setup(cache_ctx_t *ctx, uint64_t C1, uint64_t C2, uint64_t S, uint64_t B);
+static void cache_kernel_lookup(cache_ctx_t *ctx);
+static void cache_sample_access(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats);
+static double prefetch_ratio(uint64_t a, uint64_t b);
+static void cache_observed_access(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats);
+static int cache_repeats_direct(const cache_ctx_t *ctx);
+static int cache_repeat(cache_ctx_t *ctx, uint64_t address, uint64_t reads, uint64_t writes, struct cache_stats_t *stats);
+CACHE_INLINE void updateInitialStats(cache_ctx_t *ctx, char rw, struct cache_stats_t *stats);
+CACHE_INLINE void L1HIT(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, struct cache_stats_t *stats);
+CACHE_INLINE void updateL1Stats(struct cache_stats_t *stats, char rw);
+CACHE_INLINE void updateL2Stats(struct cache_stats_t *stats, char rw);
+CACHE_INLINE int L1MISSED(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, int demand, struct cache_stats_t *stats);
+CACHE_INLINE int missL1(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, int demand, struct cache_stats_t *stats);
+static void issuePrefetches(cache_ctx_t *ctx, const config cfg, int level, uint64_t blockAddress, int trigger, struct cache_stats_t *stats);
+static int storeMissL1(cache_ctx_t *ctx, const config cfg, uint64_t address, struct cache_stats_t *stats);
+CACHE_INLINE void writeL2(cache_ctx_t *ctx, const config cfg, uint64_t slot, int through, uint64_t address, struct cache_stats_t *stats);
+CACHE_INLINE void memoryStore(cache_ctx_t *ctx, const config cfg, uint64_t address, struct cache_stats_t *stats);
+CACHE_INLINE void memoryWriteBlock(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, struct cache_stats_t *stats);
+CACHE_INLINE void evictL1(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, uint8_t dirty, struct cache_stats_t *stats);
+CACHE_INLINE void writeBlockToL2(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, uint8_t dirty, struct cache_stats_t *stats);
+CACHE_INLINE void updateL1Cache(block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1);
+CACHE_INLINE void evictL2(cache_ctx_t *ctx, const config cfg, uint64_t LRUblock, uint64_t addressIndex2, struct cache_stats_t *stats);
+CACHE_INLINE int victimHit(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, struct cache_stats_t *stats);
+CACHE_INLINE block* findVictim(cache_ctx_t *ctx, uint64_t blockAddress);
+CACHE_INLINE block* victimL1(block* set1, uint64_t waysL1);
+CACHE_INLINE int usePrefetchedL1(cache_ctx_t *ctx, block* L1BLOCK, struct cache_stats_t *stats);
 
-block *cache1;
-block *cache2;
-config cacheConfig;
-unsigned int mainCounter;
+/* The context behind the cache_init/cache_access/cache_cleanup entry points */
+static cache_ctx_t *defaultCtx;
 
 
 
@@ -66,22 +200,77 @@ unsigned int mainCounter;
  */
 void cache_init(uint64_t C1, uint64_t C2, uint64_t S, uint64_t B)
 {
-	cache1 = malloc(sizeof(struct block_t)*(1 << (C1 - B)));
-	cache2 = malloc(sizeof(struct block_t)*(1 << (C2 - B)));
+	defaultCtx = cache_create(C1, C2, S, B);
+	if (!defaultCtx) {
+		perror("cache_init");
+		exit(1);
+	}
+}
+
+/**
+ * Allocate an independent cache for the given configuration. The parameters
+ * are the same as for cache_init.
+ *
+ * @return The new context, or NULL if it could not be allocated
+ */
+cache_ctx_t *cache_create(uint64_t C1, uint64_t C2, uint64_t S, uint64_t B)
+{
+	cache_ctx_t *ctx = malloc(sizeof(cache_ctx_t));
+	if (ctx && cache_ctx_setup(ctx, C1, C2, S, B)) {
+		free(ctx);
+		ctx = NULL;
+	}
+	return ctx;
+}
+
+static int cache_ctx_setup(cache_ctx_t *ctx, uint64_t C1, uint64_t C2, uint64_t S, uint64_t B)
+{
+	ctx->cache1 = malloc(sizeof(struct block_t)*(1 << (C1 - B)));
+	if (!ctx->cache1) {
+		return -1;
+	}
+	if (tag_store_init(&ctx->cache2, 1ull << (C2 - B - S), S)) {
+		free(ctx->cache1);
+		return -1;
+	}
 	for (unsigned int i = 0; i < (1 << (C1 - B)); i++) {
-		cache1[i].valid = 0;
-		cache1[i].dirty = 0;
+		ctx->cache1[i].valid = 0;
+		ctx->cache1[i].dirty = 0;
+		ctx->cache1[i].prefetched = 0;
 	}
-	for (unsigned int i = 0; i < (1 << (C2 - B)); i++) {
-		cache2[i].valid = 0;
-		cache2[i].dirty = 0;
+	ctx->cacheConfig.C1 = C1;
+	ctx->cacheConfig.C2 = C2;
+	ctx->cacheConfig.S = S;
+	ctx->cacheConfig.B = B;
+	ctx->cacheConfig.S1 = 0;
+	ctx->cacheConfig.lanes = 0;
+	cache_kernel_lookup(ctx);
+
+	ctx->mainCounter = 0;
+	if (repl_init(&ctx->repl, REPL_LRU, 1ull << (C2 - B - S), S)) {
+		free(ctx->cache1);
+		tag_store_free(&ctx->cache2);
+		return -1;
 	}
-	cacheConfig.C1 = C1;
-	cacheConfig.C2 = C2;
-	cacheConfig.S = S;
-	cacheConfig.B = B;
 
-	mainCounter = 0;
+	ctx->inclusion = INCLUSION_INCLUSIVE;
+	ctx->victim = NULL;
+	ctx->victimEntries = 0;
+	prefetch_init(&ctx->prefetch1, PREFETCH_NONE, 0, 0);
+	prefetch_init(&ctx->prefetch2, PREFETCH_NONE, 0, 0);
+	ctx->write1 = WRITE_BACK;
+	ctx->write2 = WRITE_BACK;
+	ctx->allocate1 = WRITE_ALLOCATE;
+	ctx->allocate2 = WRITE_ALLOCATE;
+	ctx->writeBuffer = NULL;
+	ctx->timing = NULL;
+	ctx->attribution = NULL;
+
+	ctx->sampleCluster = NULL;
+	ctx->samples = NULL;
+	ctx->sampleGroups = 0;
+	ctx->sampleCount = 0;
+	return 0;
 }
 
 /**
@@ -92,205 +281,1622 @@ void cache_init(uint64_t C1, uint64_t C2, uint64_t S, uint64_t B)
  */
 void cache_access (char rw, uint64_t address, struct cache_stats_t *stats)
 {
-	updateInitialStats(rw, stats);
+	cache_access_ctx(defaultCtx, rw, address, stats);
+}
 
-	uint64_t addressIndex1 = get_index(address, cacheConfig.C1, cacheConfig.B, 0);
-	uint64_t addressTag1 = get_tag(address, cacheConfig.C1, cacheConfig.B, 0);
+/**
+ * Simulate one access against a context created by cache_create
+ *
+ * @param ctx The cache to access
+ * @param rw The type of access, READ or WRITE
+ * @param address The address that is being accessed
+ * @param stats The statistics of this context
+ */
+void cache_access_ctx(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats)
+{
+	if (ctx->sampleCluster) {
+		cache_sample_access(ctx, rw, address, stats);
+	} else if (ctx->timing || ctx->attribution) {
+		cache_observed_access(ctx, rw, address, stats);
+	} else {
+		ctx->simulate(ctx, rw, address, stats);
+	}
+}
 
-	volatile block* L1BLOCK = cache1 + addressIndex1;
+/**
+ * Simulate an array of accesses with the default context
+ *
+ * @param rw The type of every access, READ or WRITE
+ * @param address The address of every access
+ * @param n The number of accesses
+ * @param stats The struct that you are supposed to store the stats in
+ */
+void cache_access_batch(const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats)
+{
+	cache_access_batch_ctx(defaultCtx, rw, address, n, stats);
+}
 
-	if (L1BLOCK->tag == addressTag1 && L1BLOCK->valid > 0) {
-		L1HIT(L1BLOCK, rw, addressIndex1, addressTag1);
+/**
+ * Simulate an array of accesses against a context. The result is the same as
+ * calling cache_access_ctx for every access in order, but the counters are
+ * kept in locals for the whole batch and the cache lines upcoming accesses
+ * will touch are prefetched.
+ *
+ * @param ctx The cache to access
+ * @param rw The type of every access, READ or WRITE
+ * @param address The address of every access
+ * @param n The number of accesses
+ * @param stats The statistics of this context
+ */
+void cache_access_batch_ctx(cache_ctx_t *ctx, const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats)
+{
+	if (ctx->sampleCluster) {
+		for (size_t i = 0; i < n; i++) {
+			cache_sample_access(ctx, rw[i], address[i], stats);
+		}
+	} else if (ctx->timing || ctx->attribution) {
+		for (size_t i = 0; i < n; i++) {
+			cache_observed_access(ctx, rw[i], address[i], stats);
+		}
 	} else {
-		updateL1Stats(stats, rw);
-		updateL1Cache(L1BLOCK, rw, addressIndex1, addressTag1);
-		L1MISSED(L1BLOCK, rw, addressIndex1, addressTag1, stats);
-		
-
+		ctx->simulateBatch(ctx, rw, address, n, stats);
 	}
+}
 
-	/* 
-		Suggested approach:
-			-> Find the L1 tag and index of the address that is being passed in to the function
-			-> Check if there is a hit in the L1 cache
-			-> If L1 misses, check the L2 cache for a hit (Hint: If L2 hits, update L1 with new values)
-			-> If L2 misses, need to get values from memory, and update L2 and L1 caches
-			
-			* We will leave it upto you to decide what must be updated and when
-	 */
+/**
+ * Simulate an access followed by reads and writes of the same block that are
+ * known to hit in the L1, e.g. a record of a reduced trace
+ *
+ * @param ctx The cache to access
+ * @param rw The type of the access, READ or WRITE
+ * @param address The address that is being accessed
+ * @param reads Reads of the block right after the access
+ * @param writes Writes of the block right after the access
+ * @param stats The statistics of this context
+ */
+void cache_access_weighted_ctx(cache_ctx_t *ctx, char rw, uint64_t address, uint64_t reads, uint64_t writes, struct cache_stats_t *stats)
+{
+	cache_access_ctx(ctx, rw, address, stats);
+	if (!reads && !writes) {
+		return;
+	}
+	if (cache_repeats_direct(ctx) && !cache_repeat(ctx, address, reads, writes, stats)) {
+		return;
+	}
+	for (uint64_t i = 0; i < reads; i++) {
+		cache_access_ctx(ctx, READ, address, stats);
+	}
+	for (uint64_t i = 0; i < writes; i++) {
+		cache_access_ctx(ctx, WRITE, address, stats);
+	}
+}
 
-	
+/* Whether L1 hits change nothing but counters, dirty bits and LRU state */
+static int cache_repeats_direct(const cache_ctx_t *ctx)
+{
+	return !ctx->sampleCluster && !ctx->timing && !ctx->attribution && !ctx->writeBuffer &&
+			ctx->prefetch1.type == PREFETCH_NONE && ctx->prefetch2.type == PREFETCH_NONE &&
+			ctx->allocate1 == WRITE_ALLOCATE;
 }
-void writeL1toL2(char rw, uint64_t addressIndex1, uint64_t addressTag1, volatile block* L1BLOCK) {
-	if (L1BLOCK->valid > 0 && L1BLOCK->dirty > 0) {
-		uint64_t addressIndex2 = convert_index(addressTag1, addressIndex1, cacheConfig.C1, cacheConfig.C2, cacheConfig.B, cacheConfig.S);
-		uint64_t addressTag2 = convert_tag(addressTag1, addressIndex1, cacheConfig.C1, cacheConfig.C2, cacheConfig.B, cacheConfig.S);
-		unsigned int blockPerSet = 1 << cacheConfig.S;
-		for (unsigned int i = 0; i < blockPerSet; i++) {
-			block *L2BLOCK = cache2 + addressIndex2*blockPerSet + i;
-			if (L2BLOCK->tag == addressTag2 && L2BLOCK->valid > 0) {
-				cache2[addressIndex2*blockPerSet + i].dirty = 1;
-				break;
-			}
+
+/**
+ * Apply reads + writes L1 hits on the block of address at once: the same
+ * counters, dirty bits, stores and replacement state as L1HIT leaves behind
+ * after that many hits in a row
+ *
+ * @return 0, or -1 if the block is not in the L1
+ */
+static int cache_repeat(cache_ctx_t *ctx, uint64_t address, uint64_t reads, uint64_t writes, struct cache_stats_t *stats)
+{
+	const config cfg = ctx->cacheConfig;
+	uint64_t addressIndex1 = get_index(address, cfg.C1, cfg.B, cfg.S1);
+	uint64_t addressTag1 = get_tag(address, cfg.C1, cfg.B, cfg.S1);
+	block* set1 = ctx->cache1 + (addressIndex1 << cfg.S1);
+	block* L1BLOCK = NULL;
+	for (uint64_t i = 0; i < (1ull << cfg.S1); i++) {
+		if (set1[i].tag == addressTag1 && set1[i].valid > 0) {
+			L1BLOCK = set1 + i;
+			break;
 		}
 	}
-}
+	if (!L1BLOCK) {
+		return -1;
+	}
 
+	stats->accesses += reads + writes;
+	stats->reads += reads;
+	stats->writes += writes;
+	ctx->mainCounter += reads + writes;
+	L1BLOCK->counter = ctx->mainCounter;
 
-void updateL1Cache(volatile block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1) {
-	//writeL1toL2(rw, addressIndex1, addressTag1, L1BLOCK);
-	L1BLOCK->tag = addressTag1;
-	L1BLOCK->valid = 1;
-	if (rw == WRITE) {
+	int through = writes && ctx->write1 == WRITE_THROUGH;
+	if (through) {
+		stats->l1_write_throughs += writes;
+	} else if (writes) {
 		L1BLOCK->dirty = 1;
+	}
+	if (ctx->inclusion == INCLUSION_EXCLUSIVE) {
+		for (uint64_t i = 0; through && i < writes; i++) {
+			memoryStore(ctx, cfg, address, stats);
+		}
+		return 0;
+	}
+
+	uint64_t addressIndex2 = convert_index(addressTag1, addressIndex1, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+	uint64_t addressTag2 = convert_tag(addressTag1, addressIndex1, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+	uint64_t set2 = addressIndex2 << cfg.S;
+	int64_t way = tag_store_scan(&ctx->cache2, addressIndex2, addressTag2, cfg.S, cfg.lanes);
+	if (way >= 0) {
+		ctx->cache2.age[set2 + way] = ctx->mainCounter;
+		repl_touch_repeat(&ctx->repl, addressIndex2, way, reads + writes);
+		if (writes && !through) {
+			writeL2(ctx, cfg, set2 + way, FALSE, address, stats);
+		}
+		for (uint64_t i = 0; through && i < writes; i++) {
+			writeL2(ctx, cfg, set2 + way, TRUE, address, stats);
+		}
 	} else {
-		L1BLOCK->dirty = 0;
+		for (uint64_t i = 0; through && i < writes; i++) {
+			memoryStore(ctx, cfg, address, stats);
+		}
 	}
+	return 0;
 }
 
-void L1MISSED(volatile block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1, struct cache_stats_t *stats) {
-	
-	uint64_t addressIndex2 = convert_index(addressTag1, addressIndex1, cacheConfig.C1, cacheConfig.C2, cacheConfig.B, cacheConfig.S);
-	uint64_t addressTag2 = convert_tag(addressTag1, addressIndex1, cacheConfig.C1, cacheConfig.C2, cacheConfig.B, cacheConfig.S);
-	unsigned int blockPerSet = 1 << cacheConfig.S;
+/**
+ * Whether a trace reduced by trace_reduce replays with exactly the statistics
+ * of the original trace on this cache. Folding runs of one block only needs
+ * blocks at least as large as block_bits. Folding L1 hits further apart also
+ * needs a direct-mapped L1 of the same block size with at least as many sets,
+ * and an exclusive L2, which L1 hits do not touch.
+ *
+ * @return 0 if it does, -1 if the original trace has to be simulated
+ */
+int cache_check_reduction(const cache_ctx_t *ctx, uint64_t block_bits, uint64_t l1_bits)
+{
+	const config *cfg = &ctx->cacheConfig;
+	if (!cache_repeats_direct(ctx) || cfg->B < block_bits) {
+		return -1;
+	}
+	if (l1_bits > block_bits && (ctx->inclusion != INCLUSION_EXCLUSIVE || cfg->S1 || cfg->B != block_bits ||
+			cfg->C1 < l1_bits)) {
+		return -1;
+	}
+	return 0;
+}
 
+/**
+ * The access path for the geometry cfg. Every kernel inlines this with its own
+ * cfg, so when cfg is a constant all shifts, masks and set scans are folded
+ * at compile time.
+ */
+CACHE_INLINE void cache_kernel(cache_ctx_t *ctx, const config cfg, char rw, uint64_t address, struct cache_stats_t *stats)
+{
+	updateInitialStats(ctx, rw, stats);
 
-	int hit2 = -1;
-	int valid2 = -1;
-	unsigned int min = mainCounter;
-	int LRUblock = -1;
+	uint64_t addressIndex1 = get_index(address, cfg.C1, cfg.B, cfg.S1);
+	uint64_t addressTag1 = get_tag(address, cfg.C1, cfg.B, cfg.S1);
+	uint64_t waysL1 = 1ull << cfg.S1;
 
-	for (unsigned int i = 0; i < blockPerSet; i++) {
-		if (cache2[addressIndex2*blockPerSet + i].tag == addressTag2 && cache2[addressIndex2*blockPerSet + i].valid > 0) {
-			hit2 = addressIndex2*blockPerSet + i;
-		}
-		if (cache2[addressIndex2*blockPerSet + i].valid == 0) {
-			valid2 = addressIndex2*blockPerSet + i;
-		}
-		if (cache2[addressIndex2*blockPerSet + i].counter < min) {
-			min = cache2[addressIndex2*blockPerSet + i].counter;
-			LRUblock = addressIndex2*blockPerSet + i;
+	block* set1 = ctx->cache1 + (addressIndex1 << cfg.S1);
+	block* L1BLOCK = NULL;
+	for (uint64_t i = 0; i < waysL1; i++) {
+		if (set1[i].tag == addressTag1 && set1[i].valid > 0) {
+			L1BLOCK = set1 + i;
+			break;
 		}
 	}
 
-	if (hit2 >= 0) {
-		cache2[hit2].counter = mainCounter;
-		if (rw == WRITE) {
-			cache2[hit2].dirty = 1;
+	int trigger = FALSE; /* Whether the access starts L1 prefetches */
+	if (L1BLOCK) {
+		if (L1BLOCK->prefetched > 0) {
+			trigger = usePrefetchedL1(ctx, L1BLOCK, stats);
 		}
+		L1HIT(ctx, cfg, L1BLOCK, rw, address, addressIndex1, addressTag1, stats);
 	} else {
-		updateL2Stats(stats, rw);
-		if (valid2 >= 0) {
-			cache2[valid2].tag = addressTag2;
-			cache2[valid2].valid = 1;
-			cache2[valid2].counter = mainCounter;
-			cache2[valid2].dirty = 0;
-			if (rw == WRITE) {
-				cache2[valid2].dirty = 1;
+		L1BLOCK = victimL1(set1, waysL1);
+		if (!ctx->victimEntries || !victimHit(ctx, cfg, L1BLOCK, rw, address, addressIndex1, addressTag1, stats)) {
+			updateL1Stats(stats, rw);
+			int trigger2;
+			if (rw == WRITE && ctx->allocate1 == WRITE_NO_ALLOCATE) {
+				trigger2 = storeMissL1(ctx, cfg, address, stats);
+				L1BLOCK = NULL;
+			} else {
+				trigger2 = missL1(ctx, cfg, L1BLOCK, rw, address, addressIndex1, addressTag1, TRUE, stats);
 			}
-		} else {
-			evictL2(cache2 + LRUblock, addressIndex2, stats);
-			cache2[LRUblock].tag = addressTag2;
-			cache2[LRUblock].valid = 1;
-			cache2[LRUblock].counter = mainCounter;
-			cache2[LRUblock].dirty = 0;
-			if (rw == WRITE) {
-				cache2[LRUblock].dirty = 1;
+			if (ctx->prefetch2.type != PREFETCH_NONE) {
+				issuePrefetches(ctx, cfg, 2, address >> cfg.B, trigger2, stats);
 			}
-
+			trigger = TRUE;
 		}
 	}
+	if (L1BLOCK) {
+		L1BLOCK->counter = ctx->mainCounter;
+	}
+
+	if (ctx->prefetch1.type != PREFETCH_NONE) {
+		issuePrefetches(ctx, cfg, 1, address >> cfg.B, trigger, stats);
+	}
 }
 
-void evictL2(volatile block* LRUblock, uint64_t addressIndex2, struct cache_stats_t *stats) {
-	uint64_t addressTag1 = convert_tag_l1(LRUblock->tag, addressIndex2, cacheConfig.C1, cacheConfig.C2,cacheConfig.B, cacheConfig.S);
-	uint64_t addressIndex1 = convert_index_l1(LRUblock->tag, addressIndex2, cacheConfig.C1, cacheConfig.C2,cacheConfig.B, cacheConfig.S);
-	unsigned int found = 0;
-	if (cache1[addressIndex1].tag == addressTag1 && cache1[addressIndex1].valid > 0) {
-		if (cache1[addressIndex1].dirty > 0) {
-			found = 1;
+/**
+ * Start loading the L1 block and the L2 set an upcoming access will look up
+ */
+CACHE_INLINE void cache_prefetch(const cache_ctx_t *ctx, const config cfg, uint64_t address)
+{
+	uint64_t set2 = get_index(address, cfg.C2, cfg.B, cfg.S) << cfg.S;
+	__builtin_prefetch(ctx->cache1 + (get_index(address, cfg.C1, cfg.B, cfg.S1) << cfg.S1), 1);
+	__builtin_prefetch(ctx->cache2.tags + set2, 0);
+	__builtin_prefetch(ctx->cache2.age + set2, 1);
+}
+
+/**
+ * cache_kernel over an array. The counters of the batch live in a local
+ * struct that never escapes, so they stay in registers and are added to
+ * stats once at the end.
+ */
+CACHE_INLINE void cache_kernel_batch(cache_ctx_t *ctx, const config cfg, const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats)
+{
+	struct cache_stats_t counts = { 0 };
+	for (size_t i = 0; i < n; i++) {
+		if (i + CACHE_PREFETCH_DISTANCE < n) {
+			cache_prefetch(ctx, cfg, address[i + CACHE_PREFETCH_DISTANCE]);
 		}
-		cache1[addressIndex1].valid = 0;
-		cache1[addressIndex1].dirty = 0;
-	}
-	if (LRUblock->dirty > 0 || found > 0) {
-		stats->write_backs = stats->write_backs + 1;
+		cache_kernel(ctx, cfg, rw[i], address[i], &counts);
 	}
+
+	stats->accesses += counts.accesses;
+	stats->reads += counts.reads;
+	stats->writes += counts.writes;
+	stats->write_backs += counts.write_backs;
+	stats->l1_read_misses += counts.l1_read_misses;
+	stats->l1_write_misses += counts.l1_write_misses;
+	stats->l2_read_misses += counts.l2_read_misses;
+	stats->l2_write_misses += counts.l2_write_misses;
+	stats->victim_hits += counts.victim_hits;
+	stats->back_invalidations += counts.back_invalidations;
+	stats->l1_write_backs += counts.l1_write_backs;
+	stats->l1_prefetches += counts.l1_prefetches;
+	stats->l1_prefetch_hits += counts.l1_prefetch_hits;
+	stats->l1_prefetch_late += counts.l1_prefetch_late;
+	stats->l1_prefetch_useless += counts.l1_prefetch_useless;
+	stats->l2_prefetches += counts.l2_prefetches;
+	stats->l2_prefetch_hits += counts.l2_prefetch_hits;
+	stats->l2_prefetch_late += counts.l2_prefetch_late;
+	stats->l2_prefetch_useless += counts.l2_prefetch_useless;
+	stats->l1_write_throughs += counts.l1_write_throughs;
+	stats->memory_stores += counts.memory_stores;
+	stats->memory_write_bytes += counts.memory_write_bytes;
 }
 
-void updateL2Stats(struct cache_stats_t *stats, char rw) {
-	if (rw == READ) {
-		stats->l2_read_misses = stats->l2_read_misses + 1;
-	} else {
-		stats->l2_write_misses = stats->l2_write_misses + 1;
-	}
+/* Fallback for geometries without a specialized kernel */
+static void cache_kernel_generic(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats)
+{
+	cache_kernel(ctx, ctx->cacheConfig, rw, address, stats);
+}
+
+static void cache_kernel_batch_generic(cache_ctx_t *ctx, const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats)
+{
+	cache_kernel_batch(ctx, ctx->cacheConfig, rw, address, n, stats);
 }
 
+#define CACHE_KERNEL_NAME(C1, C2, S, B, L) cache_kernel_ ## C1 ## _ ## C2 ## _ ## S ## _ ## B ## _x ## L
+#define CACHE_BATCH_NAME(C1, C2, S, B, L) cache_kernel_batch_ ## C1 ## _ ## C2 ## _ ## S ## _ ## B ## _x ## L
 
-void updateL1Stats(struct cache_stats_t *stats, char rw) {
-	if (rw == READ) {
-		stats->l1_read_misses = stats->l1_read_misses + 1;
-	} else {
-		stats->l1_write_misses = stats->l1_write_misses + 1;
-	}
+/*
+ * Every geometry gets one kernel per width of the L2 tag compare, built for
+ * the instruction set that width needs; cache_kernel_lookup takes the one
+ * matching the tag store. The width never exceeds the ways of a set.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CACHE_KERNEL_WIDTHS(C1, C2, S, B, X) \
+	X(C1, C2, S, B, 1, ) \
+	X(C1, C2, S, B, 2, __attribute__((target("sse4.1")))) \
+	X(C1, C2, S, B, 4, __attribute__((target("avx2"))))
+#else
+#define CACHE_KERNEL_WIDTHS(C1, C2, S, B, X) \
+	X(C1, C2, S, B, 1, )
+#endif
+
+#define CACHE_KERNEL_LANES(S, L) ((L) < (1u << (S)) ? (L) : (1u << (S)))
+
+#define CACHE_KERNEL_VARIANT(C1, C2, S, B, L, TARGET) \
+static TARGET void CACHE_KERNEL_NAME(C1, C2, S, B, L)(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats) \
+{ \
+	const config cfg = { C1, C2, S, B, 0, CACHE_KERNEL_LANES(S, L) }; \
+	cache_kernel(ctx, cfg, rw, address, stats); \
+} \
+static TARGET void CACHE_BATCH_NAME(C1, C2, S, B, L)(cache_ctx_t *ctx, const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats) \
+{ \
+	const config cfg = { C1, C2, S, B, 0, CACHE_KERNEL_LANES(S, L) }; \
+	cache_kernel_batch(ctx, cfg, rw, address, n, stats); \
 }
 
+/* Keyed by the width of the tag store, which only picks widths its sets can hold */
+#define CACHE_KERNEL_ENTRY(C1, C2, S, B, L, TARGET) \
+	{ { C1, C2, S, B, 0, L }, CACHE_KERNEL_NAME(C1, C2, S, B, L), CACHE_BATCH_NAME(C1, C2, S, B, L) },
 
-void updateInitialStats(char rw, struct cache_stats_t *stats) {
-	if (rw == READ) {
-		stats->reads = stats->reads + 1;
-	} else {
-		stats->writes = stats->writes + 1;
+#define CACHE_KERNEL_DEFINE(C1, C2, S, B) CACHE_KERNEL_WIDTHS(C1, C2, S, B, CACHE_KERNEL_VARIANT)
+#define CACHE_KERNEL_ENTRIES(C1, C2, S, B) CACHE_KERNEL_WIDTHS(C1, C2, S, B, CACHE_KERNEL_ENTRY)
+
+CACHE_KERNEL_GEOMETRIES(CACHE_KERNEL_DEFINE)
+
+static const struct {
+	config cfg;
+	cache_kernel_fn simulate;
+	cache_batch_fn simulateBatch;
+} cacheKernels[] = {
+	CACHE_KERNEL_GEOMETRIES(CACHE_KERNEL_ENTRIES)
+};
+
+/**
+ * Pick the specialized kernels of the context's geometry from kernels.h, or the generic ones
+ */
+static void cache_kernel_lookup(cache_ctx_t *ctx)
+{
+	const config *cfg = &ctx->cacheConfig;
+	ctx->simulate = cache_kernel_generic;
+	ctx->simulateBatch = cache_kernel_batch_generic;
+	for (size_t i = 0; i < sizeof(cacheKernels) / sizeof(cacheKernels[0]); i++) {
+		const config *k = &cacheKernels[i].cfg;
+		if (k->C1 == cfg->C1 && k->C2 == cfg->C2 && k->S == cfg->S && k->B == cfg->B && k->S1 == cfg->S1 &&
+				k->lanes == ctx->cache2.lanes) {
+			ctx->simulate = cacheKernels[i].simulate;
+			ctx->simulateBatch = cacheKernels[i].simulateBatch;
+		}
 	}
+}
 
-	mainCounter = mainCounter + 1;
-	stats->accesses = stats->accesses + 1;
+/**
+ * Whether accesses to ctx run through a kernel specialized for its geometry
+ */
+int cache_is_specialized(const cache_ctx_t *ctx)
+{
+	return ctx->simulate != cache_kernel_generic;
 }
 
+/**
+ * Select the replacement policy of the L2. LRU is the default.
+ *
+ * Must be called before the first access.
+ *
+ * @return 0 on success, -1 if memory for the policy metadata could not be allocated
+ */
+int cache_set_replacement(cache_ctx_t *ctx, cache_repl_t policy)
+{
+	uint64_t sets = 1ull << (ctx->cacheConfig.C2 - ctx->cacheConfig.B - ctx->cacheConfig.S);
+	repl_free(&ctx->repl);
+	return repl_init(&ctx->repl, policy, sets, ctx->cacheConfig.S);
+}
 
+/**
+ * Select how the L2 relates to the L1 (and the victim cache). The L2 is
+ * inclusive by default.
+ *
+ * Must be called before the first access.
+ *
+ * @return 0
+ */
+int cache_set_inclusion(cache_ctx_t *ctx, cache_inclusion_t inclusion)
+{
+	ctx->inclusion = inclusion;
+	return 0;
+}
 
-void L1HIT(volatile block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1) {
-	uint64_t addressIndex2 = convert_index(addressTag1, addressIndex1, cacheConfig.C1, cacheConfig.C2, cacheConfig.B, cacheConfig.S);
-	uint64_t addressTag2 = convert_tag(addressTag1, addressIndex1, cacheConfig.C1, cacheConfig.C2, cacheConfig.B, cacheConfig.S);
-	unsigned int blockPerSet = 1 << cacheConfig.S;
+/**
+ * Make the L1 2^S1-way set associative with LRU replacement. It is direct
+ * mapped by default. The L1 keeps its size, so it has 2^(C1 - B - S1) sets.
+ *
+ * Must be called before the first access and before cache_set_sampling.
+ *
+ * @return 0 on success, -1 if the L1 has fewer than 2^S1 blocks or is sampled
+ */
+int cache_set_l1_associativity(cache_ctx_t *ctx, uint64_t S1)
+{
+	if (S1 > ctx->cacheConfig.C1 - ctx->cacheConfig.B || ctx->sampleCluster) {
+		return -1;
+	}
+	ctx->cacheConfig.S1 = S1;
+	cache_kernel_lookup(ctx);
+	return 0;
+}
 
-	if (rw == WRITE) {
-		L1BLOCK->dirty = 1;
+/**
+ * Add a fully associative victim cache with LRU replacement between the L1
+ * and the L2. It holds blocks evicted from the L1; an L1 miss that finds its
+ * block there swaps it back into the L1 and counts as a victim hit instead of
+ * an L1 miss.
+ *
+ * Must be called before the first access and before cache_set_sampling.
+ *
+ * @param entries Number of blocks in the victim cache, 0 removes it
+ * @return 0 on success, -1 if the cache is sampled or memory could not be allocated
+ */
+int cache_set_victim_cache(cache_ctx_t *ctx, uint64_t entries)
+{
+	if (ctx->sampleCluster) {
+		return -1;
 	}
-	for (unsigned int i = 0; i < blockPerSet; i++) {
-		block *L2BLOCK = cache2 + addressIndex2*blockPerSet + i;
-		if (L2BLOCK->tag == addressTag2 && L2BLOCK->valid > 0) {
-			cache2[addressIndex2*blockPerSet + i].counter = mainCounter;
-			if (rw == WRITE) {
-				cache2[addressIndex2*blockPerSet + i].dirty = 1;
-			}
-			break;
+	block *victim = NULL;
+	if (entries) {
+		victim = calloc(entries, sizeof(block));
+		if (!victim) {
+			return -1;
 		}
 	}
+	free(ctx->victim);
+	ctx->victim = victim;
+	ctx->victimEntries = entries;
+	return 0;
+}
+
+/**
+ * Attach a hardware prefetcher to the L1 or the L2. The L1 prefetcher sees
+ * every access and fetches through the L2, the L2 prefetcher sees the L1
+ * misses and fetches from memory into the L2 only. Prefetches never count
+ * as misses.
+ *
+ * Must be called before the first access and before cache_set_sampling.
+ *
+ * @param level 1 or 2
+ * @param type The prefetching algorithm, PREFETCH_NONE removes the prefetcher
+ * @param degree Blocks prefetched per trigger, 1 to PREFETCH_MAX_DEGREE
+ * @param latency Accesses a prefetch takes to arrive; prefetched blocks that
+ *        are hit sooner are counted as late
+ * @return 0 on success, -1 if the arguments are invalid, the cache is sampled
+ *         or memory could not be allocated
+ */
+int cache_set_prefetcher(cache_ctx_t *ctx, int level, cache_prefetch_t type, uint64_t degree, uint64_t latency)
+{
+	if ((level != 1 && level != 2) || ctx->sampleCluster) {
+		return -1;
+	}
+	prefetch_state *state = level == 1 ? &ctx->prefetch1 : &ctx->prefetch2;
+	prefetch_free(state);
+	return prefetch_init(state, type, degree, latency);
+}
 
+/**
+ * Choose how a level handles stores. Both levels are write-back and
+ * write-allocate by default.
+ *
+ * A write-through L1 passes every store on to the L2 and its blocks never
+ * become dirty; a write-through L2 sends the stores and the L1 write-backs
+ * that reach it on to memory. A no-write-allocate L1 sends store misses to the
+ * L2 without filling the L1. The L2's allocation policy applies to those
+ * stores only: store misses of a write-allocate L1 always fetch the block
+ * through the L2, and stores passing the L2 without a copy of the block (a
+ * write-through L1 over a non-inclusive or exclusive L2) go to memory.
+ *
+ * Must be called before the first access.
+ *
+ * @param level 1 or 2
+ * @return 0 on success, -1 if the arguments are invalid
+ */
+int cache_set_write_policy(cache_ctx_t *ctx, int level, cache_write_t write, cache_allocate_t allocate)
+{
+	if ((level != 1 && level != 2) || write > WRITE_THROUGH || allocate > WRITE_NO_ALLOCATE) {
+		return -1;
+	}
+	if (level == 1) {
+		ctx->write1 = write;
+		ctx->allocate1 = allocate;
+	} else {
+		ctx->write2 = write;
+		ctx->allocate2 = allocate;
+	}
+	return 0;
 }
 
+/**
+ * Put a coalescing write buffer (see struct cache_write_buffer_config_t)
+ * between the L2 and memory. memory_write_bytes then counts the bytes left
+ * after merging.
+ *
+ * Must be called before the first access. Sampled caches cannot have one.
+ *
+ * @param config Entries, 1 to WRITEBUF_MAX_ENTRIES, and cycles per memory write
+ * @return 0 on success, -1 if the configuration is invalid, the cache is
+ *         sampled or memory could not be allocated
+ */
+int cache_set_write_buffer(cache_ctx_t *ctx, const struct cache_write_buffer_config_t *config)
+{
+	if (ctx->sampleCluster) {
+		return -1;
+	}
+	writebuf_state *buffer = malloc(sizeof(writebuf_state));
+	if (!buffer || writebuf_init(buffer, config, ctx->cacheConfig.B)) {
+		if (buffer) {
+			writebuf_free(buffer);
+		}
+		free(buffer);
+		return -1;
+	}
+	if (ctx->writeBuffer) {
+		writebuf_free(ctx->writeBuffer);
+		free(ctx->writeBuffer);
+	}
+	ctx->writeBuffer = buffer;
+	return 0;
+}
 
+/**
+ * The statistics of the write buffer of a cache set up with cache_set_write_buffer
+ */
+void cache_write_buffer_estimate(const cache_ctx_t *ctx, struct cache_write_buffer_stats_t *buffer)
+{
+	writebuf_estimate(ctx->writeBuffer, ctx->mainCounter, buffer);
+}
 
 /**
- * Subroutine for freeing up memory, and performing any final calculations before the statistics
- * are outputed by the driver
+ * Run the cycle model (see struct cache_timing_config_t) next to the
+ * simulation. Timed accesses take the unbatched path.
+ *
+ * Must be called before the first access. Sampled caches cannot be timed.
+ *
+ * @param ctx The cache to time
+ * @param config MSHRs per level, 1 to TIMING_MAX_MSHRS, and memory bandwidth
+ * @return 0 on success, -1 if the configuration is invalid, the cache is
+ *         sampled or memory could not be allocated
  */
-void cache_cleanup (struct cache_stats_t *stats)
+int cache_set_timing(cache_ctx_t *ctx, const struct cache_timing_config_t *config)
 {
-	free(cache1);
-	free(cache2);
+	if (ctx->sampleCluster) {
+		return -1;
+	}
+	timing_state *timing = malloc(sizeof(timing_state));
+	if (!timing || timing_init(timing, config)) {
+		free(timing);
+		return -1;
+	}
+	if (ctx->timing) {
+		timing_free(ctx->timing);
+		free(ctx->timing);
+	}
+	ctx->timing = timing;
+	return 0;
+}
 
-	stats->read_misses = stats->l1_read_misses + stats->l2_read_misses;
-	stats->write_misses = stats->l1_write_misses + stats->l2_write_misses;
-	stats->misses = stats->read_misses + stats->write_misses;
+/**
+ * Attribute the misses and write-backs of the cache to address regions and
+ * L2 sets, and classify every miss as compulsory, capacity or conflict (see
+ * attribution.h). Attributed accesses take the unbatched path.
+ *
+ * Must be called before the first access. Sampled caches cannot be attributed.
+ *
+ * @param ctx The cache to observe
+ * @param regionBits Regions are 2^regionBits bytes
+ * @return 0 on success, -1 if the cache is sampled or memory could not be allocated
+ */
+int cache_set_attribution(cache_ctx_t *ctx, uint64_t regionBits)
+{
+	if (ctx->sampleCluster || regionBits > 63) {
+		return -1;
+	}
+	const config cfg = ctx->cacheConfig;
+	attribution_t *attribution = attribution_create(regionBits, cfg.C1, cfg.C2, cfg.S, cfg.B);
+	if (!attribution) {
+		return -1;
+	}
+	attribution_destroy(ctx->attribution);
+	ctx->attribution = attribution;
+	return 0;
+}
 
-	stats->l1_miss_rate = ((double)stats->l1_read_misses + (double)stats->l1_write_misses) / (double)stats->accesses;
-	stats->l2_miss_rate = ((double)stats->l2_read_misses + (double)stats->l2_write_misses) / ((double)stats->l1_read_misses + (double)stats->l1_write_misses);
-	stats->miss_rate = (double)stats->misses / (double)stats->accesses;
+/**
+ * The attribution state of a cache set up with cache_set_attribution, or NULL
+ */
+struct attribution_t *cache_attribution(const cache_ctx_t *ctx)
+{
+	return ctx->attribution;
+}
 
-	stats->l2_avg_access_time = (double)stats->l2_access_time + stats->l2_miss_rate*stats->memory_access_time;
-	stats->avg_access_time = (double)stats->l1_access_time + stats->l1_miss_rate*stats->l2_avg_access_time;
+/**
+ * One access of a timed or attributed cache. The level that served it and
+ * the memory traffic it caused are read off the counters it changed.
+ */
+static void cache_observed_access(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats)
+{
+	uint64_t l1Misses = stats->l1_read_misses + stats->l1_write_misses;
+	uint64_t l2Misses = stats->l2_read_misses + stats->l2_write_misses;
+	uint64_t transfers = stats->write_backs + stats->l2_prefetches + stats->memory_stores;
+
+	ctx->simulate(ctx, rw, address, stats);
+
+	int level = 1;
+	if (stats->l2_read_misses + stats->l2_write_misses != l2Misses) {
+		level = 3;
+	} else if (stats->l1_read_misses + stats->l1_write_misses != l1Misses) {
+		level = 2;
+	}
+	if (ctx->timing) {
+		transfers = stats->write_backs + stats->l2_prefetches + stats->memory_stores - transfers;
+		timing_access(ctx->timing, address >> ctx->cacheConfig.B, level, transfers, stats);
+	}
+	if (ctx->attribution) {
+		attribution_access(ctx->attribution, address, level >= 2, level == 3);
+	}
+}
+
+/**
+ * The results of the cycle model, for a cache set up with cache_set_timing
+ */
+void cache_timing_estimate(const cache_ctx_t *ctx, struct cache_timing_stats_t *timing)
+{
+	timing_estimate(ctx->timing, timing);
+}
+
+static void checkpoint_describe(const cache_ctx_t *ctx, checkpoint_config *cfg)
+{
+	memset(cfg, 0, sizeof(checkpoint_config));
+	cfg->C1 = ctx->cacheConfig.C1;
+	cfg->C2 = ctx->cacheConfig.C2;
+	cfg->S = ctx->cacheConfig.S;
+	cfg->B = ctx->cacheConfig.B;
+	cfg->S1 = ctx->cacheConfig.S1;
+	cfg->inclusion = ctx->inclusion;
+	cfg->policy = ctx->repl.policy;
+	cfg->victimEntries = ctx->victimEntries;
+	cfg->write[0] = ctx->write1;
+	cfg->write[1] = ctx->write2;
+	cfg->allocate[0] = ctx->allocate1;
+	cfg->allocate[1] = ctx->allocate2;
+	const prefetch_state *prefetch[2] = {&ctx->prefetch1, &ctx->prefetch2};
+	for (int i = 0; i < 2; i++) {
+		cfg->prefetchType[i] = prefetch[i]->type;
+		cfg->prefetchDegree[i] = prefetch[i]->degree;
+		cfg->prefetchLatency[i] = prefetch[i]->latency;
+	}
+}
+
+/**
+ * Write the state of a cache to a checkpoint file
+ *
+ * @param ctx The cache to save
+ * @param stats The statistics accumulated so far
+ * @param trace_offset Trace records simulated so far, to continue from on restore
+ * @param path The checkpoint file, replaced atomically
+ * @return 0 on success, -1 if the cache is sampled, has a write buffer, cycle
+ *         model or miss attribution (whose state is not saved), or the file
+ *         could not be written
+ */
+int cache_checkpoint_save(const cache_ctx_t *ctx, const struct cache_stats_t *stats, uint64_t trace_offset, const char *path)
+{
+	if (ctx->sampleCluster || ctx->writeBuffer || ctx->timing || ctx->attribution) {
+		return -1;
+	}
+	const config cfg = ctx->cacheConfig;
+	uint64_t l1Blocks = 1ull << (cfg.C1 - cfg.B);
+	uint64_t l2Blocks = 1ull << (cfg.C2 - cfg.B);
+
+	checkpoint_config described;
+	checkpoint_describe(ctx, &described);
+	checkpoint_scalars scalars = {ctx->mainCounter, ctx->repl.rng, {ctx->prefetch1.clock, ctx->prefetch2.clock}};
+
+	checkpoint_t ckpt;
+	checkpoint_init(&ckpt, trace_offset);
+	checkpoint_add(&ckpt, CKPT_CONFIG, &described, sizeof(described));
+	checkpoint_add(&ckpt, CKPT_SCALARS, &scalars, sizeof(scalars));
+	checkpoint_add(&ckpt, CKPT_STATS, stats, sizeof(struct cache_stats_t));
+	checkpoint_add(&ckpt, CKPT_L1, ctx->cache1, sizeof(block) * l1Blocks);
+	checkpoint_add(&ckpt, CKPT_L2_TAGS, ctx->cache2.tags, sizeof(uint64_t) * l2Blocks);
+	checkpoint_add(&ckpt, CKPT_L2_VALID, ctx->cache2.valid, l2Blocks);
+	checkpoint_add(&ckpt, CKPT_L2_DIRTY, ctx->cache2.dirty, l2Blocks);
+	checkpoint_add(&ckpt, CKPT_L2_AGE, ctx->cache2.age, sizeof(uint64_t) * l2Blocks);
+	checkpoint_add(&ckpt, CKPT_L2_PREFETCHED, ctx->cache2.prefetched, l2Blocks);
+	if (ctx->repl.meta) {
+		checkpoint_add(&ckpt, CKPT_REPL_META, ctx->repl.meta, sizeof(uint32_t) * l2Blocks);
+	}
+	if (ctx->repl.plru) {
+		checkpoint_add(&ckpt, CKPT_REPL_PLRU, ctx->repl.plru, sizeof(uint64_t) * (l2Blocks >> cfg.S) * ctx->repl.plruWords);
+	}
+	if (ctx->victimEntries) {
+		checkpoint_add(&ckpt, CKPT_VICTIM, ctx->victim, sizeof(block) * ctx->victimEntries);
+	}
+	const prefetch_state *prefetch[2] = {&ctx->prefetch1, &ctx->prefetch2};
+	for (uint32_t i = 0; i < 2; i++) {
+		if (prefetch[i]->strides) {
+			checkpoint_add(&ckpt, CKPT_PREFETCH1_STRIDES + 2 * i, prefetch[i]->strides, sizeof(prefetch_stride_t) * PREFETCH_STRIDE_ENTRIES);
+		}
+		if (prefetch[i]->streams) {
+			checkpoint_add(&ckpt, CKPT_PREFETCH1_STREAMS + 2 * i, prefetch[i]->streams, sizeof(prefetch_stream_t) * PREFETCH_STREAMS);
+		}
+	}
+	return checkpoint_write(&ckpt, path);
+}
+
+/**
+ * Copy one section of a checkpoint, which must be exactly size bytes
+ *
+ * @return 0 on success, -1 if the section is missing or has another size
+ */
+static int checkpoint_restore_section(const checkpoint_t *ckpt, uint32_t id, void *data, uint64_t size)
+{
+	uint64_t found;
+	const void *section = checkpoint_section(ckpt, id, &found);
+	if (!section || found != size) {
+		return -1;
+	}
+	memcpy(data, section, size);
+	return 0;
+}
+
+/**
+ * Load a checkpoint written by cache_checkpoint_save. The file is mapped
+ * rather than read, so only the pages of the state are touched once.
+ *
+ * Must be called before the first access, after the cache has been given the
+ * configuration of the saved one (L1 associativity, inclusion, replacement,
+ * victim cache and prefetchers). The statistics counters are restored, the
+ * access times keep the values in stats.
+ *
+ * @param ctx The cache to restore into
+ * @param stats Receives the statistics of the saved run
+ * @param trace_offset Receives the number of trace records the saved run simulated
+ * @param path The checkpoint file
+ * @return 0 on success, -1 if the file cannot be read, is not a checkpoint
+ *         (errno is EINVAL), does not match the configuration of the cache
+ *         (errno is EINVAL) or the cache is sampled. A corrupt checkpoint may
+ *         leave the cache partially restored. Caches with a write buffer,
+ *         cycle model or miss attribution cannot be restored either.
+ */
+int cache_checkpoint_restore(cache_ctx_t *ctx, struct cache_stats_t *stats, uint64_t *trace_offset, const char *path)
+{
+	if (ctx->sampleCluster || ctx->writeBuffer || ctx->timing || ctx->attribution) {
+		return -1;
+	}
+	checkpoint_t ckpt;
+	if (checkpoint_open(&ckpt, path)) {
+		return -1;
+	}
+
+	const config cfg = ctx->cacheConfig;
+	uint64_t l1Blocks = 1ull << (cfg.C1 - cfg.B);
+	uint64_t l2Blocks = 1ull << (cfg.C2 - cfg.B);
+	checkpoint_config described, saved;
+	checkpoint_describe(ctx, &described);
+	checkpoint_scalars scalars;
+	struct cache_stats_t restored;
+
+	int failed = checkpoint_restore_section(&ckpt, CKPT_CONFIG, &saved, sizeof(saved)) ||
+			memcmp(&saved, &described, sizeof(checkpoint_config)) ||
+			checkpoint_restore_section(&ckpt, CKPT_SCALARS, &scalars, sizeof(scalars)) ||
+			checkpoint_restore_section(&ckpt, CKPT_STATS, &restored, sizeof(restored)) ||
+			checkpoint_restore_section(&ckpt, CKPT_L1, ctx->cache1, sizeof(block) * l1Blocks) ||
+			checkpoint_restore_section(&ckpt, CKPT_L2_TAGS, ctx->cache2.tags, sizeof(uint64_t) * l2Blocks) ||
+			checkpoint_restore_section(&ckpt, CKPT_L2_VALID, ctx->cache2.valid, l2Blocks) ||
+			checkpoint_restore_section(&ckpt, CKPT_L2_DIRTY, ctx->cache2.dirty, l2Blocks) ||
+			checkpoint_restore_section(&ckpt, CKPT_L2_AGE, ctx->cache2.age, sizeof(uint64_t) * l2Blocks) ||
+			checkpoint_restore_section(&ckpt, CKPT_L2_PREFETCHED, ctx->cache2.prefetched, l2Blocks);
+	if (!failed && ctx->repl.meta) {
+		failed = checkpoint_restore_section(&ckpt, CKPT_REPL_META, ctx->repl.meta, sizeof(uint32_t) * l2Blocks);
+	}
+	if (!failed && ctx->repl.plru) {
+		failed = checkpoint_restore_section(&ckpt, CKPT_REPL_PLRU, ctx->repl.plru, sizeof(uint64_t) * (l2Blocks >> cfg.S) * ctx->repl.plruWords);
+	}
+	if (!failed && ctx->victimEntries) {
+		failed = checkpoint_restore_section(&ckpt, CKPT_VICTIM, ctx->victim, sizeof(block) * ctx->victimEntries);
+	}
+	prefetch_state *prefetch[2] = {&ctx->prefetch1, &ctx->prefetch2};
+	for (uint32_t i = 0; !failed && i < 2; i++) {
+		if (prefetch[i]->strides) {
+			failed = checkpoint_restore_section(&ckpt, CKPT_PREFETCH1_STRIDES + 2 * i, prefetch[i]->strides, sizeof(prefetch_stride_t) * PREFETCH_STRIDE_ENTRIES);
+		}
+		if (!failed && prefetch[i]->streams) {
+			failed = checkpoint_restore_section(&ckpt, CKPT_PREFETCH1_STREAMS + 2 * i, prefetch[i]->streams, sizeof(prefetch_stream_t) * PREFETCH_STREAMS);
+		}
+	}
+	*trace_offset = ckpt.header.trace_offset;
+	checkpoint_close(&ckpt);
+	if (failed) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ctx->mainCounter = scalars.mainCounter;
+	ctx->repl.rng = (uint32_t)scalars.rng;
+	ctx->prefetch1.clock = scalars.prefetchClock[0];
+	ctx->prefetch2.clock = scalars.prefetchClock[1];
+	restored.l1_access_time = stats->l1_access_time;
+	restored.l2_access_time = stats->l2_access_time;
+	restored.memory_access_time = stats->memory_access_time;
+	*stats = restored;
+	return 0;
+}
+
+/**
+ * Only simulate a subset of the sets
+ *
+ * Sets are grouped by the low bits of the block address that are part of both
+ * the L1 index and the L2 index, so every group is a closed set of L1 sets and
+ * L2 sets and behaves exactly as it would in the full simulation. One in 2^shift
+ * groups (picked by a fixed pseudo-random permutation, to avoid aliasing with
+ * strided access patterns) is simulated; accesses to the other groups are only
+ * counted. Use cache_sample_estimate instead of cache_finalize_stats to scale
+ * the results back up.
+ *
+ * Must be called before the first access.
+ *
+ * @param ctx The cache to sample
+ * @param shift Simulate 1 in 2^shift set groups
+ * @return 0 on success, -1 if there are fewer than 2^shift groups, there is a
+ *         victim cache, prefetcher, write buffer, cycle model or attribution,
+ *         or memory ran out
+ */
+int cache_set_sampling(cache_ctx_t *ctx, uint64_t shift)
+{
+	uint64_t l1Bits = ctx->cacheConfig.C1 - ctx->cacheConfig.S1 - ctx->cacheConfig.B;
+	uint64_t l2Bits = ctx->cacheConfig.C2 - ctx->cacheConfig.S - ctx->cacheConfig.B;
+	uint64_t groupBits = l1Bits < l2Bits ? l1Bits : l2Bits;
+	/* A victim cache or prefetcher couples the sets, so groups would not be independent */
+	if (shift == 0 || shift > groupBits || ctx->victimEntries || ctx->prefetch1.type || ctx->prefetch2.type ||
+			ctx->writeBuffer || ctx->timing || ctx->attribution) {
+		return -1;
+	}
+
+	ctx->sampleGroups = 1ull << groupBits;
+	ctx->sampleCount = ctx->sampleGroups >> shift;
+	ctx->sampleCluster = malloc(sizeof(uint32_t) * ctx->sampleGroups);
+	ctx->samples = calloc(ctx->sampleCount, sizeof(sample_counts));
+	if (!ctx->sampleCluster || !ctx->samples) {
+		free(ctx->sampleCluster);
+		free(ctx->samples);
+		ctx->sampleCluster = NULL;
+		ctx->samples = NULL;
+		return -1;
+	}
+
+	/* Multiplying by an odd constant permutes the groups, keep the ones that land in the first 1/2^shift */
+	uint32_t next = 0;
+	for (uint64_t group = 0; group < ctx->sampleGroups; group++) {
+		uint64_t slot = (group * 0x9e3779b97f4a7c15ull) & (ctx->sampleGroups - 1);
+		ctx->sampleCluster[group] = slot < ctx->sampleCount ? next++ : SAMPLE_SKIP;
+	}
+	return 0;
+}
+
+static void cache_sample_access(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats)
+{
+	uint32_t cluster = ctx->sampleCluster[(address >> ctx->cacheConfig.B) & (ctx->sampleGroups - 1)];
+	if (cluster == SAMPLE_SKIP) {
+		if (rw == READ) {
+			stats->reads = stats->reads + 1;
+		} else {
+			stats->writes = stats->writes + 1;
+		}
+		stats->accesses = stats->accesses + 1;
+		return;
+	}
+
+	uint64_t l1Misses = stats->l1_read_misses + stats->l1_write_misses;
+	uint64_t l2Misses = stats->l2_read_misses + stats->l2_write_misses;
+	ctx->simulate(ctx, rw, address, stats);
+
+	sample_counts *counts = ctx->samples + cluster;
+	counts->accesses++;
+	counts->l1_misses += stats->l1_read_misses + stats->l1_write_misses - l1Misses;
+	counts->l2_misses += stats->l2_read_misses + stats->l2_write_misses - l2Misses;
+}
+
+/**
+ * 95% confidence half-width of the ratio estimator sum(y) / sum(x) over the
+ * sampled groups, with finite population correction. x and y are weighted
+ * sums of the per-group counters.
+ */
+static double sample_ratio_ci(const cache_ctx_t *ctx, double ratio, double xAccesses, double xL1Misses, double yL1Misses, double yL2Misses)
+{
+	uint64_t n = ctx->sampleCount;
+	if (n < 2) {
+		return NAN;
+	}
+	double sumX = 0;
+	double sumSquares = 0;
+	for (uint64_t i = 0; i < n; i++) {
+		const sample_counts *counts = ctx->samples + i;
+		double x = xAccesses * counts->accesses + xL1Misses * counts->l1_misses;
+		double y = yL1Misses * counts->l1_misses + yL2Misses * counts->l2_misses;
+		sumX += x;
+		sumSquares += (y - ratio * x) * (y - ratio * x);
+	}
+	double meanX = sumX / n;
+	double fraction = (double)n / (double)ctx->sampleGroups;
+	double variance = (1 - fraction) * sumSquares / ((n - 1) * n * meanX * meanX);
+	return SAMPLE_Z95 * sqrt(variance);
+}
+
+/**
+ * Scale the counters of a sampled run up to the whole trace and compute the
+ * final statistics (this replaces cache_finalize_stats for sampled contexts)
+ *
+ * Miss and write-back counts are scaled by total accesses / sampled accesses.
+ * The confidence intervals treat every sampled set group as one cluster.
+ *
+ * @param ctx A context configured with cache_set_sampling
+ * @param stats The statistics gathered while sampling
+ * @param sample Set to the sample size and 95% confidence half-widths
+ */
+void cache_sample_estimate(const cache_ctx_t *ctx, struct cache_stats_t *stats, struct cache_sample_stats_t *sample)
+{
+	uint64_t sampled = 0;
+	for (uint64_t i = 0; i < ctx->sampleCount; i++) {
+		sampled += ctx->samples[i].accesses;
+	}
+
+	sample->sampled_sets = ctx->sampleCount;
+	sample->total_sets = ctx->sampleGroups;
+	sample->sampled_accesses = sampled;
+
+	double scale = sampled ? (double)stats->accesses / (double)sampled : 0;
+	stats->l1_read_misses = llround(stats->l1_read_misses * scale);
+	stats->l1_write_misses = llround(stats->l1_write_misses * scale);
+	stats->l2_read_misses = llround(stats->l2_read_misses * scale);
+	stats->l2_write_misses = llround(stats->l2_write_misses * scale);
+	stats->write_backs = llround(stats->write_backs * scale);
+	stats->l1_write_throughs = llround(stats->l1_write_throughs * scale);
+	stats->memory_stores = llround(stats->memory_stores * scale);
+	stats->memory_write_bytes = llround(stats->memory_write_bytes * scale);
+	cache_finalize_stats(stats);
+
+	/* AAT - l1_access_time = (l2_access_time * L1 misses + memory_access_time * L2 misses) / accesses */
+	double t2 = stats->l2_access_time;
+	double tm = stats->memory_access_time;
+	sample->l1_miss_rate_ci = sample_ratio_ci(ctx, stats->l1_miss_rate, 1, 0, 1, 0);
+	sample->l2_miss_rate_ci = sample_ratio_ci(ctx, stats->l2_miss_rate, 0, 1, 0, 1);
+	sample->avg_access_time_ci = sample_ratio_ci(ctx, stats->avg_access_time - stats->l1_access_time, 1, 0, t2, tm);
+}
+
+CACHE_INLINE void updateL1Cache(block* L1BLOCK, char rw, uint64_t addressIndex1, uint64_t addressTag1) {
+	L1BLOCK->tag = addressTag1;
+	L1BLOCK->valid = 1;
+	L1BLOCK->prefetched = 0;
+	if (rw == WRITE) {
+		L1BLOCK->dirty = 1;
+	} else {
+		L1BLOCK->dirty = 0;
+	}
+}
+
+/**
+ * Make room in an L2 set: the last invalid way, or a victim picked by the
+ * replacement policy, which is evicted
+ *
+ * @return The way to fill
+ */
+CACHE_INLINE uint64_t allocateL2(cache_ctx_t *ctx, const config cfg, uint64_t addressIndex2, struct cache_stats_t *stats) {
+	uint64_t blockPerSet = 1ull << cfg.S;
+	uint64_t set2 = addressIndex2 << cfg.S;
+	tag_store *L2 = &ctx->cache2;
+
+	for (int64_t i = blockPerSet - 1; i >= 0; i--) {
+		if (L2->valid[set2 + i] == 0) {
+			return i;
+		}
+	}
+
+	uint64_t way = 0;
+	if (ctx->repl.policy == REPL_LRU) {
+		uint64_t min = ctx->mainCounter;
+		for (uint64_t i = 0; i < blockPerSet; i++) {
+			if (L2->age[set2 + i] < min) {
+				min = L2->age[set2 + i];
+				way = i;
+			}
+		}
+	} else {
+		way = repl_victim(&ctx->repl, addressIndex2);
+	}
+	evictL2(ctx, cfg, set2 + way, addressIndex2, stats);
+	return way;
+}
+
+/**
+ * Look up the block of an L1 miss in the L2 and fill it there if it missed
+ *
+ * @param demand FALSE for L1 prefetches, whose L2 misses are not counted
+ * @return Whether the access triggers the L2 prefetcher (an L2 miss or the
+ *         first hit on a block the L2 prefetcher brought in)
+ */
+CACHE_INLINE int L1MISSED(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, int demand, struct cache_stats_t *stats) {
+	
+	uint64_t addressIndex2 = convert_index(addressTag1, addressIndex1, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+	uint64_t addressTag2 = convert_tag(addressTag1, addressIndex1, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+	uint64_t set2 = addressIndex2 << cfg.S;
+	tag_store *L2 = &ctx->cache2;
+
+	int64_t hit2 = tag_store_scan(L2, addressIndex2, addressTag2, cfg.S, cfg.lanes);
+	if (hit2 >= 0) {
+		int trigger = FALSE;
+		if (L2->prefetched[set2 + hit2] > 0) {
+			L2->prefetched[set2 + hit2] = 0;
+			stats->l2_prefetch_hits = stats->l2_prefetch_hits + 1;
+			/* L1 prefetches have no one waiting on them */
+			if (demand && ctx->mainCounter - L2->age[set2 + hit2] < ctx->prefetch2.latency) {
+				stats->l2_prefetch_late = stats->l2_prefetch_late + 1;
+			}
+			trigger = TRUE;
+		}
+		if (ctx->inclusion == INCLUSION_EXCLUSIVE) {
+			/* The block moves up into the L1 */
+			L1BLOCK->dirty |= L2->dirty[set2 + hit2];
+			L2->valid[set2 + hit2] = 0;
+			L2->dirty[set2 + hit2] = 0;
+			if (rw == WRITE && ctx->write1 == WRITE_THROUGH) {
+				memoryStore(ctx, cfg, address, stats);
+			}
+			return trigger;
+		}
+		L2->age[set2 + hit2] = ctx->mainCounter;
+		repl_touch(&ctx->repl, addressIndex2, hit2);
+		if (rw == WRITE) {
+			writeL2(ctx, cfg, set2 + hit2, ctx->write1 == WRITE_THROUGH, address, stats);
+		}
+		return trigger;
+	}
+
+	if (demand) {
+		updateL2Stats(stats, rw);
+	}
+	if (ctx->inclusion == INCLUSION_EXCLUSIVE) {
+		/* Blocks from memory only go to the L1 */
+		if (rw == WRITE && ctx->write1 == WRITE_THROUGH) {
+			memoryStore(ctx, cfg, address, stats);
+		}
+		return TRUE;
+	}
+
+	uint64_t way = allocateL2(ctx, cfg, addressIndex2, stats);
+	L2->tags[set2 + way] = addressTag2;
+	L2->valid[set2 + way] = 1;
+	L2->age[set2 + way] = ctx->mainCounter;
+	L2->dirty[set2 + way] = 0;
+	L2->prefetched[set2 + way] = 0;
+	repl_fill(&ctx->repl, addressIndex2, way);
+	if (rw == WRITE) {
+		writeL2(ctx, cfg, set2 + way, ctx->write1 == WRITE_THROUGH, address, stats);
+	}
+	return TRUE;
+}
+
+/**
+ * A store miss of a no-write-allocate L1. The store goes on to the L2, which
+ * handles it by its own write and allocation policies. Not inlined: it only
+ * runs for that policy.
+ *
+ * @return Whether the store triggers the L2 prefetcher, see L1MISSED
+ */
+static int storeMissL1(cache_ctx_t *ctx, const config cfg, uint64_t address, struct cache_stats_t *stats) {
+	uint64_t l2Bits = cfg.C2 - cfg.B - cfg.S;
+	uint64_t blockAddress = address >> cfg.B;
+	uint64_t addressIndex2 = blockAddress & ((1ull << l2Bits) - 1);
+	uint64_t addressTag2 = blockAddress >> l2Bits;
+	uint64_t set2 = addressIndex2 << cfg.S;
+	tag_store *L2 = &ctx->cache2;
+	stats->l1_write_throughs = stats->l1_write_throughs + 1;
+
+	int64_t hit2 = tag_store_scan(L2, addressIndex2, addressTag2, cfg.S, cfg.lanes);
+	if (hit2 >= 0) {
+		int trigger = FALSE;
+		if (L2->prefetched[set2 + hit2] > 0) {
+			L2->prefetched[set2 + hit2] = 0;
+			stats->l2_prefetch_hits = stats->l2_prefetch_hits + 1;
+			trigger = TRUE;
+		}
+		L2->age[set2 + hit2] = ctx->mainCounter;
+		repl_touch(&ctx->repl, addressIndex2, hit2);
+		writeL2(ctx, cfg, set2 + hit2, TRUE, address, stats);
+		return trigger;
+	}
+
+	updateL2Stats(stats, WRITE);
+	if (ctx->allocate2 == WRITE_NO_ALLOCATE || ctx->inclusion == INCLUSION_EXCLUSIVE) {
+		memoryStore(ctx, cfg, address, stats);
+		return TRUE;
+	}
+	uint64_t way = allocateL2(ctx, cfg, addressIndex2, stats);
+	L2->tags[set2 + way] = addressTag2;
+	L2->valid[set2 + way] = 1;
+	L2->age[set2 + way] = ctx->mainCounter;
+	L2->dirty[set2 + way] = 0;
+	L2->prefetched[set2 + way] = 0;
+	repl_fill(&ctx->repl, addressIndex2, way);
+	writeL2(ctx, cfg, set2 + way, TRUE, address, stats);
+	return TRUE;
+}
+
+/**
+ * A store reaching the L2 copy of a block
+ *
+ * @param slot The entry of the block in the L2 tag store
+ * @param through Whether the store itself reaches the L2. Stores absorbed by
+ *        a write-back L1 only mark the L2 copy, to be written back later.
+ */
+CACHE_INLINE void writeL2(cache_ctx_t *ctx, const config cfg, uint64_t slot, int through, uint64_t address, struct cache_stats_t *stats) {
+	if (ctx->write2 == WRITE_BACK) {
+		ctx->cache2.dirty[slot] = 1;
+	} else if (through) {
+		memoryStore(ctx, cfg, address, stats);
+	}
+}
+
+/**
+ * Write one store to memory, through the write buffer if there is one
+ */
+CACHE_INLINE void memoryStore(cache_ctx_t *ctx, const config cfg, uint64_t address, struct cache_stats_t *stats) {
+	stats->memory_stores = stats->memory_stores + 1;
+	if (ctx->writeBuffer) {
+		stats->memory_write_bytes += writebuf_write(ctx->writeBuffer, ctx->mainCounter, address, FALSE);
+	} else {
+		stats->memory_write_bytes += 1ull << cache_store_shift(cfg.B);
+	}
+}
+
+/**
+ * Write a whole block back to memory, through the write buffer if there is one
+ *
+ * @param blockAddress The address of the block without its offset (address >> B)
+ */
+CACHE_INLINE void memoryWriteBlock(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, struct cache_stats_t *stats) {
+	stats->write_backs = stats->write_backs + 1;
+	if (ctx->attribution) {
+		attribution_write_back(ctx->attribution, blockAddress);
+	}
+	if (ctx->writeBuffer) {
+		stats->memory_write_bytes += writebuf_write(ctx->writeBuffer, ctx->mainCounter, blockAddress << cfg.B, TRUE);
+	} else {
+		stats->memory_write_bytes += 1ull << cfg.B;
+	}
+}
+
+/**
+ * The least recently used way of an L1 set, or its first invalid way
+ */
+CACHE_INLINE block* victimL1(block* set1, uint64_t waysL1) {
+	block* L1BLOCK = set1;
+	for (uint64_t i = 0; i < waysL1 && L1BLOCK->valid; i++) {
+		if (!set1[i].valid || set1[i].counter < L1BLOCK->counter) {
+			L1BLOCK = set1 + i;
+		}
+	}
+	return L1BLOCK;
+}
+
+/**
+ * Bring a block into the L1 way L1BLOCK and send the block it replaces down
+ * the hierarchy
+ *
+ * @param demand FALSE for prefetches
+ * @return Whether the access triggers the L2 prefetcher, see L1MISSED
+ */
+CACHE_INLINE int missL1(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, int demand, struct cache_stats_t *stats) {
+	block evicted = *L1BLOCK;
+	uint64_t evictedAddress = (evicted.tag << (cfg.C1 - cfg.B - cfg.S1)) | addressIndex1; /* address >> B */
+	if (evicted.valid > 0 && evicted.prefetched > 0) {
+		stats->l1_prefetch_useless = stats->l1_prefetch_useless + 1;
+	}
+
+	int trigger;
+	if (rw == WRITE && ctx->write1 == WRITE_THROUGH) {
+		stats->l1_write_throughs = stats->l1_write_throughs + 1;
+		updateL1Cache(L1BLOCK, READ, addressIndex1, addressTag1);
+	} else {
+		updateL1Cache(L1BLOCK, rw, addressIndex1, addressTag1);
+	}
+	/* An exclusive L2 takes the L1 victim only once the requested block has left it */
+	if (ctx->inclusion == INCLUSION_EXCLUSIVE) {
+		trigger = L1MISSED(ctx, cfg, L1BLOCK, rw, address, addressIndex1, addressTag1, demand, stats);
+		if (evicted.valid) {
+			evictL1(ctx, cfg, evictedAddress, evicted.dirty, stats);
+		}
+	} else {
+		if (evicted.valid) {
+			evictL1(ctx, cfg, evictedAddress, evicted.dirty, stats);
+		}
+		trigger = L1MISSED(ctx, cfg, L1BLOCK, rw, address, addressIndex1, addressTag1, demand, stats);
+	}
+	return trigger;
+}
+
+/**
+ * Count the first demand hit on a block the L1 prefetcher brought in
+ *
+ * @return TRUE, such hits trigger further prefetches
+ */
+CACHE_INLINE int usePrefetchedL1(cache_ctx_t *ctx, block* L1BLOCK, struct cache_stats_t *stats) {
+	L1BLOCK->prefetched = 0;
+	stats->l1_prefetch_hits = stats->l1_prefetch_hits + 1;
+	/* counter still holds the time of the fill */
+	if (ctx->mainCounter - L1BLOCK->counter < ctx->prefetch1.latency) {
+		stats->l1_prefetch_late = stats->l1_prefetch_late + 1;
+	}
+	return TRUE;
+}
+
+/**
+ * Prefetch a block into the L1, fetching it through the L2 like a read miss
+ *
+ * @param blockAddress The address of the block without its offset (address >> B)
+ */
+CACHE_INLINE void prefetchL1(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, struct cache_stats_t *stats) {
+	uint64_t l1Bits = cfg.C1 - cfg.B - cfg.S1;
+	uint64_t addressIndex1 = blockAddress & ((1ull << l1Bits) - 1);
+	uint64_t addressTag1 = blockAddress >> l1Bits;
+	block* set1 = ctx->cache1 + (addressIndex1 << cfg.S1);
+	for (uint64_t i = 0; i < (1ull << cfg.S1); i++) {
+		if (set1[i].tag == addressTag1 && set1[i].valid > 0) {
+			return;
+		}
+	}
+	if (ctx->victimEntries && findVictim(ctx, blockAddress)) {
+		return;
+	}
+
+	block* L1BLOCK = victimL1(set1, 1ull << cfg.S1);
+	stats->l1_prefetches = stats->l1_prefetches + 1;
+	missL1(ctx, cfg, L1BLOCK, READ, blockAddress << cfg.B, addressIndex1, addressTag1, FALSE, stats);
+	L1BLOCK->prefetched = 1;
+	L1BLOCK->counter = ctx->mainCounter;
+}
+
+/**
+ * Prefetch a block from memory into the L2 only
+ *
+ * @param blockAddress The address of the block without its offset (address >> B)
+ */
+CACHE_INLINE void prefetchL2(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, struct cache_stats_t *stats) {
+	uint64_t l2Bits = cfg.C2 - cfg.B - cfg.S;
+	uint64_t addressIndex2 = blockAddress & ((1ull << l2Bits) - 1);
+	uint64_t addressTag2 = blockAddress >> l2Bits;
+	uint64_t set2 = addressIndex2 << cfg.S;
+	tag_store *L2 = &ctx->cache2;
+	if (tag_store_scan(L2, addressIndex2, addressTag2, cfg.S, cfg.lanes) >= 0) {
+		return;
+	}
+	if (ctx->inclusion == INCLUSION_EXCLUSIVE) {
+		/* Keep the levels exclusive: skip blocks the L1 side already has */
+		uint64_t l1Bits = cfg.C1 - cfg.B - cfg.S1;
+		uint64_t addressIndex1 = blockAddress & ((1ull << l1Bits) - 1);
+		uint64_t addressTag1 = blockAddress >> l1Bits;
+		block* set1 = ctx->cache1 + (addressIndex1 << cfg.S1);
+		for (uint64_t i = 0; i < (1ull << cfg.S1); i++) {
+			if (set1[i].tag == addressTag1 && set1[i].valid > 0) {
+				return;
+			}
+		}
+		if (ctx->victimEntries && findVictim(ctx, blockAddress)) {
+			return;
+		}
+	}
+
+	uint64_t way = allocateL2(ctx, cfg, addressIndex2, stats);
+	L2->tags[set2 + way] = addressTag2;
+	L2->valid[set2 + way] = 1;
+	L2->age[set2 + way] = ctx->mainCounter;
+	L2->dirty[set2 + way] = 0;
+	L2->prefetched[set2 + way] = 1;
+	repl_fill(&ctx->repl, addressIndex2, way);
+	stats->l2_prefetches = stats->l2_prefetches + 1;
+}
+
+/**
+ * Train the prefetcher of a level on a demand access and issue its prefetches.
+ * Not inlined: it only runs when a prefetcher is enabled.
+ *
+ * @param level 1 or 2
+ * @param blockAddress The address of the accessed block without its offset
+ * @param trigger Whether the access missed or was the first hit on a prefetched block
+ */
+static void issuePrefetches(cache_ctx_t *ctx, const config cfg, int level, uint64_t blockAddress, int trigger, struct cache_stats_t *stats) {
+	uint64_t targets[PREFETCH_MAX_DEGREE];
+	prefetch_state *state = level == 1 ? &ctx->prefetch1 : &ctx->prefetch2;
+	size_t n = prefetch_train(state, blockAddress, trigger, targets);
+	for (size_t i = 0; i < n; i++) {
+		if (level == 1) {
+			prefetchL1(ctx, cfg, targets[i], stats);
+		} else {
+			prefetchL2(ctx, cfg, targets[i], stats);
+		}
+	}
+}
+
+/**
+ * Find a block in the victim cache
+ *
+ * @param blockAddress The address of the block without its offset (address >> B)
+ * @return The entry holding the block, or NULL
+ */
+CACHE_INLINE block* findVictim(cache_ctx_t *ctx, uint64_t blockAddress) {
+	for (uint64_t i = 0; i < ctx->victimEntries; i++) {
+		if (ctx->victim[i].tag == blockAddress && ctx->victim[i].valid > 0) {
+			return ctx->victim + i;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Serve an L1 miss from the victim cache by swapping the block with the L1
+ * victim in L1BLOCK. The access then proceeds as an L1 hit.
+ *
+ * @return TRUE if the block was in the victim cache
+ */
+CACHE_INLINE int victimHit(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, struct cache_stats_t *stats) {
+	uint64_t l1Bits = cfg.C1 - cfg.B - cfg.S1;
+	block* entry = findVictim(ctx, (addressTag1 << l1Bits) | addressIndex1);
+	if (!entry) {
+		return FALSE;
+	}
+	stats->victim_hits = stats->victim_hits + 1;
+
+	block evicted = *L1BLOCK;
+	if (evicted.valid > 0 && evicted.prefetched > 0) {
+		stats->l1_prefetch_useless = stats->l1_prefetch_useless + 1;
+	}
+	L1BLOCK->tag = addressTag1;
+	L1BLOCK->valid = 1;
+	L1BLOCK->dirty = entry->dirty;
+	L1BLOCK->prefetched = 0;
+	if (evicted.valid > 0) {
+		entry->tag = (evicted.tag << l1Bits) | addressIndex1;
+		entry->dirty = evicted.dirty;
+		entry->counter = ctx->mainCounter;
+	} else {
+		entry->valid = 0;
+		entry->dirty = 0;
+	}
+	L1HIT(ctx, cfg, L1BLOCK, rw, address, addressIndex1, addressTag1, stats);
+	return TRUE;
+}
+
+/**
+ * Handle a block leaving the L1. With a victim cache it is kept there and the
+ * oldest victim moves on to the L2 instead.
+ */
+CACHE_INLINE void evictL1(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, uint8_t dirty, struct cache_stats_t *stats) {
+	if (ctx->victimEntries) {
+		block* entry = ctx->victim;
+		for (uint64_t i = 0; i < ctx->victimEntries && entry->valid; i++) {
+			if (!ctx->victim[i].valid || ctx->victim[i].counter < entry->counter) {
+				entry = ctx->victim + i;
+			}
+		}
+		block displaced = *entry;
+		entry->tag = blockAddress;
+		entry->valid = 1;
+		entry->dirty = dirty;
+		entry->counter = ctx->mainCounter;
+		if (!displaced.valid) {
+			return;
+		}
+		blockAddress = displaced.tag;
+		dirty = displaced.dirty;
+	}
+	writeBlockToL2(ctx, cfg, blockAddress, dirty, stats);
+}
+
+/**
+ * Hand a block evicted from the L1 side down to the L2. An exclusive L2 takes
+ * every victim. Otherwise only dirty victims are written back: an inclusive L2
+ * already has the block marked dirty, a non-inclusive one may have dropped it,
+ * in which case the data goes to memory.
+ *
+ * @param blockAddress The address of the block without its offset (address >> B)
+ */
+CACHE_INLINE void writeBlockToL2(cache_ctx_t *ctx, const config cfg, uint64_t blockAddress, uint8_t dirty, struct cache_stats_t *stats) {
+	uint64_t l2Bits = cfg.C2 - cfg.B - cfg.S;
+	uint64_t addressIndex2 = blockAddress & ((1ull << l2Bits) - 1);
+	uint64_t addressTag2 = blockAddress >> l2Bits;
+	uint64_t set2 = addressIndex2 << cfg.S;
+	tag_store *L2 = &ctx->cache2;
+
+	if (ctx->inclusion == INCLUSION_EXCLUSIVE) {
+		stats->l1_write_backs = stats->l1_write_backs + 1;
+		uint64_t way = allocateL2(ctx, cfg, addressIndex2, stats);
+		L2->tags[set2 + way] = addressTag2;
+		L2->valid[set2 + way] = 1;
+		L2->age[set2 + way] = ctx->mainCounter;
+		L2->dirty[set2 + way] = dirty && ctx->write2 == WRITE_BACK;
+		L2->prefetched[set2 + way] = 0;
+		repl_fill(&ctx->repl, addressIndex2, way);
+		if (dirty && ctx->write2 == WRITE_THROUGH) {
+			memoryWriteBlock(ctx, cfg, blockAddress, stats);
+		}
+		return;
+	}
+	if (!dirty) {
+		return;
+	}
+	stats->l1_write_backs = stats->l1_write_backs + 1;
+	/* A write-through L2 passes the block on, it never holds dirty data */
+	if (ctx->inclusion == INCLUSION_INCLUSIVE && ctx->write2 == WRITE_BACK) {
+		return;
+	}
+	int64_t way = ctx->write2 == WRITE_BACK ? tag_store_scan(L2, addressIndex2, addressTag2, cfg.S, cfg.lanes) : -1;
+	if (way >= 0) {
+		L2->dirty[set2 + way] = 1;
+	} else {
+		memoryWriteBlock(ctx, cfg, blockAddress, stats);
+	}
+}
+
+/**
+ * Remove a block from the L2. An inclusive L2 also invalidates the copies in
+ * the L1 and the victim cache, and writes the block back if any copy is dirty.
+ */
+CACHE_INLINE void evictL2(cache_ctx_t *ctx, const config cfg, uint64_t LRUblock, uint64_t addressIndex2, struct cache_stats_t *stats) {
+	uint64_t tag2 = ctx->cache2.tags[LRUblock];
+	unsigned int found = 0;
+	if (ctx->inclusion == INCLUSION_INCLUSIVE) {
+		uint64_t addressTag1 = convert_tag_l1(tag2, addressIndex2, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+		uint64_t addressIndex1 = convert_index_l1(tag2, addressIndex2, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+		block* set1 = ctx->cache1 + (addressIndex1 << cfg.S1);
+		for (uint64_t i = 0; i < (1ull << cfg.S1); i++) {
+			if (set1[i].tag == addressTag1 && set1[i].valid > 0) {
+				if (set1[i].dirty > 0) {
+					found = 1;
+				}
+				if (set1[i].prefetched > 0) {
+					stats->l1_prefetch_useless = stats->l1_prefetch_useless + 1;
+				}
+				set1[i].valid = 0;
+				set1[i].dirty = 0;
+				stats->back_invalidations = stats->back_invalidations + 1;
+				break;
+			}
+		}
+		if (ctx->victimEntries) {
+			block* entry = findVictim(ctx, (tag2 << (cfg.C2 - cfg.B - cfg.S)) | addressIndex2);
+			if (entry) {
+				if (entry->dirty > 0) {
+					found = 1;
+				}
+				entry->valid = 0;
+				entry->dirty = 0;
+				stats->back_invalidations = stats->back_invalidations + 1;
+			}
+		}
+	}
+	if (ctx->cache2.prefetched[LRUblock] > 0) {
+		stats->l2_prefetch_useless = stats->l2_prefetch_useless + 1;
+	}
+	if (ctx->cache2.dirty[LRUblock] > 0 || found > 0) {
+		memoryWriteBlock(ctx, cfg, (tag2 << (cfg.C2 - cfg.B - cfg.S)) | addressIndex2, stats);
+	}
+}
+
+CACHE_INLINE void updateL2Stats(struct cache_stats_t *stats, char rw) {
+	if (rw == READ) {
+		stats->l2_read_misses = stats->l2_read_misses + 1;
+	} else {
+		stats->l2_write_misses = stats->l2_write_misses + 1;
+	}
+}
+
+
+CACHE_INLINE void updateL1Stats(struct cache_stats_t *stats, char rw) {
+	if (rw == READ) {
+		stats->l1_read_misses = stats->l1_read_misses + 1;
+	} else {
+		stats->l1_write_misses = stats->l1_write_misses + 1;
+	}
+}
+
+
+CACHE_INLINE void updateInitialStats(cache_ctx_t *ctx, char rw, struct cache_stats_t *stats) {
+	if (rw == READ) {
+		stats->reads = stats->reads + 1;
+	} else {
+		stats->writes = stats->writes + 1;
+	}
+
+	ctx->mainCounter = ctx->mainCounter + 1;
+	stats->accesses = stats->accesses + 1;
+}
+
+
+
+CACHE_INLINE void L1HIT(cache_ctx_t *ctx, const config cfg, block* L1BLOCK, char rw, uint64_t address, uint64_t addressIndex1, uint64_t addressTag1, struct cache_stats_t *stats) {
+	int through = rw == WRITE && ctx->write1 == WRITE_THROUGH;
+	if (through) {
+		stats->l1_write_throughs = stats->l1_write_throughs + 1;
+	} else if (rw == WRITE) {
+		L1BLOCK->dirty = 1;
+	}
+	if (ctx->inclusion == INCLUSION_EXCLUSIVE) {
+		/* The block is not in the L2 */
+		if (through) {
+			memoryStore(ctx, cfg, address, stats);
+		}
+		return;
+	}
+
+	uint64_t addressIndex2 = convert_index(addressTag1, addressIndex1, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+	uint64_t addressTag2 = convert_tag(addressTag1, addressIndex1, cfg.C1 - cfg.S1, cfg.C2, cfg.B, cfg.S);
+	uint64_t set2 = addressIndex2 << cfg.S;
+	int64_t way = tag_store_scan(&ctx->cache2, addressIndex2, addressTag2, cfg.S, cfg.lanes);
+	if (way >= 0) {
+		ctx->cache2.age[set2 + way] = ctx->mainCounter;
+		repl_touch(&ctx->repl, addressIndex2, way);
+		if (rw == WRITE) {
+			writeL2(ctx, cfg, set2 + way, through, address, stats);
+		}
+	} else if (through) {
+		/* Stores passing a level that does not hold the block go on to memory */
+		memoryStore(ctx, cfg, address, stats);
+	}
+
+}
+
+
+
+/**
+ * Subroutine for freeing up memory, and performing any final calculations before the statistics
+ * are outputed by the driver
+ */
+void cache_cleanup (struct cache_stats_t *stats)
+{
+	cache_destroy(defaultCtx);
+	defaultCtx = NULL;
+	cache_finalize_stats(stats);
+}
+
+/**
+ * Release a context created by cache_create
+ */
+void cache_destroy(cache_ctx_t *ctx)
+{
+	if (ctx) {
+		free(ctx->cache1);
+		tag_store_free(&ctx->cache2);
+		free(ctx->victim);
+		prefetch_free(&ctx->prefetch1);
+		prefetch_free(&ctx->prefetch2);
+		if (ctx->writeBuffer) {
+			writebuf_free(ctx->writeBuffer);
+			free(ctx->writeBuffer);
+		}
+		if (ctx->timing) {
+			timing_free(ctx->timing);
+			free(ctx->timing);
+		}
+		attribution_destroy(ctx->attribution);
+		free(ctx->sampleCluster);
+		free(ctx->samples);
+		repl_free(&ctx->repl);
+		free(ctx);
+	}
+}
+
+/**
+ * Derive the miss rates and access times from the raw counters in stats. This
+ * is the final step of cache_cleanup, exposed for callers of the context API.
+ */
+void cache_finalize_stats(struct cache_stats_t *stats)
+{
+	stats->read_misses = stats->l1_read_misses + stats->l2_read_misses;
+	stats->write_misses = stats->l1_write_misses + stats->l2_write_misses;
+	stats->misses = stats->read_misses + stats->write_misses;
+
+	stats->l1_miss_rate = ((double)stats->l1_read_misses + (double)stats->l1_write_misses) / (double)stats->accesses;
+	stats->l2_miss_rate = ((double)stats->l2_read_misses + (double)stats->l2_write_misses) / ((double)stats->l1_read_misses + (double)stats->l1_write_misses);
+	stats->miss_rate = (double)stats->misses / (double)stats->accesses;
+
+	stats->l2_avg_access_time = (double)stats->l2_access_time + stats->l2_miss_rate*stats->memory_access_time;
+	stats->avg_access_time = (double)stats->l1_access_time + stats->l1_miss_rate*stats->l2_avg_access_time;
+
+	uint64_t l1Misses = stats->l1_read_misses + stats->l1_write_misses;
+	uint64_t l2Misses = stats->l2_read_misses + stats->l2_write_misses;
+	stats->l1_prefetch_accuracy = prefetch_ratio(stats->l1_prefetch_hits, stats->l1_prefetches);
+	stats->l1_prefetch_coverage = prefetch_ratio(stats->l1_prefetch_hits, stats->l1_prefetch_hits + l1Misses);
+	stats->l1_prefetch_timeliness = prefetch_ratio(stats->l1_prefetch_hits - stats->l1_prefetch_late, stats->l1_prefetch_hits);
+	stats->l2_prefetch_accuracy = prefetch_ratio(stats->l2_prefetch_hits, stats->l2_prefetches);
+	stats->l2_prefetch_coverage = prefetch_ratio(stats->l2_prefetch_hits, stats->l2_prefetch_hits + l2Misses);
+	stats->l2_prefetch_timeliness = prefetch_ratio(stats->l2_prefetch_hits - stats->l2_prefetch_late, stats->l2_prefetch_hits);
+}
+
+/* a / b, or 0 when there was nothing to measure */
+static double prefetch_ratio(uint64_t a, uint64_t b)
+{
+	return b ? (double)a / (double)b : 0;
 }
 
 /**
@@ -33,12 +33,226 @@ struct cache_stats_t {
 
     double l2_avg_access_time;
     double avg_access_time;
+
+    /* Hierarchy traffic, see cache_set_inclusion and cache_set_victim_cache */
+    uint64_t victim_hits; /* L1 misses served by the victim cache, not counted as L1 misses */
+    uint64_t back_invalidations; /* L1 and victim cache blocks invalidated by L2 evictions */
+    uint64_t l1_write_backs; /* Blocks written from the L1/victim cache into the L2 */
+
+    /* Prefetching, see cache_set_prefetcher */
+    uint64_t l1_prefetches; /* Blocks brought into the L1 by its prefetcher */
+    uint64_t l1_prefetch_hits; /* Prefetched blocks that were used */
+    uint64_t l1_prefetch_late; /* Prefetch hits sooner than the prefetch latency */
+    uint64_t l1_prefetch_useless; /* Prefetched blocks evicted unused */
+    uint64_t l2_prefetches;
+    uint64_t l2_prefetch_hits;
+    uint64_t l2_prefetch_late;
+    uint64_t l2_prefetch_useless;
+
+    double l1_prefetch_accuracy; /* Hits per prefetch */
+    double l1_prefetch_coverage; /* Fraction of would-be misses removed */
+    double l1_prefetch_timeliness; /* Fraction of hits that were not late */
+    double l2_prefetch_accuracy;
+    double l2_prefetch_coverage;
+    double l2_prefetch_timeliness;
+
+    /* Multi-core coherence, see coherence.h */
+    uint64_t invalidations; /* Copies in other L1s invalidated by this core's writes */
+    uint64_t upgrades; /* Write hits on shared blocks */
+    uint64_t coherence_misses; /* L1 misses on blocks another core invalidated */
+    uint64_t false_sharing_misses; /* Coherence misses on words no other core wrote */
+    uint64_t sharing_write_backs; /* Modified copies of other cores written back to the L2 */
+    uint64_t cross_core_evictions; /* L2 evictions of blocks another core fetched last */
+
+    /* Write policies, see cache_set_write_policy */
+    uint64_t l1_write_throughs; /* Stores the L1 passed on to the L2 */
+    uint64_t memory_stores; /* Stores written to memory on their own, not as part of a block */
+    uint64_t memory_write_bytes; /* Write-backs and stores, after write combining */
 };
 
 void cache_init(uint64_t C1, uint64_t C2,  uint64_t S, uint64_t B);
 void cache_access (char rw, uint64_t address, struct cache_stats_t *stats);
+void cache_access_batch(const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats);
 void cache_cleanup (struct cache_stats_t *stats);
 
+/*
+ * Reentrant interface. Every context owns its own L1/L2 state, so any number
+ * of caches can be simulated in one process and distinct contexts may be used
+ * from different threads concurrently. cache_init/cache_access/cache_cleanup
+ * are wrappers around a single built-in context.
+ */
+typedef struct cache_ctx cache_ctx_t;
+
+cache_ctx_t *cache_create(uint64_t C1, uint64_t C2, uint64_t S, uint64_t B);
+void cache_access_ctx(cache_ctx_t *ctx, char rw, uint64_t address, struct cache_stats_t *stats);
+void cache_access_batch_ctx(cache_ctx_t *ctx, const char *rw, const uint64_t *address, size_t n, struct cache_stats_t *stats);
+void cache_destroy(cache_ctx_t *ctx);
+void cache_finalize_stats(struct cache_stats_t *stats);
+int cache_is_specialized(const cache_ctx_t *ctx);
+
+/*
+ * L2 replacement policies
+ */
+typedef enum cache_repl_t {
+    REPL_LRU,
+    REPL_PLRU, /* Tree pseudo-LRU */
+    REPL_SRRIP, /* Static re-reference interval prediction */
+    REPL_BRRIP, /* Bimodal re-reference interval prediction */
+    REPL_LFU,
+    REPL_RANDOM
+} cache_repl_t;
+
+int cache_set_replacement(cache_ctx_t *ctx, cache_repl_t policy);
+
+/*
+ * Relation of the L2 to the L1 and the victim cache
+ */
+typedef enum cache_inclusion_t {
+    INCLUSION_INCLUSIVE, /* L2 evictions back-invalidate the L1 */
+    INCLUSION_NONINCLUSIVE, /* Misses fill both levels, L2 evictions leave the L1 alone */
+    INCLUSION_EXCLUSIVE /* A block is in the L1 or the L2, L1 victims move to the L2 */
+} cache_inclusion_t;
+
+int cache_set_inclusion(cache_ctx_t *ctx, cache_inclusion_t inclusion);
+int cache_set_l1_associativity(cache_ctx_t *ctx, uint64_t S1);
+int cache_set_victim_cache(cache_ctx_t *ctx, uint64_t entries);
+
+/*
+ * Hardware prefetchers
+ */
+typedef enum cache_prefetch_t {
+    PREFETCH_NONE,
+    PREFETCH_NEXTLINE, /* The next N blocks */
+    PREFETCH_STRIDE, /* Constant strides within a region, no PC needed */
+    PREFETCH_STREAM /* Several ascending or descending streams */
+} cache_prefetch_t;
+
+int cache_set_prefetcher(cache_ctx_t *ctx, int level, cache_prefetch_t type, uint64_t degree, uint64_t latency);
+
+/*
+ * Write policies of one level. Traces carry no access size, every store is
+ * taken to write CACHE_STORE_BYTES (at most a block).
+ */
+typedef enum cache_write_t {
+    WRITE_BACK, /* Stores dirty the block, which is written when it is evicted */
+    WRITE_THROUGH /* Every store is passed on to the next level, blocks stay clean */
+} cache_write_t;
+
+typedef enum cache_allocate_t {
+    WRITE_ALLOCATE, /* A store miss fetches the block */
+    WRITE_NO_ALLOCATE /* A store miss is passed on without filling the level */
+} cache_allocate_t;
+
+#define CACHE_STORE_SHIFT 3
+#define CACHE_STORE_BYTES (1 << CACHE_STORE_SHIFT)
+
+/* log2 of the bytes one store writes: CACHE_STORE_BYTES, or a smaller block */
+static inline uint64_t cache_store_shift(uint64_t B) {
+    return B < CACHE_STORE_SHIFT ? B : CACHE_STORE_SHIFT;
+}
+
+int cache_set_write_policy(cache_ctx_t *ctx, int level, cache_write_t write, cache_allocate_t allocate);
+
+/*
+ * Coalescing write buffer in front of memory. Write-backs and stores going to
+ * memory wait in it and stores to a block that is already queued are merged.
+ * The core issues one access per cycle and stalls when the buffer is full.
+ */
+struct cache_write_buffer_config_t {
+    uint64_t entries; /* Blocks the buffer holds */
+    uint64_t drain_interval; /* Cycles memory takes per buffered block */
+};
+
+struct cache_write_buffer_stats_t {
+    uint64_t writes; /* Write-backs and stores that entered the buffer */
+    uint64_t coalesced; /* Writes merged into a queued block */
+    uint64_t memory_writes; /* Blocks written to memory, including the ones still queued */
+    uint64_t stalls; /* Writes that found the buffer full */
+    uint64_t stall_cycles;
+    uint64_t max_occupancy;
+    double avg_occupancy;
+};
+
+int cache_set_write_buffer(cache_ctx_t *ctx, const struct cache_write_buffer_config_t *config);
+void cache_write_buffer_estimate(const cache_ctx_t *ctx, struct cache_write_buffer_stats_t *buffer);
+
+/*
+ * Set sampling: simulate only a fraction of the sets and scale the results.
+ * The *_ci fields are half-widths of 95% confidence intervals.
+ */
+struct cache_sample_stats_t {
+    uint64_t sampled_sets;
+    uint64_t total_sets;
+    uint64_t sampled_accesses;
+
+    double l1_miss_rate_ci;
+    double l2_miss_rate_ci;
+    double avg_access_time_ci;
+};
+
+int cache_set_sampling(cache_ctx_t *ctx, uint64_t shift);
+void cache_sample_estimate(const cache_ctx_t *ctx, struct cache_stats_t *stats, struct cache_sample_stats_t *sample);
+
+/*
+ * Cycle model with MSHRs, non-blocking misses and a memory bandwidth limit.
+ * The access times in cache_stats_t are used as the latency of every level.
+ */
+struct cache_timing_config_t {
+    uint64_t l1_mshrs; /* Outstanding L1 misses before the core stalls */
+    uint64_t l2_mshrs; /* Outstanding memory requests */
+    uint64_t memory_interval; /* Cycles between two block transfers from memory */
+};
+
+/* Latency histogram bucket k counts latencies in [2^k, 2^(k+1)), bucket 0 also 0 */
+#define CACHE_TIMING_BUCKETS 16
+
+struct cache_timing_stats_t {
+    uint64_t cycles;
+    uint64_t stall_cycles; /* Cycles the core waited for a free L1 MSHR */
+    uint64_t mshr_merges; /* Accesses to blocks that were still being filled */
+    uint64_t memory_requests;
+    uint64_t latency_histogram[CACHE_TIMING_BUCKETS];
+
+    double accesses_per_cycle;
+    double avg_latency; /* Measured, unlike avg_access_time */
+    double mlp; /* Memory requests in flight on average while there is one */
+    double memory_busy; /* Fraction of cycles with a memory request in flight */
+};
+
+int cache_set_timing(cache_ctx_t *ctx, const struct cache_timing_config_t *config);
+void cache_timing_estimate(const cache_ctx_t *ctx, struct cache_timing_stats_t *timing);
+
+/*
+ * Miss attribution by address region and L2 set, with a 3C classification.
+ * The results are read and exported through attribution.h.
+ */
+struct attribution_t;
+
+int cache_set_attribution(cache_ctx_t *ctx, uint64_t regionBits);
+struct attribution_t *cache_attribution(const cache_ctx_t *ctx);
+
+/*
+ * Checkpoints of the complete L1/L2 state (blocks, replacement and prefetcher
+ * state, victim cache, LRU clock) and the statistics, so that a warmup only
+ * has to be simulated once. A checkpoint can only be restored into a cache of
+ * the same configuration built by the same simulator binary. Write buffer,
+ * cycle model, attribution and sampling state are not part of it, so caches
+ * with any of them are refused.
+ */
+int cache_checkpoint_save(const cache_ctx_t *ctx, const struct cache_stats_t *stats, uint64_t trace_offset, const char *path);
+int cache_checkpoint_restore(cache_ctx_t *ctx, struct cache_stats_t *stats, uint64_t *trace_offset, const char *path);
+
+/*
+ * Weighted accesses, for replaying reduced traces (see trace_reduce): an
+ * access followed by reads and writes that hit its block. Without prefetchers,
+ * a no-write-allocate L1, a write buffer, a cycle model, attribution or
+ * sampling, the repeats are applied at once; otherwise they are simulated one
+ * by one. cache_check_reduction tells whether a trace reduced for 2^block_bits
+ * byte blocks and a direct-mapped 2^l1_bits byte L1 replays exactly.
+ */
+void cache_access_weighted_ctx(cache_ctx_t *ctx, char rw, uint64_t address, uint64_t reads, uint64_t writes, struct cache_stats_t *stats);
+int cache_check_reduction(const cache_ctx_t *ctx, uint64_t block_bits, uint64_t l1_bits);
+
 static const uint64_t DEFAULT_C1 = 10;   /* 1KB L1 Cache */
 static const uint64_t DEFAULT_C2 = 15;  /* 32KB L2 Cache */
 static const uint64_t DEFAULT_B = 5;    /* 32-byte blocks */
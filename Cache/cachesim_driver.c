@@ -7,7 +7,14 @@
 #include <string.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <errno.h>
 #include "cachesim.h"
+#include "trace.h"
+#include "sweep.h"
+#include "stackdist.h"
+#include "coherence.h"
+#include "attribution.h"
+#include "interval.h"
 
 void print_help_and_exit(void) {
     printf("cachesim [OPTIONS] < traces/file.trace\n");
@@ -15,12 +22,66 @@ void print_help_and_exit(void) {
     printf("  -c2 c\t\tTotal size of the L2 cache in bytes is 2^C2\n");
     printf("  -b B\t\tSize of each block in bytes is 2^B\n");
     printf("  -s S\t\tNumber of blocks per set is 2^S\n");
+    printf("  -a A\t\tNumber of blocks per L1 set is 2^A (default 0, direct mapped)\n");
+    printf("  -I mode\tL2 inclusion: inclusive (default), noninclusive or exclusive\n");
+    printf("  -v N\t\tAdd a fully associative victim cache of N blocks after the L1\n");
+    printf("  -f kind\tL1 prefetcher: none (default), nextline, stride or stream\n");
+    printf("  -F kind\tL2 prefetcher, same kinds as -f\n");
+    printf("  -d N\t\tBlocks fetched per prefetch trigger (default 2)\n");
+    printf("  -w P1,P2\tWrite policies of the L1 and the L2: wb (write-back, default),\n");
+    printf("\t\twt (write-through), wb-nwa or wt-nwa (no-write-allocate)\n");
+    printf("  -W N,I\t\tCoalescing write buffer of N blocks in front of memory, which\n");
+    printf("\t\ttakes I cycles per block, e.g. -W 8,20\n");
+    printf("  -T M1,M2,I\tCycle model with M1 L1 and M2 L2 MSHRs and one memory block\n");
+    printf("\t\ttransfer every I cycles, e.g. -T 8,16,4\n");
+    printf("  -A bits\tAttribute misses to 2^bits byte regions and to L2 sets,\n");
+    printf("\t\twith a compulsory/capacity/conflict split\n");
+    printf("  -o file\tWith -A, export every region and set as CSV, or JSON if file ends in .json\n");
+    printf("  -S N\t\tStream NDJSON statistics of every N accesses (0: only at\n");
+    printf("\t\t\"m id\" marker lines) and the phases found, instead of the report\n");
+    printf("  -q X\t\tWith -S, largest signature distance within a phase (default 0.1)\n");
+    printf("  -k file\tSave the cache state and statistics to a checkpoint file at the end\n");
+    printf("  -K N\t\tStop after record N of the trace, e.g. the end of a warmup for -k\n");
+    printf("  -R file\tRestore a checkpoint of the same configuration and continue\n");
+    printf("\t\tthe trace after the records it already simulated\n");
+    printf("  -i file\tText, binary or reduced (see tracecvt) trace to replay\n");
+    printf("  -g spec\tReplay a synthetic workload instead of a trace, e.g.\n");
+    printf("\t\t-g zipf,footprint=0x1000000,count=1000000 (see tracegen_parse)\n");
+    printf("  -n N\t\tSimulate N cores with private L1s and a shared MESI L2; the\n");
+    printf("\t\ttrace has one \"core rw address\" line per access\n");
+    printf("  -G grid\tSweep every configuration in grid in one pass and print CSV,\n");
+    printf("\t\te.g. -G C1=8-12,C2=14-18,S=0-4,B=5 (unlisted values come from -C/-c/-s/-b)\n");
+    printf("  -j N\t\tWith -G, decode the trace once and replay it on N threads\n");
+    printf("  -r policy\tL2 replacement policy: lru (default), plru, srrip, brrip, lfu or random\n");
+    printf("  -p P\t\tSimulate only 1 in 2^P set groups and scale the results up\n");
+    printf("  -M C\t\tPrint the LRU miss curve of every L2 up to 2^C bytes with 2^B byte blocks\n");
     printf("  -h\t\tThis helpful output\n");
     printf("Note the difference between 'C' and 'c' for size of L1 and L2 caches\n");
     exit(0);
 }
 
+static const char* const REPL_NAMES[] = { "lru", "plru", "srrip", "brrip", "lfu", "random" };
+static const char* const INCLUSION_NAMES[] = { "inclusive", "noninclusive", "exclusive" };
+static const char* const PREFETCH_NAMES[] = { "none", "nextline", "stride", "stream" };
+/* Indexed by cache_write_t + 2 * cache_allocate_t */
+static const char* const WRITE_NAMES[] = { "wb", "wt", "wb-nwa", "wt-nwa" };
+
 void print_statistics(struct cache_stats_t* p_stats);
+void print_sample_statistics(struct cache_sample_stats_t* p_sample);
+void print_hierarchy_statistics(struct cache_stats_t* p_stats);
+void print_prefetch_statistics(struct cache_stats_t* p_stats);
+void print_timing_statistics(struct cache_timing_stats_t* p_timing);
+int export_attribution(const attribution_t* attr, const char* path);
+int run_intervals(trace_t* trace, cache_ctx_t* cache, struct cache_stats_t* stats, uint64_t size, double threshold);
+cache_prefetch_t parse_prefetcher(const char* name);
+int parse_write_policy(const char* name, size_t len);
+void print_write_statistics(struct cache_stats_t* p_stats);
+void print_write_buffer_statistics(struct cache_write_buffer_stats_t* p_buffer);
+int run_sweep(trace_t* trace, const char* grid, const sweep_config_t* defaults, const struct cache_stats_t* timing, int threads);
+int run_miss_curve(trace_t* trace, uint64_t c, uint64_t c1, uint64_t b);
+int run_cores(trace_t* trace, unsigned int cores, uint64_t c1, uint64_t c2, uint64_t s, uint64_t b, uint64_t s1, const struct cache_stats_t* timing);
+void print_coherence_statistics(struct cache_stats_t* p_stats);
+int trace_corrupt(const trace_t* trace);
 
 int main(int argc, char* argv[]) {
     int opt;
@@ -28,10 +89,39 @@ int main(int argc, char* argv[]) {
     uint64_t c2 = DEFAULT_C2;
     uint64_t b = DEFAULT_B;
     uint64_t s = DEFAULT_S;
-    FILE* fin  = stdin;
+    const char* trace_path = NULL;
+    const char* workload = NULL;
+    const char* grid = NULL;
+    uint64_t curve = 0;
+    int threads = 1;
+    uint64_t sample_shift = 0;
+    cache_repl_t policy = REPL_LRU;
+    uint64_t s1 = 0;
+    cache_inclusion_t inclusion = INCLUSION_INCLUSIVE;
+    uint64_t victim = 0;
+    int hierarchy = 0;
+    cache_prefetch_t prefetch1 = PREFETCH_NONE;
+    cache_prefetch_t prefetch2 = PREFETCH_NONE;
+    uint64_t degree = 2;
+    unsigned int cores = 0;
+    struct cache_timing_config_t timing_config;
+    int timed = 0;
+    int attribute = 0;
+    uint64_t region_bits = 12;
+    const char* export_path = NULL;
+    int snapshot = 0;
+    uint64_t interval_size = 0;
+    double phase_threshold = 0.1;
+    const char* save_path = NULL;
+    const char* restore_path = NULL;
+    uint64_t stop = 0;
+    int write_policy[2] = { 0, 0 }; /* Indices into WRITE_NAMES */
+    int writes = 0;
+    struct cache_write_buffer_config_t buffer_config;
+    int buffered = 0;
 
     /* Read arguments */ 
-    while(-1 != (opt = getopt(argc, argv, "C:c:b:s:i:h"))) {
+    while(-1 != (opt = getopt(argc, argv, "C:c:b:s:a:I:v:f:F:d:w:W:T:A:o:S:q:k:K:R:i:g:n:G:j:M:p:r:h"))) {
         switch(opt) {
             case 'C':
                 c1 = atoi(optarg);
@@ -45,8 +135,103 @@ int main(int argc, char* argv[]) {
             case 's':
                 s = atoi(optarg);
                 break;
+            case 'a':
+                s1 = atoi(optarg);
+                hierarchy = 1;
+                break;
+            case 'I':
+                for (inclusion = 0; inclusion <= INCLUSION_EXCLUSIVE && strcmp(optarg, INCLUSION_NAMES[inclusion]); inclusion++);
+                if (inclusion > INCLUSION_EXCLUSIVE) {
+                    print_help_and_exit();
+                }
+                hierarchy = 1;
+                break;
+            case 'v':
+                victim = atoi(optarg);
+                hierarchy = 1;
+                break;
+            case 'f':
+                prefetch1 = parse_prefetcher(optarg);
+                break;
+            case 'F':
+                prefetch2 = parse_prefetcher(optarg);
+                break;
+            case 'd':
+                degree = atoi(optarg);
+                break;
+            case 'w': {
+                const char* comma = strchr(optarg, ',');
+                if (!comma) {
+                    print_help_and_exit();
+                }
+                write_policy[0] = parse_write_policy(optarg, comma - optarg);
+                write_policy[1] = parse_write_policy(comma + 1, strlen(comma + 1));
+                writes = 1;
+                break;
+            }
+            case 'W':
+                if (sscanf(optarg, "%" SCNu64 ",%" SCNu64, &buffer_config.entries, &buffer_config.drain_interval) != 2) {
+                    print_help_and_exit();
+                }
+                buffered = 1;
+                writes = 1;
+                break;
+            case 'T':
+                if (sscanf(optarg, "%" SCNu64 ",%" SCNu64 ",%" SCNu64, &timing_config.l1_mshrs,
+                           &timing_config.l2_mshrs, &timing_config.memory_interval) != 3) {
+                    print_help_and_exit();
+                }
+                timed = 1;
+                break;
+            case 'A':
+                region_bits = atoi(optarg);
+                attribute = 1;
+                break;
+            case 'o':
+                export_path = optarg;
+                break;
+            case 'S':
+                interval_size = atoi(optarg);
+                snapshot = 1;
+                break;
+            case 'q':
+                phase_threshold = atof(optarg);
+                break;
+            case 'k':
+                save_path = optarg;
+                break;
+            case 'K':
+                stop = strtoull(optarg, NULL, 10);
+                break;
+            case 'R':
+                restore_path = optarg;
+                break;
             case 'i':
-                fin = fopen(optarg, "r");
+                trace_path = optarg;
+                break;
+            case 'g':
+                workload = optarg;
+                break;
+            case 'n':
+                cores = atoi(optarg);
+                break;
+            case 'G':
+                grid = optarg;
+                break;
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            case 'M':
+                curve = atoi(optarg);
+                break;
+            case 'p':
+                sample_shift = atoi(optarg);
+                break;
+            case 'r':
+                for (policy = 0; policy <= REPL_RANDOM && strcmp(optarg, REPL_NAMES[policy]); policy++);
+                if (policy > REPL_RANDOM) {
+                    print_help_and_exit();
+                }
                 break;
             case 'h':
             default:
@@ -55,15 +240,63 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    printf("Cache Settings\n");
-    printf("C1: %" PRIu64 "\n", c1);
-    printf("C2: %" PRIu64 "\n", c2);
-    printf("B: %" PRIu64 "\n", b);
-    printf("S: %" PRIu64 "\n", s);
-    printf("\n");
+    trace_t* trace = workload ? trace_generate(workload) : trace_open(trace_path);
+    if (!trace) {
+        return 1;
+    }
 
-    /* Setup the cache */
-    cache_init(c1, c2, s, b);
+    if (trace->reduced && (grid || curve || cores || snapshot)) {
+        fprintf(stderr, "Reduced traces can only be replayed on a single cache\n");
+        trace_close(trace);
+        return 1;
+    }
+
+    /* Options only the single cache simulation below implements */
+    int extended = policy != REPL_LRU || prefetch1 || prefetch2 || writes || timed || attribute ||
+                   sample_shift || snapshot || save_path || restore_path || stop;
+    if ((grid || curve) && (extended || hierarchy)) {
+        fprintf(stderr, "-G and -M model plain LRU caches and take none of -r, -a, -I, -v, -f, -F, -w, -W,\n"
+                "-T, -A, -p, -S, -k, -K or -R\n");
+        trace_close(trace);
+        return 1;
+    }
+
+    if (grid) {
+        sweep_config_t defaults = { c1, c2, s, b };
+        struct cache_stats_t timing;
+        memset(&timing, 0, sizeof(struct cache_stats_t));
+        timing.l1_access_time = 2;
+        timing.l2_access_time = 10;
+        timing.memory_access_time = 100;
+        int ret = run_sweep(trace, grid, &defaults, &timing, threads);
+        trace_close(trace);
+        return ret;
+    }
+
+    if (curve) {
+        int ret = run_miss_curve(trace, curve, c1, b);
+        trace_close(trace);
+        return ret;
+    }
+
+    /* The coherence model has LRU private L1s of 2^S1 ways and an inclusive shared L2 */
+    if (cores && (extended || inclusion != INCLUSION_INCLUSIVE || victim)) {
+        fprintf(stderr, "-n models LRU caches with an inclusive L2 and takes none of -r, -I, -v, -f, -F,\n"
+                "-w, -W, -T, -A, -p, -S, -k, -K or -R\n");
+        trace_close(trace);
+        return 1;
+    }
+
+    if (cores) {
+        struct cache_stats_t timing;
+        memset(&timing, 0, sizeof(struct cache_stats_t));
+        timing.l1_access_time = 2;
+        timing.l2_access_time = 10;
+        timing.memory_access_time = 100;
+        int ret = run_cores(trace, cores, c1, c2, s, b, s1, &timing);
+        trace_close(trace);
+        return ret;
+    }
 
     /* Setup statistics */
     struct cache_stats_t stats;
@@ -72,19 +305,268 @@ int main(int argc, char* argv[]) {
     stats.l2_access_time = 10;
     stats.memory_access_time = 100;
 
+    /* Setup the cache */
+    cache_ctx_t* cache = cache_create(c1, c2, s, b);
+    if (!cache) {
+        fprintf(stderr, "Could not allocate the cache\n");
+        return 1;
+    }
+    if (cache_set_replacement(cache, policy)) {
+        fprintf(stderr, "Could not allocate the replacement policy state\n");
+        return 1;
+    }
+    if (cache_set_l1_associativity(cache, s1)) {
+        fprintf(stderr, "The L1 has fewer than 2^%" PRIu64 " blocks\n", s1);
+        return 1;
+    }
+    cache_set_inclusion(cache, inclusion);
+    if (cache_set_victim_cache(cache, victim)) {
+        fprintf(stderr, "Could not allocate the victim cache\n");
+        return 1;
+    }
+    /* A prefetch takes as long as the access it saves, counted in L1 hits */
+    if (cache_set_prefetcher(cache, 1, prefetch1, degree, stats.l2_access_time / stats.l1_access_time) ||
+        cache_set_prefetcher(cache, 2, prefetch2, degree, stats.memory_access_time / stats.l1_access_time)) {
+        fprintf(stderr, "Invalid prefetch degree %" PRIu64 "\n", degree);
+        return 1;
+    }
+    for (int level = 1; level <= 2; level++) {
+        int policy = write_policy[level - 1];
+        cache_set_write_policy(cache, level, (cache_write_t)(policy % 2), (cache_allocate_t)(policy / 2));
+    }
+    if (buffered && cache_set_write_buffer(cache, &buffer_config)) {
+        fprintf(stderr, "Invalid write buffer configuration\n");
+        return 1;
+    }
+    if (timed && cache_set_timing(cache, &timing_config)) {
+        fprintf(stderr, "Invalid cycle model configuration\n");
+        return 1;
+    }
+    if (attribute && cache_set_attribution(cache, region_bits)) {
+        fprintf(stderr, "Could not allocate the miss attribution\n");
+        return 1;
+    }
+    if (snapshot && sample_shift) {
+        fprintf(stderr, "Interval statistics cannot be sampled\n");
+        return 1;
+    }
+    if ((save_path || restore_path || stop) && (snapshot || sample_shift)) {
+        fprintf(stderr, "Checkpoints cannot be combined with interval statistics or sampling\n");
+        return 1;
+    }
+    if ((save_path || restore_path) && (buffered || timed || attribute)) {
+        fprintf(stderr, "Checkpoints do not hold the state of -W, -T or -A\n");
+        return 1;
+    }
+    /* Records the checkpoint already simulated are skipped, not replayed */
+    uint64_t records = 0;
+    if (restore_path) {
+        if (cache_checkpoint_restore(cache, &stats, &records, restore_path)) {
+            fprintf(stderr, "Could not restore %s: %s\n", restore_path,
+                    errno == EINVAL ? "not a checkpoint of this configuration" : strerror(errno));
+            return 1;
+        }
+        if (trace_skip(trace, records) != records) {
+            fprintf(stderr, "The trace ends before record %" PRIu64 " of the checkpoint\n", records);
+            return 1;
+        }
+    }
+    if (sample_shift && cache_set_sampling(cache, sample_shift)) {
+        fprintf(stderr, "Cannot sample 1 in 2^%" PRIu64 " sets of this configuration\n", sample_shift);
+        return 1;
+    }
+
+    if (trace->reduced && cache_check_reduction(cache, trace->reduction.block_bits, trace->reduction.l1_bits)) {
+        fprintf(stderr, "The trace was reduced for 2^%" PRIu32 " byte blocks and a 2^%" PRIu32 " byte L1, which this\n"
+                "configuration does not replay exactly; simulate the original trace\n",
+                trace->reduction.block_bits, trace->reduction.l1_bits);
+        return 1;
+    }
+
+    /*
+     * Printed only once the configuration, checkpoint and trace are known to
+     * work. The interval stream replaces the report, so that stdout stays
+     * valid NDJSON.
+     */
+    if (!snapshot) {
+        printf("Cache Settings\n");
+        printf("C1: %" PRIu64 "\n", c1);
+        printf("C2: %" PRIu64 "\n", c2);
+        printf("B: %" PRIu64 "\n", b);
+        printf("S: %" PRIu64 "\n", s);
+        if (policy != REPL_LRU) {
+            printf("Replacement: %s\n", REPL_NAMES[policy]);
+        }
+        if (hierarchy) {
+            printf("S1: %" PRIu64 "\n", s1);
+            printf("Inclusion: %s\n", INCLUSION_NAMES[inclusion]);
+            printf("Victim cache: %" PRIu64 "\n", victim);
+        }
+        if (prefetch1 || prefetch2) {
+            printf("L1 prefetcher: %s\n", PREFETCH_NAMES[prefetch1]);
+            printf("L2 prefetcher: %s\n", PREFETCH_NAMES[prefetch2]);
+            printf("Prefetch degree: %" PRIu64 "\n", degree);
+        }
+        if (writes) {
+            printf("L1 write policy: %s\n", WRITE_NAMES[write_policy[0]]);
+            printf("L2 write policy: %s\n", WRITE_NAMES[write_policy[1]]);
+        }
+        if (buffered) {
+            printf("Write buffer entries: %" PRIu64 "\n", buffer_config.entries);
+            printf("Write buffer drain interval: %" PRIu64 "\n", buffer_config.drain_interval);
+        }
+        if (timed) {
+            printf("L1 MSHRs: %" PRIu64 "\n", timing_config.l1_mshrs);
+            printf("L2 MSHRs: %" PRIu64 "\n", timing_config.l2_mshrs);
+            printf("Memory transfer interval: %" PRIu64 "\n", timing_config.memory_interval);
+        }
+        printf("\n");
+    }
+
+    if (snapshot) {
+        int ret = run_intervals(trace, cache, &stats, interval_size, phase_threshold);
+        cache_destroy(cache);
+        trace_close(trace);
+        return ret;
+    }
+
     /* Begin reading the file */ 
+    char rw[TRACE_BLOCK];
+    uint64_t address[TRACE_BLOCK];
+    size_t n;
+    if (trace->reduced) {
+        /* Every record carries the hits that were folded into it */
+        uint64_t reads, writes;
+        while ((!stop || records < stop) && trace_next_reduced(trace, rw, address, &reads, &writes)) {
+            cache_access_weighted_ctx(cache, rw[0], address[0], reads, writes, &stats);
+            records++;
+        }
+    }
+    while (!trace->reduced && (!stop || records < stop)) {
+        size_t want = stop && stop - records < TRACE_BLOCK ? stop - records : TRACE_BLOCK;
+        if (!(n = trace_read(trace, rw, address, want))) {
+            break;
+        }
+        cache_access_batch_ctx(cache, rw, address, n, &stats);
+        records += n;
+    }
+    if (trace_corrupt(trace)) {
+        return 1;
+    }
+    if (save_path && cache_checkpoint_save(cache, &stats, records, save_path)) {
+        perror(save_path);
+        return 1;
+    }
+
+    if (sample_shift) {
+        struct cache_sample_stats_t sample;
+        cache_sample_estimate(cache, &stats, &sample);
+        print_statistics(&stats);
+        print_sample_statistics(&sample);
+    } else {
+        cache_finalize_stats(&stats);
+        print_statistics(&stats);
+    }
+    if (hierarchy) {
+        print_hierarchy_statistics(&stats);
+    }
+    if (prefetch1 || prefetch2) {
+        print_prefetch_statistics(&stats);
+    }
+    if (writes) {
+        print_write_statistics(&stats);
+    }
+    if (buffered) {
+        struct cache_write_buffer_stats_t buffer;
+        cache_write_buffer_estimate(cache, &buffer);
+        print_write_buffer_statistics(&buffer);
+    }
+    if (timed) {
+        struct cache_timing_stats_t timing;
+        cache_timing_estimate(cache, &timing);
+        print_timing_statistics(&timing);
+    }
+    if (attribute) {
+        attribution_print_summary(cache_attribution(cache), 10, stdout);
+        if (export_path && export_attribution(cache_attribution(cache), export_path)) {
+            return 1;
+        }
+    }
+    cache_destroy(cache);
+    trace_close(trace);
+    return 0;
+}
+
+int run_sweep(trace_t* trace, const char* grid, const sweep_config_t* defaults, const struct cache_stats_t* timing, int threads) {
+    sweep_config_t* configs;
+    size_t count;
+    if (sweep_parse_grid(grid, defaults, &configs, &count)) {
+        fprintf(stderr, "Invalid sweep grid: %s\n", grid);
+        return 1;
+    }
+
+    sweep_t* sweep = sweep_create(configs, count, timing);
+    free(configs);
+    if (!sweep) {
+        fprintf(stderr, "Could not allocate %zu cache configurations\n", count);
+        return 1;
+    }
+
+    if (threads > 1) {
+        trace_buffer_t buffer;
+        if (trace_load(trace, &buffer) || sweep_run_parallel(sweep, &buffer, threads)) {
+            fprintf(stderr, "Could not run the sweep on %d threads\n", threads);
+            trace_buffer_free(&buffer);
+            sweep_destroy(sweep);
+            return 1;
+        }
+        trace_buffer_free(&buffer);
+    } else {
+        char rw[TRACE_BLOCK];
+        uint64_t address[TRACE_BLOCK];
+        size_t n;
+        while ((n = trace_read(trace, rw, address, TRACE_BLOCK))) {
+            sweep_access_batch(sweep, rw, address, n);
+        }
+        if (trace_corrupt(trace)) {
+            sweep_destroy(sweep);
+            return 1;
+        }
+    }
+
+    sweep_finish(sweep);
+    sweep_print_csv(sweep, stdout);
+    sweep_destroy(sweep);
+    return 0;
+}
+
+int run_miss_curve(trace_t* trace, uint64_t c, uint64_t c1, uint64_t b) {
+    if (c1 > c) {
+        c = c1;
+    }
+    if (b > c1) {
+        fprintf(stderr, "Block size 2^%" PRIu64 " does not fit in the L1\n", b);
+        return 1;
+    }
+
+    stackdist_t* sd = stackdist_create(c, b);
+    if (!sd) {
+        fprintf(stderr, "Could not allocate the stack distance analyzer\n");
+        return 1;
+    }
+
     char rw;
     uint64_t address;
-    while (!feof(fin)) { 
-        int ret = fscanf(fin, "%c %" PRIx64 "\n", &rw, &address); 
-        if(ret == 2) {
-            cache_access(rw, address, &stats); 
-        }
+    while (trace_next(trace, &rw, &address)) {
+        stackdist_access(sd, address);
+    }
+    if (trace_corrupt(trace)) {
+        stackdist_destroy(sd);
+        return 1;
     }
 
-    cache_cleanup(&stats);
-    print_statistics(&stats);
-    fclose(fin);
+    stackdist_print_csv(sd, c1, stdout);
+    stackdist_destroy(sd);
     return 0;
 }
 
@@ -121,3 +603,270 @@ void print_statistics(struct cache_stats_t* p_stats) {
     printf("L2 average access time: %f\n", p_stats->l2_avg_access_time);
     printf("Average access time (AAT): %f\n", p_stats->avg_access_time);
 }
+
+void print_hierarchy_statistics(struct cache_stats_t* p_stats) {
+    printf("\nHierarchy Statistics\n");
+    printf("Victim cache hits: %" PRIu64 "\n", p_stats->victim_hits);
+    printf("Back invalidations: %" PRIu64 "\n", p_stats->back_invalidations);
+    printf("L1 writebacks to L2: %" PRIu64 "\n", p_stats->l1_write_backs);
+}
+
+void print_prefetch_statistics(struct cache_stats_t* p_stats) {
+    printf("\nPrefetch Statistics\n");
+    printf("L1 prefetches: %" PRIu64 "\n", p_stats->l1_prefetches);
+    printf("L1 useful prefetches: %" PRIu64 "\n", p_stats->l1_prefetch_hits);
+    printf("L1 late prefetches: %" PRIu64 "\n", p_stats->l1_prefetch_late);
+    printf("L1 useless prefetches: %" PRIu64 "\n", p_stats->l1_prefetch_useless);
+    printf("L1 prefetch accuracy: %f\n", p_stats->l1_prefetch_accuracy);
+    printf("L1 prefetch coverage: %f\n", p_stats->l1_prefetch_coverage);
+    printf("L1 prefetch timeliness: %f\n", p_stats->l1_prefetch_timeliness);
+    printf("L2 prefetches: %" PRIu64 "\n", p_stats->l2_prefetches);
+    printf("L2 useful prefetches: %" PRIu64 "\n", p_stats->l2_prefetch_hits);
+    printf("L2 late prefetches: %" PRIu64 "\n", p_stats->l2_prefetch_late);
+    printf("L2 useless prefetches: %" PRIu64 "\n", p_stats->l2_prefetch_useless);
+    printf("L2 prefetch accuracy: %f\n", p_stats->l2_prefetch_accuracy);
+    printf("L2 prefetch coverage: %f\n", p_stats->l2_prefetch_coverage);
+    printf("L2 prefetch timeliness: %f\n", p_stats->l2_prefetch_timeliness);
+}
+
+void print_timing_statistics(struct cache_timing_stats_t* p_timing) {
+    printf("\nTiming Statistics\n");
+    printf("Cycles: %" PRIu64 "\n", p_timing->cycles);
+    printf("Accesses per cycle: %f\n", p_timing->accesses_per_cycle);
+    printf("Average latency: %f\n", p_timing->avg_latency);
+    printf("MSHR stall cycles: %" PRIu64 "\n", p_timing->stall_cycles);
+    printf("MSHR merges: %" PRIu64 "\n", p_timing->mshr_merges);
+    printf("Memory requests: %" PRIu64 "\n", p_timing->memory_requests);
+    printf("Memory-level parallelism: %f\n", p_timing->mlp);
+    printf("Memory busy: %f\n", p_timing->memory_busy);
+    printf("Latency histogram (cycles: accesses)\n");
+    for (int i = 0; i < CACHE_TIMING_BUCKETS; i++) {
+        if (p_timing->latency_histogram[i]) {
+            uint64_t lo = i ? (uint64_t)1 << i : 0;
+            if (i + 1 < CACHE_TIMING_BUCKETS) {
+                printf("%" PRIu64 "-%" PRIu64 ": %" PRIu64 "\n", lo, ((uint64_t)1 << (i + 1)) - 1, p_timing->latency_histogram[i]);
+            } else {
+                printf("%" PRIu64 "+: %" PRIu64 "\n", lo, p_timing->latency_histogram[i]);
+            }
+        }
+    }
+}
+
+int run_intervals(trace_t* trace, cache_ctx_t* cache, struct cache_stats_t* stats, uint64_t size, double threshold) {
+    interval_t* iv = interval_create(stdout, threshold);
+    if (!iv) {
+        fprintf(stderr, "Could not allocate the interval statistics\n");
+        return 1;
+    }
+
+    /* Accesses are still simulated in batches, cut wherever an interval ends */
+    char rw[TRACE_BLOCK];
+    uint64_t address[TRACE_BLOCK];
+    size_t n = 0;
+    uint64_t left = size;
+    int ret = 0;
+    while (!ret && trace_next(trace, &rw[n], &address[n])) {
+        if (trace->markers) {
+            /*
+             * The markers came before the record just read. The first one
+             * closes the interval; any right after it would close empty
+             * intervals, which are not written.
+             */
+            cache_access_batch_ctx(cache, rw, address, n, stats);
+            ret = interval_snapshot(iv, stats, "marker", &trace->marker);
+            left = size;
+            rw[0] = rw[n];
+            address[0] = address[n];
+            n = 0;
+        }
+        n++;
+        if (size && --left == 0) {
+            cache_access_batch_ctx(cache, rw, address, n, stats);
+            ret = ret || interval_snapshot(iv, stats, "count", NULL);
+            left = size;
+            n = 0;
+        } else if (n == TRACE_BLOCK) {
+            cache_access_batch_ctx(cache, rw, address, n, stats);
+            n = 0;
+        }
+    }
+    cache_access_batch_ctx(cache, rw, address, n, stats);
+    if (trace_corrupt(trace)) {
+        interval_destroy(iv);
+        return 1;
+    }
+    if (!ret && trace->markers) {
+        ret = interval_snapshot(iv, stats, "marker", &trace->marker);
+    }
+    if (!ret) {
+        ret = interval_snapshot(iv, stats, "end", NULL);
+    }
+    if (ret) {
+        fprintf(stderr, "Could not allocate the interval statistics\n");
+        interval_destroy(iv);
+        return 1;
+    }
+
+    cache_finalize_stats(stats);
+    interval_finish(iv, stats);
+    interval_destroy(iv);
+    return 0;
+}
+
+int export_attribution(const attribution_t* attr, const char* path) {
+    FILE* fout = fopen(path, "w");
+    if (!fout) {
+        perror(path);
+        return 1;
+    }
+    size_t len = strlen(path);
+    if (len >= 5 && !strcmp(path + len - 5, ".json")) {
+        attribution_write_json(attr, fout);
+    } else {
+        attribution_write_csv(attr, fout);
+    }
+    fclose(fout);
+    return 0;
+}
+
+void print_write_statistics(struct cache_stats_t* p_stats) {
+    printf("\nWrite Statistics\n");
+    printf("L1 write-throughs: %" PRIu64 "\n", p_stats->l1_write_throughs);
+    printf("Memory stores: %" PRIu64 "\n", p_stats->memory_stores);
+    printf("Memory write bytes: %" PRIu64 "\n", p_stats->memory_write_bytes);
+}
+
+void print_write_buffer_statistics(struct cache_write_buffer_stats_t* p_buffer) {
+    printf("\nWrite Buffer Statistics\n");
+    printf("Buffered writes: %" PRIu64 "\n", p_buffer->writes);
+    printf("Coalesced writes: %" PRIu64 "\n", p_buffer->coalesced);
+    printf("Memory block writes: %" PRIu64 "\n", p_buffer->memory_writes);
+    printf("Full buffer stalls: %" PRIu64 "\n", p_buffer->stalls);
+    printf("Stall cycles: %" PRIu64 "\n", p_buffer->stall_cycles);
+    printf("Average occupancy: %f\n", p_buffer->avg_occupancy);
+    printf("Maximum occupancy: %" PRIu64 "\n", p_buffer->max_occupancy);
+}
+
+int parse_write_policy(const char* name, size_t len) {
+    for (int policy = 0; policy < 4; policy++) {
+        if (strlen(WRITE_NAMES[policy]) == len && !strncmp(name, WRITE_NAMES[policy], len)) {
+            return policy;
+        }
+    }
+    print_help_and_exit();
+    return 0;
+}
+
+cache_prefetch_t parse_prefetcher(const char* name) {
+    cache_prefetch_t type;
+    for (type = 0; type <= PREFETCH_STREAM && strcmp(name, PREFETCH_NAMES[type]); type++);
+    if (type > PREFETCH_STREAM) {
+        print_help_and_exit();
+    }
+    return type;
+}
+
+int run_cores(trace_t* trace, unsigned int cores, uint64_t c1, uint64_t c2, uint64_t s, uint64_t b, uint64_t s1, const struct cache_stats_t* timing) {
+    if (trace->pos) {
+        fprintf(stderr, "Multi-core traces must be text\n");
+        return 1;
+    }
+    coherence_t* sys = coherence_create(cores, c1, c2, s, b, s1);
+    if (!sys) {
+        fprintf(stderr, "Could not create %u cores of this configuration (at most %d)\n", cores, COHERENCE_MAX_CORES);
+        return 1;
+    }
+    struct cache_stats_t* stats = malloc(sizeof(struct cache_stats_t) * (cores + 1));
+    if (!stats) {
+        fprintf(stderr, "Could not allocate the statistics\n");
+        coherence_destroy(sys);
+        return 1;
+    }
+    for (unsigned int k = 0; k <= cores; k++) {
+        stats[k] = *timing;
+    }
+
+    unsigned int core;
+    char rw;
+    uint64_t address;
+    while (trace_next_core(trace, &core, &rw, &address)) {
+        if (core >= cores) {
+            fprintf(stderr, "Access of core %u in a %u core simulation\n", core, cores);
+            free(stats);
+            coherence_destroy(sys);
+            return 1;
+        }
+        coherence_access(sys, core, rw, address, &stats[core]);
+    }
+
+    printf("Cache Settings\n");
+    printf("C1: %" PRIu64 "\n", c1);
+    printf("C2: %" PRIu64 "\n", c2);
+    printf("B: %" PRIu64 "\n", b);
+    printf("S: %" PRIu64 "\n", s);
+    printf("S1: %" PRIu64 "\n", s1);
+    printf("Cores: %u\n", cores);
+
+    /* stats[cores] sums up all cores */
+    struct cache_stats_t* total = &stats[cores];
+    for (unsigned int k = 0; k < cores; k++) {
+        total->accesses += stats[k].accesses;
+        total->reads += stats[k].reads;
+        total->writes += stats[k].writes;
+        total->write_backs += stats[k].write_backs;
+        total->l1_read_misses += stats[k].l1_read_misses;
+        total->l1_write_misses += stats[k].l1_write_misses;
+        total->l2_read_misses += stats[k].l2_read_misses;
+        total->l2_write_misses += stats[k].l2_write_misses;
+        total->back_invalidations += stats[k].back_invalidations;
+        total->l1_write_backs += stats[k].l1_write_backs;
+        total->invalidations += stats[k].invalidations;
+        total->upgrades += stats[k].upgrades;
+        total->coherence_misses += stats[k].coherence_misses;
+        total->false_sharing_misses += stats[k].false_sharing_misses;
+        total->sharing_write_backs += stats[k].sharing_write_backs;
+        total->cross_core_evictions += stats[k].cross_core_evictions;
+
+        printf("\nCore %u ", k);
+        cache_finalize_stats(&stats[k]);
+        print_statistics(&stats[k]);
+        print_coherence_statistics(&stats[k]);
+    }
+    printf("\nAll Cores ");
+    cache_finalize_stats(total);
+    print_statistics(total);
+    print_coherence_statistics(total);
+
+    free(stats);
+    coherence_destroy(sys);
+    return 0;
+}
+
+void print_coherence_statistics(struct cache_stats_t* p_stats) {
+    printf("Invalidations: %" PRIu64 "\n", p_stats->invalidations);
+    printf("Upgrades: %" PRIu64 "\n", p_stats->upgrades);
+    printf("Coherence misses: %" PRIu64 "\n", p_stats->coherence_misses);
+    printf("False sharing misses: %" PRIu64 "\n", p_stats->false_sharing_misses);
+    printf("Sharing writebacks: %" PRIu64 "\n", p_stats->sharing_write_backs);
+    printf("L1 writebacks to L2: %" PRIu64 "\n", p_stats->l1_write_backs);
+    printf("Back invalidations: %" PRIu64 "\n", p_stats->back_invalidations);
+    printf("Cross-core L2 evictions: %" PRIu64 "\n", p_stats->cross_core_evictions);
+}
+
+void print_sample_statistics(struct cache_sample_stats_t* p_sample) {
+    printf("\nSampling Statistics\n");
+    printf("Sampled set groups: %" PRIu64 " of %" PRIu64 "\n", p_sample->sampled_sets, p_sample->total_sets);
+    printf("Sampled accesses: %" PRIu64 "\n", p_sample->sampled_accesses);
+    printf("L1 Miss rate 95%% CI: +/- %f\n", p_sample->l1_miss_rate_ci);
+    printf("L2 Miss rate 95%% CI: +/- %f\n", p_sample->l2_miss_rate_ci);
+    printf("AAT 95%% CI: +/- %f\n", p_sample->avg_access_time_ci);
+}
+
+/* Report a binary trace that ended inside a record */
+int trace_corrupt(const trace_t* trace) {
+    if (trace->corrupt) {
+        fprintf(stderr, "The trace is truncated or corrupt\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "checkpoint.h"
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Start an empty checkpoint for writing
+ *
+ * @param trace_offset Trace records simulated so far
+ */
+void checkpoint_init(checkpoint_t *ckpt, uint64_t trace_offset)
+{
+	memset(ckpt, 0, sizeof(checkpoint_t));
+	memcpy(ckpt->header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN);
+	ckpt->header.version = CHECKPOINT_VERSION;
+	ckpt->header.trace_offset = trace_offset;
+}
+
+/**
+ * Add a section. The data is not copied and must stay valid until
+ * checkpoint_write.
+ *
+ * @return 0 on success, -1 if the table is full
+ */
+int checkpoint_add(checkpoint_t *ckpt, uint32_t id, const void *data, uint64_t size)
+{
+	if (ckpt->header.sections == CHECKPOINT_MAX_SECTIONS) {
+		return -1;
+	}
+	checkpoint_section_t *section = ckpt->table + ckpt->header.sections;
+	section->id = id;
+	section->size = size;
+	ckpt->data[ckpt->header.sections] = data;
+	ckpt->header.sections++;
+	return 0;
+}
+
+/**
+ * Write the checkpoint to a file. It is written to path.tmp and renamed, so
+ * an interrupted write never leaves a truncated checkpoint behind.
+ *
+ * @return 0 on success, -1 with errno set on I/O errors
+ */
+int checkpoint_write(const checkpoint_t *ckpt, const char *path)
+{
+	checkpoint_section_t table[CHECKPOINT_MAX_SECTIONS];
+	uint64_t offset = sizeof(checkpoint_header_t) + sizeof(checkpoint_section_t) * ckpt->header.sections;
+	for (uint32_t i = 0; i < ckpt->header.sections; i++) {
+		offset = (offset + CHECKPOINT_ALIGN - 1) & ~(uint64_t)(CHECKPOINT_ALIGN - 1);
+		table[i] = ckpt->table[i];
+		table[i].offset = offset;
+		offset += table[i].size;
+	}
+
+	size_t len = strlen(path);
+	char *tmp = malloc(len + 5);
+	if (!tmp) {
+		return -1;
+	}
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".tmp", 5);
+
+	FILE *fout = fopen(tmp, "wb");
+	if (!fout) {
+		free(tmp);
+		return -1;
+	}
+	static const char zeros[CHECKPOINT_ALIGN];
+	int ok = fwrite(&ckpt->header, sizeof(checkpoint_header_t), 1, fout) == 1 &&
+			fwrite(table, sizeof(checkpoint_section_t), ckpt->header.sections, fout) == ckpt->header.sections;
+	uint64_t position = sizeof(checkpoint_header_t) + sizeof(checkpoint_section_t) * ckpt->header.sections;
+	for (uint32_t i = 0; ok && i < ckpt->header.sections; i++) {
+		size_t pad = table[i].offset - position;
+		ok = fwrite(zeros, 1, pad, fout) == pad &&
+				fwrite(ckpt->data[i], 1, table[i].size, fout) == table[i].size;
+		position = table[i].offset + table[i].size;
+	}
+	if (fclose(fout) != 0) {
+		ok = 0;
+	}
+	if (!ok || rename(tmp, path) != 0) {
+		remove(tmp);
+		free(tmp);
+		return -1;
+	}
+	free(tmp);
+	return 0;
+}
+
+/**
+ * Map a checkpoint file. The mapping is private, so sections may be used in
+ * place and even modified without touching the file.
+ *
+ * @return 0 on success, -1 if the file cannot be mapped (errno is set) or is
+ *         not a valid checkpoint of this version (errno is EINVAL)
+ */
+int checkpoint_open(checkpoint_t *ckpt, const char *path)
+{
+	memset(ckpt, 0, sizeof(checkpoint_t));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size < sizeof(checkpoint_header_t)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	ckpt->map = map;
+	ckpt->map_size = st.st_size;
+
+	memcpy(&ckpt->header, map, sizeof(checkpoint_header_t));
+	if (memcmp(ckpt->header.magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_LEN) ||
+			ckpt->header.version != CHECKPOINT_VERSION ||
+			ckpt->header.sections > CHECKPOINT_MAX_SECTIONS ||
+			sizeof(checkpoint_header_t) + sizeof(checkpoint_section_t) * ckpt->header.sections > ckpt->map_size) {
+		checkpoint_close(ckpt);
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(ckpt->table, (char *)map + sizeof(checkpoint_header_t), sizeof(checkpoint_section_t) * ckpt->header.sections);
+	for (uint32_t i = 0; i < ckpt->header.sections; i++) {
+		const checkpoint_section_t *section = ckpt->table + i;
+		if (section->offset > ckpt->map_size || section->size > ckpt->map_size - section->offset) {
+			checkpoint_close(ckpt);
+			errno = EINVAL;
+			return -1;
+		}
+		ckpt->data[i] = (char *)map + section->offset;
+	}
+	return 0;
+}
+
+/**
+ * Find a section of an opened checkpoint
+ *
+ * @param size Set to the size of the section
+ * @return The section's data, or NULL if the checkpoint has no such section
+ */
+const void *checkpoint_section(const checkpoint_t *ckpt, uint32_t id, uint64_t *size)
+{
+	for (uint32_t i = 0; i < ckpt->header.sections; i++) {
+		if (ckpt->table[i].id == id) {
+			*size = ckpt->table[i].size;
+			return ckpt->data[i];
+		}
+	}
+	return NULL;
+}
+
+void checkpoint_close(checkpoint_t *ckpt)
+{
+	if (ckpt->map) {
+		munmap(ckpt->map, ckpt->map_size);
+	}
+	ckpt->map = NULL;
+	ckpt->map_size = 0;
+	ckpt->header.sections = 0;
+}
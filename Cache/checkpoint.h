@@ -0,0 +1,56 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+/**
+ * Checkpoint file format
+ *
+ * A checkpoint starts with a checkpoint_header_t and a table of sections,
+ * followed by the data of every section, each aligned to CHECKPOINT_ALIGN
+ * bytes so that it can be used in place once the file is mapped. Section ids
+ * and contents are defined by the writer (see cache_checkpoint_save); a reader
+ * rejects files with a different magic or version.
+ */
+#define CHECKPOINT_MAGIC "CSIMCKPT"
+#define CHECKPOINT_MAGIC_LEN 8
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ALIGN 64
+#define CHECKPOINT_MAX_SECTIONS 32
+
+typedef struct checkpoint_header_t {
+	char magic[CHECKPOINT_MAGIC_LEN];
+	uint32_t version;
+	uint32_t sections;
+	uint64_t trace_offset; /* Trace records simulated before the checkpoint */
+} checkpoint_header_t;
+
+typedef struct checkpoint_section_t {
+	uint32_t id;
+	uint32_t reserved;
+	uint64_t offset; /* From the start of the file */
+	uint64_t size;
+} checkpoint_section_t;
+
+/**
+ * A checkpoint being written (sections point at the caller's data until
+ * checkpoint_write) or read (sections point into the mapped file)
+ */
+typedef struct checkpoint_t {
+	checkpoint_header_t header;
+	checkpoint_section_t table[CHECKPOINT_MAX_SECTIONS];
+	const void *data[CHECKPOINT_MAX_SECTIONS];
+
+	void *map; /* The mapped file, NULL while writing */
+	size_t map_size;
+} checkpoint_t;
+
+void checkpoint_init(checkpoint_t *ckpt, uint64_t trace_offset);
+int checkpoint_add(checkpoint_t *ckpt, uint32_t id, const void *data, uint64_t size);
+int checkpoint_write(const checkpoint_t *ckpt, const char *path);
+int checkpoint_open(checkpoint_t *ckpt, const char *path);
+const void *checkpoint_section(const checkpoint_t *ckpt, uint32_t id, uint64_t *size);
+void checkpoint_close(checkpoint_t *ckpt);
+
+#endif
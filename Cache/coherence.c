@@ -0,0 +1,343 @@
+#include "coherence.h"
+#include <string.h>
+
+/**
+ * Create a multi-core hierarchy
+ *
+ * @param cores Number of cores, 1 to COHERENCE_MAX_CORES
+ * @param C1, C2, S, B Geometry of every L1 and of the shared L2, as for cache_init
+ * @param S1 2^S1 ways in every L1
+ * @return The hierarchy, or NULL if the geometry is invalid or memory ran out
+ */
+coherence_t *coherence_create(unsigned int cores, uint64_t C1, uint64_t C2, uint64_t S, uint64_t B, uint64_t S1)
+{
+	if (cores == 0 || cores > COHERENCE_MAX_CORES || B + S1 > C1 || B + S > C2 || C1 > C2) {
+		return NULL;
+	}
+	coherence_t *sys = calloc(1, sizeof(coherence_t));
+	if (!sys) {
+		return NULL;
+	}
+	sys->cores = cores;
+	sys->C1 = C1;
+	sys->C2 = C2;
+	sys->S = S;
+	sys->B = B;
+	sys->S1 = S1;
+	/* Words are the size of a store, but at most 64 per block */
+	sys->wordShift = B > cache_store_shift(B) + 6 ? B - 6 : cache_store_shift(B);
+
+	uint64_t blocks2 = 1ull << (C2 - B);
+	sys->l1 = calloc((uint64_t)cores << (C1 - B), sizeof(coherence_line));
+	sys->sharers = calloc(blocks2, sizeof(uint64_t));
+	sys->lost = calloc(blocks2, sizeof(uint64_t));
+	sys->filler = calloc(blocks2, sizeof(uint8_t));
+	if (!sys->l1 || !sys->sharers || !sys->lost || !sys->filler ||
+			tag_store_init(&sys->l2, 1ull << (C2 - B - S), S)) {
+		coherence_destroy(sys);
+		return NULL;
+	}
+	return sys;
+}
+
+void coherence_destroy(coherence_t *sys)
+{
+	if (!sys) {
+		return;
+	}
+	tag_store_free(&sys->l2);
+	free(sys->l1);
+	free(sys->sharers);
+	free(sys->lost);
+	free(sys->filler);
+	free(sys);
+}
+
+/**
+ * The L1 set of a core that a block maps to
+ */
+static coherence_line *coherence_set(coherence_t *sys, unsigned int core, uint64_t block)
+{
+	uint64_t l1Bits = sys->C1 - sys->B - sys->S1;
+	uint64_t index = block & ((1ull << l1Bits) - 1);
+	return sys->l1 + ((uint64_t)core << (sys->C1 - sys->B)) + (index << sys->S1);
+}
+
+/**
+ * Find a block in a core's L1
+ *
+ * @param lost 0 for a valid copy, 1 for a copy another core invalidated
+ * @return The line, or NULL if the core has no such copy
+ */
+static coherence_line *coherence_find(coherence_t *sys, unsigned int core, uint64_t block, int lost)
+{
+	coherence_line *set = coherence_set(sys, core, block);
+	uint64_t tag = block >> (sys->C1 - sys->B - sys->S1);
+	for (uint64_t i = 0; i < (1ull << sys->S1); i++) {
+		if (set[i].tag == tag && set[i].lost == lost && (lost || set[i].state != MESI_INVALID)) {
+			return set + i;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * The L2 entry (set << S) + way holding a block, or -1
+ */
+static int64_t coherence_l2_find(coherence_t *sys, uint64_t block)
+{
+	uint64_t l2Bits = sys->C2 - sys->B - sys->S;
+	uint64_t index = block & ((1ull << l2Bits) - 1);
+	int64_t way = tag_store_find(&sys->l2, index, block >> l2Bits);
+	return way < 0 ? -1 : (int64_t)((index << sys->S) + way);
+}
+
+/**
+ * Invalidate every copy of an L2 block outside the writing core. Modified
+ * copies are written back to the L2 first.
+ */
+static void coherence_invalidate(coherence_t *sys, unsigned int core, uint64_t entry, uint64_t block, uint64_t word, struct cache_stats_t *stats)
+{
+	uint64_t others = sys->sharers[entry] & ~(1ull << core);
+	for (unsigned int k = 0; others; k++, others >>= 1) {
+		if (!(others & 1)) {
+			continue;
+		}
+		coherence_line *line = coherence_find(sys, k, block, 0);
+		if (line->state == MESI_MODIFIED) {
+			sys->l2.dirty[entry] = 1;
+			stats->sharing_write_backs = stats->sharing_write_backs + 1;
+		}
+		line->state = MESI_INVALID;
+		line->lost = 1;
+		line->stale = word;
+		stats->invalidations = stats->invalidations + 1;
+	}
+	sys->lost[entry] |= sys->sharers[entry] & ~(1ull << core);
+	sys->sharers[entry] &= 1ull << core;
+}
+
+/**
+ * Record a write in the invalidated copies of the other cores, so that their
+ * next miss can be classified as true or false sharing
+ */
+static void coherence_mark_stale(coherence_t *sys, unsigned int core, uint64_t entry, uint64_t block, uint64_t word)
+{
+	uint64_t others = sys->lost[entry] & ~(1ull << core);
+	for (unsigned int k = 0; others; k++, others >>= 1) {
+		if (!(others & 1)) {
+			continue;
+		}
+		coherence_line *line = coherence_find(sys, k, block, 1);
+		if (line) {
+			line->stale |= word;
+		} else {
+			/* The core reused the line since */
+			sys->lost[entry] &= ~(1ull << k);
+		}
+	}
+}
+
+/**
+ * Remove an L1 block of a core from the directory, writing it back if modified
+ */
+static void coherence_evict_l1(coherence_t *sys, unsigned int core, coherence_line *line, uint64_t index, struct cache_stats_t *stats)
+{
+	uint64_t l1Bits = sys->C1 - sys->B - sys->S1;
+	int64_t entry = coherence_l2_find(sys, (line->tag << l1Bits) | index);
+	if (entry < 0) {
+		return;
+	}
+	if (line->lost) {
+		sys->lost[entry] &= ~(1ull << core);
+		return;
+	}
+	sys->sharers[entry] &= ~(1ull << core);
+	if (line->state == MESI_MODIFIED) {
+		sys->l2.dirty[entry] = 1;
+		stats->l1_write_backs = stats->l1_write_backs + 1;
+	}
+}
+
+/**
+ * Evict an L2 block, invalidating it in every L1 to keep the L2 inclusive
+ */
+static void coherence_evict_l2(coherence_t *sys, unsigned int core, uint64_t entry, struct cache_stats_t *stats)
+{
+	uint64_t l2Bits = sys->C2 - sys->B - sys->S;
+	uint64_t block = (sys->l2.tags[entry] << l2Bits) | (entry >> sys->S);
+	int dirty = sys->l2.dirty[entry];
+
+	for (unsigned int k = 0; k < sys->cores; k++) {
+		if (sys->sharers[entry] & (1ull << k)) {
+			coherence_line *line = coherence_find(sys, k, block, 0);
+			dirty |= line->state == MESI_MODIFIED;
+			line->state = MESI_INVALID;
+			stats->back_invalidations = stats->back_invalidations + 1;
+		}
+		if (sys->lost[entry] & (1ull << k)) {
+			coherence_line *line = coherence_find(sys, k, block, 1);
+			if (line) {
+				line->lost = 0;
+			}
+		}
+	}
+	if (dirty) {
+		stats->write_backs = stats->write_backs + 1;
+	}
+	if (sys->filler[entry] != core) {
+		stats->cross_core_evictions = stats->cross_core_evictions + 1;
+	}
+	sys->l2.valid[entry] = 0;
+	sys->sharers[entry] = 0;
+	sys->lost[entry] = 0;
+}
+
+/**
+ * Bring a block into the shared L2 from memory
+ *
+ * @return The L2 entry it was placed in
+ */
+static uint64_t coherence_fill_l2(coherence_t *sys, unsigned int core, uint64_t block, struct cache_stats_t *stats)
+{
+	uint64_t l2Bits = sys->C2 - sys->B - sys->S;
+	uint64_t set = (block & ((1ull << l2Bits) - 1)) << sys->S;
+	uint64_t entry = set;
+	for (uint64_t i = 0; i < (1ull << sys->S); i++) {
+		if (!sys->l2.valid[set + i]) {
+			entry = set + i;
+			break;
+		}
+		if (sys->l2.age[set + i] < sys->l2.age[entry]) {
+			entry = set + i;
+		}
+	}
+	if (sys->l2.valid[entry]) {
+		coherence_evict_l2(sys, core, entry, stats);
+	}
+
+	sys->l2.tags[entry] = block >> l2Bits;
+	sys->l2.valid[entry] = 1;
+	sys->l2.dirty[entry] = 0;
+	sys->sharers[entry] = 0;
+	sys->lost[entry] = 0;
+	return entry;
+}
+
+/**
+ * Simulate one access of one core
+ *
+ * @param sys The hierarchy
+ * @param core The core issuing the access, below the number of cores
+ * @param rw READ or WRITE
+ * @param address The address of the access
+ * @param stats The statistics of that core
+ */
+void coherence_access(coherence_t *sys, unsigned int core, char rw, uint64_t address, struct cache_stats_t *stats)
+{
+	if (rw == READ) {
+		stats->reads = stats->reads + 1;
+	} else {
+		stats->writes = stats->writes + 1;
+	}
+	stats->accesses = stats->accesses + 1;
+	sys->clock = sys->clock + 1;
+
+	uint64_t block = address >> sys->B;
+	uint64_t word = 1ull << ((address & ((1ull << sys->B) - 1)) >> sys->wordShift);
+	uint64_t l1Bits = sys->C1 - sys->B - sys->S1;
+	uint64_t index1 = block & ((1ull << l1Bits) - 1);
+	uint64_t tag1 = block >> l1Bits;
+
+	coherence_line *line = coherence_find(sys, core, block, 0);
+	if (line) {
+		int64_t entry = coherence_l2_find(sys, block);
+		if (rw == WRITE) {
+			if (line->state == MESI_SHARED) {
+				stats->upgrades = stats->upgrades + 1;
+				coherence_invalidate(sys, core, entry, block, word, stats);
+			}
+			line->state = MESI_MODIFIED;
+			coherence_mark_stale(sys, core, entry, block, word);
+		}
+		line->counter = sys->clock;
+		sys->l2.age[entry] = sys->clock;
+		return;
+	}
+
+	if (rw == READ) {
+		stats->l1_read_misses = stats->l1_read_misses + 1;
+	} else {
+		stats->l1_write_misses = stats->l1_write_misses + 1;
+	}
+
+	/* Reuse the invalidated copy if there is one, else the first invalid way or the LRU one */
+	coherence_line *set = coherence_set(sys, core, block);
+	line = coherence_find(sys, core, block, 1);
+	if (line) {
+		stats->coherence_misses = stats->coherence_misses + 1;
+		if (!(line->stale & word)) {
+			stats->false_sharing_misses = stats->false_sharing_misses + 1;
+		}
+	} else {
+		line = set;
+		for (uint64_t i = 0; i < (1ull << sys->S1); i++) {
+			if (set[i].state == MESI_INVALID && !set[i].lost) {
+				line = set + i;
+				break;
+			}
+			if (set[i].counter < line->counter) {
+				line = set + i;
+			}
+		}
+		if (line->state != MESI_INVALID || line->lost) {
+			coherence_evict_l1(sys, core, line, index1, stats);
+		}
+	}
+
+	int64_t entry = coherence_l2_find(sys, block);
+	mesi_state_t state;
+	if (entry >= 0) {
+		uint64_t others = sys->sharers[entry] & ~(1ull << core);
+		if (rw == WRITE) {
+			coherence_invalidate(sys, core, entry, block, word, stats);
+			state = MESI_MODIFIED;
+		} else if (others) {
+			/* An exclusive or modified copy is downgraded, a modified one written back */
+			for (unsigned int k = 0; others; k++, others >>= 1) {
+				if (others & 1) {
+					coherence_line *other = coherence_find(sys, k, block, 0);
+					if (other->state == MESI_MODIFIED) {
+						sys->l2.dirty[entry] = 1;
+						stats->sharing_write_backs = stats->sharing_write_backs + 1;
+					}
+					other->state = MESI_SHARED;
+				}
+			}
+			state = MESI_SHARED;
+		} else {
+			state = MESI_EXCLUSIVE;
+		}
+	} else {
+		if (rw == READ) {
+			stats->l2_read_misses = stats->l2_read_misses + 1;
+		} else {
+			stats->l2_write_misses = stats->l2_write_misses + 1;
+		}
+		entry = coherence_fill_l2(sys, core, block, stats);
+		state = rw == READ ? MESI_EXCLUSIVE : MESI_MODIFIED;
+	}
+	sys->sharers[entry] |= 1ull << core;
+	sys->lost[entry] &= ~(1ull << core);
+	sys->filler[entry] = core;
+	sys->l2.age[entry] = sys->clock;
+	if (rw == WRITE) {
+		coherence_mark_stale(sys, core, entry, block, word);
+	}
+
+	line->tag = tag1;
+	line->state = state;
+	line->lost = 0;
+	line->stale = 0;
+	line->counter = sys->clock;
+}
@@ -0,0 +1,55 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include "cachesim.h"
+#include "tagstore.h"
+
+/* Cores are tracked in one bit per core of the L2 directory */
+#define COHERENCE_MAX_CORES 64
+
+typedef enum mesi_state_t {
+	MESI_INVALID,
+	MESI_SHARED,
+	MESI_EXCLUSIVE,
+	MESI_MODIFIED
+} mesi_state_t;
+
+/**
+ * A block of a private L1. A block invalidated by another core keeps its tag
+ * (lost is set) so that the next miss on it can be told apart from a
+ * capacity or conflict miss.
+ */
+typedef struct coherence_line_t {
+	uint64_t tag;
+	uint64_t counter; /* Time of the last access, for LRU */
+	uint64_t stale; /* Words other cores wrote since the block was lost */
+	uint8_t state; /* mesi_state_t */
+	uint8_t lost;
+} coherence_line;
+
+/**
+ * A multi-core hierarchy: one private L1 per core, shaped like cache1 of the
+ * single core model (2^C1 bytes, 2^S1 ways), and one shared inclusive L2,
+ * shaped like cache2, that doubles as the MESI directory.
+ *
+ * Every counter is charged to the stats of the core whose access caused it:
+ * an invalidation belongs to the writer, not to the core that lost the block.
+ */
+typedef struct coherence_t {
+	unsigned int cores;
+	uint64_t C1, C2, S, B, S1;
+	uint64_t wordShift; /* The false sharing detector tracks 2^wordShift byte words */
+	uint64_t clock;
+
+	coherence_line *l1; /* Core k's L1 starts at l1 + (k << (C1 - B)) */
+	tag_store l2;
+	uint64_t *sharers; /* Per L2 block, the cores holding it in their L1 */
+	uint64_t *lost; /* Per L2 block, the cores it was invalidated in */
+	uint8_t *filler; /* Per L2 block, the core that last fetched it into its L1 */
+} coherence_t;
+
+coherence_t *coherence_create(unsigned int cores, uint64_t C1, uint64_t C2, uint64_t S, uint64_t B, uint64_t S1);
+void coherence_access(coherence_t *sys, unsigned int core, char rw, uint64_t address, struct cache_stats_t *stats);
+void coherence_destroy(coherence_t *sys);
+
+#endif
@@ -0,0 +1,136 @@
+#include "hashmap.h"
+#include <string.h>
+
+/**
+ * Initialize an empty map
+ *
+ * @param map The map to initialize
+ * @param capacity Expected number of keys; the map grows past it as needed
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int hashmap_init(hashmap_t *map, size_t capacity)
+{
+	size_t slots = 16;
+	while (slots < capacity * 2) {
+		slots <<= 1;
+	}
+	memset(map, 0, sizeof(hashmap_t));
+	map->keys = malloc(sizeof(uint64_t) * slots);
+	map->values = malloc(sizeof(uint64_t) * slots);
+	if (!map->keys || !map->values) {
+		hashmap_free(map);
+		return -1;
+	}
+	memset(map->keys, 0xff, sizeof(uint64_t) * slots);
+	map->capacity = slots;
+	return 0;
+}
+
+void hashmap_free(hashmap_t *map)
+{
+	free(map->keys);
+	free(map->values);
+	map->keys = NULL;
+	map->values = NULL;
+	map->capacity = 0;
+	map->count = 0;
+}
+
+/**
+ * Remove every key without releasing memory
+ */
+void hashmap_clear(hashmap_t *map)
+{
+	memset(map->keys, 0xff, sizeof(uint64_t) * map->capacity);
+	map->count = 0;
+	map->has_empty_key = 0;
+}
+
+/**
+ * Look up a key
+ *
+ * @return A pointer to the value stored for key, or NULL if it is not present.
+ *         The pointer is invalidated by the next hashmap_put.
+ */
+uint64_t *hashmap_get(const hashmap_t *map, uint64_t key)
+{
+	if (key == HASHMAP_EMPTY) {
+		return map->has_empty_key ? (uint64_t *)&map->empty_key_value : NULL;
+	}
+	size_t mask = map->capacity - 1;
+	for (size_t i = hashmap_hash(key) & mask; ; i = (i + 1) & mask) {
+		if (map->keys[i] == key) {
+			return &map->values[i];
+		}
+		if (map->keys[i] == HASHMAP_EMPTY) {
+			return NULL;
+		}
+	}
+}
+
+static int hashmap_grow(hashmap_t *map)
+{
+	hashmap_t grown;
+	if (hashmap_init(&grown, map->capacity)) {
+		return -1;
+	}
+	size_t mask = grown.capacity - 1;
+	for (size_t j = 0; j < map->capacity; j++) {
+		if (map->keys[j] == HASHMAP_EMPTY) {
+			continue;
+		}
+		size_t i = hashmap_hash(map->keys[j]) & mask;
+		while (grown.keys[i] != HASHMAP_EMPTY) {
+			i = (i + 1) & mask;
+		}
+		grown.keys[i] = map->keys[j];
+		grown.values[i] = map->values[j];
+	}
+	grown.count = map->count;
+	grown.has_empty_key = map->has_empty_key;
+	grown.empty_key_value = map->empty_key_value;
+	hashmap_free(map);
+	*map = grown;
+	return 0;
+}
+
+/**
+ * Find the slot for key, inserting it with value if it is not present yet
+ *
+ * @param inserted Set to 1 if the key was added, 0 if it already existed (may be NULL)
+ * @return A pointer to the value stored for key, or NULL if the map could not grow
+ */
+uint64_t *hashmap_put(hashmap_t *map, uint64_t key, uint64_t value, int *inserted)
+{
+	if (key == HASHMAP_EMPTY) {
+		if (inserted) {
+			*inserted = !map->has_empty_key;
+		}
+		if (!map->has_empty_key) {
+			map->has_empty_key = 1;
+			map->empty_key_value = value;
+		}
+		return &map->empty_key_value;
+	}
+	if ((map->count + 1) * 2 > map->capacity && hashmap_grow(map)) {
+		return NULL;
+	}
+	size_t mask = map->capacity - 1;
+	size_t i = hashmap_hash(key) & mask;
+	while (map->keys[i] != HASHMAP_EMPTY) {
+		if (map->keys[i] == key) {
+			if (inserted) {
+				*inserted = 0;
+			}
+			return &map->values[i];
+		}
+		i = (i + 1) & mask;
+	}
+	map->keys[i] = key;
+	map->values[i] = value;
+	map->count++;
+	if (inserted) {
+		*inserted = 1;
+	}
+	return &map->values[i];
+}
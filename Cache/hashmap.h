@@ -0,0 +1,38 @@
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+/**
+ * Open addressing hash map from 64-bit keys to 64-bit values, used wherever
+ * the simulator needs to index blocks or regions by address
+ */
+typedef struct hashmap_t {
+	uint64_t *keys;
+	uint64_t *values;
+	size_t capacity; /* Always a power of two */
+	size_t count;
+
+	/* HASHMAP_EMPTY marks free slots, so that one key is stored on the side */
+	int has_empty_key;
+	uint64_t empty_key_value;
+} hashmap_t;
+
+#define HASHMAP_EMPTY UINT64_MAX
+
+int hashmap_init(hashmap_t *map, size_t capacity);
+void hashmap_free(hashmap_t *map);
+uint64_t *hashmap_get(const hashmap_t *map, uint64_t key);
+uint64_t *hashmap_put(hashmap_t *map, uint64_t key, uint64_t value, int *inserted);
+void hashmap_clear(hashmap_t *map);
+
+static inline size_t hashmap_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return (size_t)key;
+}
+
+#endif
@@ -0,0 +1,229 @@
+#include "interval.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Start an interval stream
+ *
+ * @param fout Where the NDJSON records go
+ * @param threshold Largest signature distance within one phase
+ * @return The stream, or NULL if memory could not be allocated
+ */
+interval_t *interval_create(FILE *fout, double threshold)
+{
+	interval_t *iv = calloc(1, sizeof(interval_t));
+	if (!iv) {
+		return NULL;
+	}
+	iv->fout = fout;
+	iv->threshold = threshold;
+	iv->phaseCapacity = 16;
+	iv->capacity = 1024;
+	iv->phases = malloc(sizeof(interval_phase) * iv->phaseCapacity);
+	iv->signatures = malloc(sizeof(*iv->signatures) * iv->capacity);
+	iv->phaseOf = malloc(sizeof(uint32_t) * iv->capacity);
+	iv->start = malloc(sizeof(uint64_t) * iv->capacity);
+	if (!iv->phases || !iv->signatures || !iv->phaseOf || !iv->start) {
+		interval_destroy(iv);
+		return NULL;
+	}
+	return iv;
+}
+
+void interval_destroy(interval_t *iv)
+{
+	if (!iv) {
+		return;
+	}
+	free(iv->phases);
+	free(iv->signatures);
+	free(iv->phaseOf);
+	free(iv->start);
+	free(iv);
+}
+
+/* JSON has no NaN or infinity, so ratios over empty counts print as 0 */
+static double interval_number(double x)
+{
+	return isfinite(x) ? x : 0;
+}
+
+/**
+ * The counters of stats accumulated since the previous snapshot, finalized
+ */
+static void interval_delta(const interval_t *iv, const struct cache_stats_t *stats, struct cache_stats_t *delta)
+{
+	const struct cache_stats_t *last = &iv->last;
+	memset(delta, 0, sizeof(struct cache_stats_t));
+	delta->accesses = stats->accesses - last->accesses;
+	delta->reads = stats->reads - last->reads;
+	delta->writes = stats->writes - last->writes;
+	delta->write_backs = stats->write_backs - last->write_backs;
+	delta->l1_read_misses = stats->l1_read_misses - last->l1_read_misses;
+	delta->l1_write_misses = stats->l1_write_misses - last->l1_write_misses;
+	delta->l2_read_misses = stats->l2_read_misses - last->l2_read_misses;
+	delta->l2_write_misses = stats->l2_write_misses - last->l2_write_misses;
+	delta->l1_access_time = stats->l1_access_time;
+	delta->l2_access_time = stats->l2_access_time;
+	delta->memory_access_time = stats->memory_access_time;
+	cache_finalize_stats(delta);
+}
+
+/**
+ * The miss-rate signature of an interval: L1 misses, L2 misses, write-backs
+ * and writes per access
+ */
+static void interval_signature(const struct cache_stats_t *delta, double *signature)
+{
+	double accesses = (double)delta->accesses;
+	signature[0] = (double)(delta->l1_read_misses + delta->l1_write_misses) / accesses;
+	signature[1] = (double)(delta->l2_read_misses + delta->l2_write_misses) / accesses;
+	signature[2] = (double)delta->write_backs / accesses;
+	signature[3] = (double)delta->writes / accesses;
+}
+
+static double interval_distance(const double *a, const double *b)
+{
+	double distance = 0;
+	for (int i = 0; i < INTERVAL_SIGNATURE; i++) {
+		distance += fabs(a[i] - b[i]);
+	}
+	return distance;
+}
+
+/**
+ * Put an interval into the nearest phase, or a new one
+ *
+ * @return The phase, or -1 if memory could not be allocated
+ */
+static int64_t interval_classify(interval_t *iv, const double *signature, uint64_t accesses)
+{
+	size_t best = 0;
+	double bestDistance = INFINITY;
+	for (size_t i = 0; i < iv->phaseCount; i++) {
+		double distance = interval_distance(signature, iv->phases[i].centroid);
+		if (distance < bestDistance) {
+			best = i;
+			bestDistance = distance;
+		}
+	}
+
+	if (bestDistance > iv->threshold) {
+		if (iv->phaseCount == iv->phaseCapacity) {
+			interval_phase *grown = realloc(iv->phases, sizeof(interval_phase) * iv->phaseCapacity * 2);
+			if (!grown) {
+				return -1;
+			}
+			iv->phases = grown;
+			iv->phaseCapacity *= 2;
+		}
+		best = iv->phaseCount++;
+		memset(iv->phases + best, 0, sizeof(interval_phase));
+	}
+
+	/* Running mean of the signatures in the phase */
+	interval_phase *phase = iv->phases + best;
+	phase->intervals++;
+	phase->accesses += accesses;
+	for (int i = 0; i < INTERVAL_SIGNATURE; i++) {
+		phase->centroid[i] += (signature[i] - phase->centroid[i]) / (double)phase->intervals;
+	}
+	return (int64_t)best;
+}
+
+/**
+ * Close the current interval and write its record. Empty intervals (e.g. a
+ * marker right after another) are skipped.
+ *
+ * @param iv The stream
+ * @param stats The cumulative counters of the simulation
+ * @param reason Why the interval ends: "count", "marker" or "end"
+ * @param marker The id of the marker that ends the interval, or NULL
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int interval_snapshot(interval_t *iv, const struct cache_stats_t *stats, const char *reason, const uint64_t *marker)
+{
+	struct cache_stats_t delta;
+	interval_delta(iv, stats, &delta);
+	if (delta.accesses == 0) {
+		return 0;
+	}
+
+	if (iv->count == iv->capacity) {
+		size_t capacity = iv->capacity * 2;
+		double (*signatures)[INTERVAL_SIGNATURE] = realloc(iv->signatures, sizeof(*signatures) * capacity);
+		if (signatures) {
+			iv->signatures = signatures;
+		}
+		uint32_t *phaseOf = realloc(iv->phaseOf, sizeof(uint32_t) * capacity);
+		if (phaseOf) {
+			iv->phaseOf = phaseOf;
+		}
+		uint64_t *start = realloc(iv->start, sizeof(uint64_t) * capacity);
+		if (start) {
+			iv->start = start;
+		}
+		if (!signatures || !phaseOf || !start) {
+			return -1;
+		}
+		iv->capacity = capacity;
+	}
+
+	double *signature = iv->signatures[iv->count];
+	interval_signature(&delta, signature);
+	int64_t phase = interval_classify(iv, signature, delta.accesses);
+	if (phase < 0) {
+		return -1;
+	}
+	iv->phaseOf[iv->count] = (uint32_t)phase;
+	iv->start[iv->count] = iv->last.accesses;
+
+	fprintf(iv->fout, "{\"type\":\"interval\",\"index\":%zu,\"start\":%" PRIu64 ",\"accesses\":%" PRIu64 ",\"reason\":\"%s\",",
+			iv->count, iv->last.accesses, delta.accesses, reason);
+	if (marker) {
+		fprintf(iv->fout, "\"marker\":%" PRIu64 ",", *marker);
+	}
+	fprintf(iv->fout, "\"l1_miss_rate\":%f,\"l2_miss_rate\":%f,\"miss_rate\":%f,\"write_backs\":%" PRIu64 ",\"aat\":%f,\"phase\":%" PRId64 "}\n",
+			interval_number(delta.l1_miss_rate), interval_number(delta.l2_miss_rate), interval_number(delta.miss_rate),
+			delta.write_backs, interval_number(delta.avg_access_time), phase);
+
+	iv->count++;
+	iv->last = *stats;
+	return 0;
+}
+
+/**
+ * Write the phase summary and the totals of the run. Every phase lists its
+ * representative interval (the one nearest to the phase centroid) and its
+ * weight, the fraction of all accesses that fell into the phase.
+ *
+ * @param stats The cumulative counters, already finalized
+ */
+void interval_finish(interval_t *iv, const struct cache_stats_t *stats)
+{
+	fprintf(iv->fout, "{\"type\":\"phases\",\"threshold\":%f,\"phases\":[", iv->threshold);
+	for (size_t p = 0; p < iv->phaseCount; p++) {
+		size_t representative = 0;
+		double bestDistance = INFINITY;
+		for (size_t i = 0; i < iv->count; i++) {
+			if (iv->phaseOf[i] != p) {
+				continue;
+			}
+			double distance = interval_distance(iv->signatures[i], iv->phases[p].centroid);
+			if (distance < bestDistance) {
+				representative = i;
+				bestDistance = distance;
+			}
+		}
+		const interval_phase *phase = iv->phases + p;
+		fprintf(iv->fout, "%s{\"phase\":%zu,\"intervals\":%" PRIu64 ",\"weight\":%f,\"representative\":%zu,\"start\":%" PRIu64 "}",
+				p ? "," : "", p, phase->intervals,
+				interval_number((double)phase->accesses / (double)stats->accesses),
+				representative, iv->start[representative]);
+	}
+	fprintf(iv->fout, "]}\n");
+
+	fprintf(iv->fout, "{\"type\":\"total\",\"accesses\":%" PRIu64 ",\"l1_miss_rate\":%f,\"l2_miss_rate\":%f,\"miss_rate\":%f,\"write_backs\":%" PRIu64 ",\"aat\":%f}\n",
+			stats->accesses, interval_number(stats->l1_miss_rate), interval_number(stats->l2_miss_rate),
+			interval_number(stats->miss_rate), stats->write_backs, interval_number(stats->avg_access_time));
+}
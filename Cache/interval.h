@@ -0,0 +1,47 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <stdio.h>
+#include "cachesim.h"
+
+/* Dimensions of an interval signature, see interval_signature */
+#define INTERVAL_SIGNATURE 4
+
+typedef struct interval_phase_t {
+	double centroid[INTERVAL_SIGNATURE];
+	uint64_t intervals;
+	uint64_t accesses;
+} interval_phase;
+
+/**
+ * Interval statistics of one simulation, streamed as NDJSON (one JSON object
+ * per line). Each snapshot holds the counters accumulated since the previous
+ * one. Intervals are grouped into phases online: an interval joins the phase
+ * whose centroid is nearest to its miss-rate signature if the Manhattan
+ * distance is below the threshold, otherwise it starts a new phase.
+ * interval_finish picks the interval nearest to every phase's centroid as
+ * its representative, SimPoint style.
+ */
+typedef struct interval_t {
+	FILE *fout;
+	double threshold;
+	struct cache_stats_t last; /* Counters at the end of the previous interval */
+
+	interval_phase *phases;
+	size_t phaseCount;
+	size_t phaseCapacity;
+
+	/* Per interval, for picking representatives at the end */
+	double (*signatures)[INTERVAL_SIGNATURE];
+	uint32_t *phaseOf;
+	uint64_t *start; /* First access of the interval */
+	size_t count;
+	size_t capacity;
+} interval_t;
+
+interval_t *interval_create(FILE *fout, double threshold);
+int interval_snapshot(interval_t *iv, const struct cache_stats_t *stats, const char *reason, const uint64_t *marker);
+void interval_finish(interval_t *iv, const struct cache_stats_t *stats);
+void interval_destroy(interval_t *iv);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+/**
+ * Geometries that get an access path specialized at compile time, as
+ * X(C1, C2, S, B). cache_create picks the matching kernel, every other
+ * geometry runs the generic one. Both produce identical results; add the
+ * configurations that are simulated most often.
+ */
+#define CACHE_KERNEL_GEOMETRIES(X) \
+	X(10, 15, 3, 5) /* Defaults */ \
+	X(10, 15, 2, 5) \
+	X(10, 15, 4, 5) \
+	X(12, 16, 3, 6) \
+	X(12, 17, 2, 6) \
+	X(12, 17, 3, 6) \
+	X(12, 18, 4, 6) \
+	X(13, 18, 3, 6) \
+	X(14, 20, 3, 6) \
+	X(15, 20, 4, 6) \
+	X(15, 21, 4, 6) \
+	X(8, 12, 0, 4)
+
+#endif
@@ -0,0 +1,157 @@
+#include "prefetch.h"
+#include <string.h>
+
+/**
+ * Set up a prefetcher
+ *
+ * @param state The state to initialize
+ * @param type The prefetching algorithm, PREFETCH_NONE disables it
+ * @param degree Blocks fetched per trigger, at most PREFETCH_MAX_DEGREE
+ * @param latency Accesses a prefetch takes to arrive
+ * @return 0 on success, -1 if the degree is invalid or memory could not be allocated
+ */
+int prefetch_init(prefetch_state *state, cache_prefetch_t type, uint64_t degree, uint64_t latency)
+{
+	memset(state, 0, sizeof(prefetch_state));
+	if (type != PREFETCH_NONE && (degree == 0 || degree > PREFETCH_MAX_DEGREE)) {
+		return -1;
+	}
+	state->type = type;
+	state->degree = degree;
+	state->latency = latency;
+
+	switch (type) {
+	case PREFETCH_STRIDE:
+		state->strides = calloc(PREFETCH_STRIDE_ENTRIES, sizeof(prefetch_stride_t));
+		return state->strides ? 0 : -1;
+	case PREFETCH_STREAM:
+		state->streams = calloc(PREFETCH_STREAMS, sizeof(prefetch_stream_t));
+		return state->streams ? 0 : -1;
+	default:
+		return 0;
+	}
+}
+
+void prefetch_free(prefetch_state *state)
+{
+	free(state->strides);
+	free(state->streams);
+	state->strides = NULL;
+	state->streams = NULL;
+}
+
+/**
+ * Learn the stride of the block's region and predict along it once the same
+ * stride has been seen PREFETCH_STRIDE_CONFIDENT times in a row
+ */
+static size_t prefetch_stride(prefetch_state *state, uint64_t block, int trigger, uint64_t *targets)
+{
+	uint64_t region = block >> PREFETCH_REGION_BITS;
+	prefetch_stride_t *entry = state->strides + (region % PREFETCH_STRIDE_ENTRIES);
+	if (!entry->valid || entry->region != region) {
+		entry->valid = 1;
+		entry->region = region;
+		entry->last = block;
+		entry->stride = 0;
+		entry->confidence = 0;
+		return 0;
+	}
+
+	int64_t stride = (int64_t)(block - entry->last);
+	if (stride == 0) {
+		return 0;
+	}
+	if (stride == entry->stride) {
+		if (entry->confidence < PREFETCH_STRIDE_CONFIDENT) {
+			entry->confidence++;
+		}
+	} else {
+		entry->stride = stride;
+		entry->confidence = 0;
+	}
+	entry->last = block;
+
+	if (!trigger || entry->confidence < PREFETCH_STRIDE_CONFIDENT) {
+		return 0;
+	}
+	for (uint64_t i = 0; i < state->degree; i++) {
+		targets[i] = block + (i + 1) * stride;
+	}
+	return state->degree;
+}
+
+/**
+ * Follow up to PREFETCH_STREAMS ascending or descending miss streams. A
+ * stream is confirmed by its second miss and then runs degree blocks ahead.
+ */
+static size_t prefetch_stream(prefetch_state *state, uint64_t block, int trigger, uint64_t *targets)
+{
+	if (!trigger) {
+		return 0;
+	}
+	state->clock++;
+
+	prefetch_stream_t *stream = NULL;
+	prefetch_stream_t *oldest = state->streams;
+	for (uint64_t i = 0; i < PREFETCH_STREAMS; i++) {
+		prefetch_stream_t *s = state->streams + i;
+		if (!s->valid) {
+			oldest = s;
+			continue;
+		}
+		int64_t distance = (int64_t)(block - s->last);
+		if (distance != 0 && distance >= -PREFETCH_STREAM_WINDOW && distance <= PREFETCH_STREAM_WINDOW &&
+				(s->direction == 0 || (distance > 0) == (s->direction > 0))) {
+			stream = s;
+			break;
+		}
+		if (oldest->valid && s->used < oldest->used) {
+			oldest = s;
+		}
+	}
+
+	if (!stream) {
+		oldest->valid = 1;
+		oldest->last = block;
+		oldest->direction = 0;
+		oldest->used = state->clock;
+		return 0;
+	}
+
+	stream->direction = block > stream->last ? 1 : -1;
+	stream->last = block;
+	stream->used = state->clock;
+	for (uint64_t i = 0; i < state->degree; i++) {
+		targets[i] = block + (i + 1) * stream->direction;
+	}
+	return state->degree;
+}
+
+/**
+ * Train the prefetcher on one access
+ *
+ * @param state The prefetcher
+ * @param block Block address (address >> B) of the access
+ * @param trigger Whether the access missed or was the first hit on a prefetched block
+ * @param targets Set to the block addresses to prefetch, room for PREFETCH_MAX_DEGREE
+ * @return The number of targets
+ */
+size_t prefetch_train(prefetch_state *state, uint64_t block, int trigger, uint64_t *targets)
+{
+	switch (state->type) {
+	case PREFETCH_NEXTLINE:
+		if (!trigger) {
+			return 0;
+		}
+		for (uint64_t i = 0; i < state->degree; i++) {
+			targets[i] = block + i + 1;
+		}
+		return state->degree;
+	case PREFETCH_STRIDE:
+		return prefetch_stride(state, block, trigger, targets);
+	case PREFETCH_STREAM:
+		return prefetch_stream(state, block, trigger, targets);
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "cachesim.h"
+
+/* Most blocks one access may prefetch */
+#define PREFETCH_MAX_DEGREE 16
+
+/* Stride table: one entry per region of 2^PREFETCH_REGION_BITS blocks */
+#define PREFETCH_STRIDE_ENTRIES 64
+#define PREFETCH_REGION_BITS 6
+#define PREFETCH_STRIDE_CONFIDENT 2
+
+/* Stream tracker: a miss within PREFETCH_STREAM_WINDOW blocks of a stream extends it */
+#define PREFETCH_STREAMS 16
+#define PREFETCH_STREAM_WINDOW 16
+
+typedef struct prefetch_stride_t {
+	uint64_t region;
+	uint64_t last; /* Last block accessed in the region */
+	int64_t stride;
+	uint32_t confidence; /* Times in a row the stride repeated, saturating */
+	uint8_t valid;
+} prefetch_stride_t;
+
+typedef struct prefetch_stream_t {
+	uint64_t last; /* Last block of the stream */
+	int64_t direction; /* +1 or -1 once confirmed, 0 while it is a single miss */
+	uint64_t used; /* For LRU replacement of streams */
+	uint8_t valid;
+} prefetch_stream_t;
+
+/**
+ * A prefetcher of one cache level. It is trained on the block addresses of
+ * the demand accesses that reach the level and returns the blocks to fetch.
+ * Only triggering accesses (misses and first hits on prefetched blocks, so
+ * that a working prefetcher keeps itself going) start prefetches, except for
+ * the stride detector, which learns from every access.
+ */
+typedef struct prefetch_state_t {
+	cache_prefetch_t type;
+	uint64_t degree; /* Blocks fetched per trigger */
+	uint64_t latency; /* Accesses a prefetch takes, demand hits sooner are late */
+	prefetch_stride_t *strides;
+	prefetch_stream_t *streams;
+	uint64_t clock;
+} prefetch_state;
+
+int prefetch_init(prefetch_state *state, cache_prefetch_t type, uint64_t degree, uint64_t latency);
+void prefetch_free(prefetch_state *state);
+size_t prefetch_train(prefetch_state *state, uint64_t block, int trigger, uint64_t *targets);
+
+#endif
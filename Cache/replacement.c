@@ -0,0 +1,184 @@
+#include "replacement.h"
+#include <string.h>
+
+/**
+ * Allocate the metadata of a policy for an L2 with the given shape
+ *
+ * @param state The state to initialize
+ * @param policy The replacement policy
+ * @param sets Number of L2 sets
+ * @param S The L2 has 2^S ways per set
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int repl_init(repl_state *state, cache_repl_t policy, uint64_t sets, uint64_t S)
+{
+	memset(state, 0, sizeof(repl_state));
+	state->policy = policy;
+	state->S = S;
+	state->rng = 0x2545f491;
+
+	switch (policy) {
+	case REPL_PLRU:
+		/* Tree node n (1 .. ways - 1) is bit n of the set's bit vector */
+		state->plruWords = ((1ull << S) + 63) / 64;
+		state->plru = calloc(sets * state->plruWords, sizeof(uint64_t));
+		return state->plru ? 0 : -1;
+	case REPL_SRRIP:
+	case REPL_BRRIP:
+	case REPL_LFU:
+		state->meta = calloc(sets << S, sizeof(uint32_t));
+		return state->meta ? 0 : -1;
+	default:
+		return 0;
+	}
+}
+
+void repl_free(repl_state *state)
+{
+	free(state->meta);
+	free(state->plru);
+	state->meta = NULL;
+	state->plru = NULL;
+}
+
+static uint32_t repl_random(repl_state *state)
+{
+	state->rng ^= state->rng << 13;
+	state->rng ^= state->rng >> 17;
+	state->rng ^= state->rng << 5;
+	return state->rng;
+}
+
+/**
+ * Point every tree node on the path to way away from it
+ */
+static void plru_update(repl_state *state, uint64_t set, uint64_t way)
+{
+	uint64_t *bits = state->plru + set * state->plruWords;
+	uint64_t node = 1;
+	for (uint64_t level = state->S; level > 0; level--) {
+		uint64_t right = (way >> (level - 1)) & 1;
+		if (right) {
+			bits[node / 64] &= ~(1ull << (node % 64));
+		} else {
+			bits[node / 64] |= 1ull << (node % 64);
+		}
+		node = node * 2 + right;
+	}
+}
+
+/**
+ * Update the metadata of a block that was hit
+ */
+void repl_touch(repl_state *state, uint64_t set, uint64_t way)
+{
+	uint64_t block = (set << state->S) + way;
+	switch (state->policy) {
+	case REPL_PLRU:
+		plru_update(state, set, way);
+		break;
+	case REPL_SRRIP:
+	case REPL_BRRIP:
+		state->meta[block] = 0;
+		break;
+	case REPL_LFU:
+		if (state->meta[block] < UINT32_MAX) {
+			state->meta[block]++;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * repl_touch n times in a row. Only LFU counts every hit, the other policies
+ * end up in the state of a single touch.
+ */
+void repl_touch_repeat(repl_state *state, uint64_t set, uint64_t way, uint64_t n)
+{
+	if (!n) {
+		return;
+	}
+	if (state->policy == REPL_LFU) {
+		uint32_t *count = state->meta + (set << state->S) + way;
+		*count = n < UINT32_MAX - *count ? *count + (uint32_t)n : UINT32_MAX;
+	} else {
+		repl_touch(state, set, way);
+	}
+}
+
+/**
+ * Update the metadata of a block that was just brought into the cache
+ */
+void repl_fill(repl_state *state, uint64_t set, uint64_t way)
+{
+	uint64_t block = (set << state->S) + way;
+	switch (state->policy) {
+	case REPL_PLRU:
+		plru_update(state, set, way);
+		break;
+	case REPL_SRRIP:
+		state->meta[block] = RRPV_LONG;
+		break;
+	case REPL_BRRIP:
+		state->meta[block] = (repl_random(state) % BRRIP_EPSILON) ? RRPV_MAX : RRPV_LONG;
+		break;
+	case REPL_LFU:
+		state->meta[block] = 1;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Pick the way to evict from a full set. Not used for LRU, whose victim is
+ * found from the block counters while the set is scanned for a hit.
+ */
+uint64_t repl_victim(repl_state *state, uint64_t set)
+{
+	uint64_t ways = 1ull << state->S;
+	uint32_t *meta = state->meta + (set << state->S);
+
+	switch (state->policy) {
+	case REPL_PLRU: {
+		uint64_t *bits = state->plru + set * state->plruWords;
+		uint64_t node = 1;
+		for (uint64_t level = 0; level < state->S; level++) {
+			node = node * 2 + ((bits[node / 64] >> (node % 64)) & 1);
+		}
+		return node - ways;
+	}
+	case REPL_SRRIP:
+	case REPL_BRRIP: {
+		/* Age the whole set by the distance of the oldest block to RRPV_MAX in one step */
+		uint64_t victim = 0;
+		for (uint64_t i = 1; i < ways; i++) {
+			if (meta[i] > meta[victim]) {
+				victim = i;
+			}
+		}
+		uint32_t age = RRPV_MAX - meta[victim];
+		if (age) {
+			for (uint64_t i = 0; i < ways; i++) {
+				meta[i] += age;
+			}
+		}
+		return victim;
+	}
+	case REPL_LFU: {
+		uint64_t victim = 0;
+		for (uint64_t i = 1; i < ways; i++) {
+			if (meta[i] < meta[victim]) {
+				victim = i;
+			}
+		}
+		return victim;
+	}
+	case REPL_RANDOM:
+		return repl_random(state) & (ways - 1);
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include "cachesim.h"
+
+/**
+ * Replacement metadata of the L2. It lives in arrays next to the L2 block
+ * array: one word per block for RRPVs and LFU counts, and a small bit vector
+ * per set for the tree-PLRU. LRU keeps using the counter in every block.
+ *
+ * All policies update their metadata in constant time (O(S) for the PLRU
+ * tree) when a block is hit or filled. Victim selection is only needed once
+ * a set is full.
+ */
+typedef struct repl_state_t {
+	cache_repl_t policy;
+	uint64_t S; /* 2^S ways per set */
+	uint32_t *meta; /* RRPV or use count, one per L2 block */
+	uint64_t *plru; /* Tree bits, plruWords per set */
+	uint64_t plruWords;
+	uint32_t rng;
+} repl_state;
+
+/* Re-reference prediction values of SRRIP/BRRIP (2-bit RRPVs) */
+#define RRPV_MAX 3
+#define RRPV_LONG 2
+/* BRRIP inserts with a long RRPV once every BRRIP_EPSILON fills */
+#define BRRIP_EPSILON 32
+
+int repl_init(repl_state *state, cache_repl_t policy, uint64_t sets, uint64_t S);
+void repl_free(repl_state *state);
+void repl_touch(repl_state *state, uint64_t set, uint64_t way);
+void repl_touch_repeat(repl_state *state, uint64_t set, uint64_t way, uint64_t n);
+void repl_fill(repl_state *state, uint64_t set, uint64_t way);
+uint64_t repl_victim(repl_state *state, uint64_t set);
+
+#endif
@@ -0,0 +1,217 @@
+#include "stackdist.h"
+#include <string.h>
+
+static uint32_t stackdist_random(stackdist_t *sd)
+{
+	sd->seed ^= sd->seed << 13;
+	sd->seed ^= sd->seed >> 17;
+	sd->seed ^= sd->seed << 5;
+	return sd->seed;
+}
+
+static inline void stackdist_update(stackdist_node_t *n, uint32_t t)
+{
+	n[t].size = 1 + n[n[t].left].size + n[n[t].right].size;
+}
+
+/**
+ * Split the tree rooted at t into the nodes older than time (l) and the rest (r)
+ */
+static void stackdist_split(stackdist_node_t *n, uint32_t t, uint64_t time, uint32_t *l, uint32_t *r)
+{
+	if (!t) {
+		*l = 0;
+		*r = 0;
+		return;
+	}
+	if (n[t].time < time) {
+		stackdist_split(n, n[t].right, time, &n[t].right, r);
+		*l = t;
+	} else {
+		stackdist_split(n, n[t].left, time, l, &n[t].left);
+		*r = t;
+	}
+	stackdist_update(n, t);
+}
+
+/**
+ * Join two trees where every node of a is older than every node of b
+ */
+static uint32_t stackdist_merge(stackdist_node_t *n, uint32_t a, uint32_t b)
+{
+	if (!a) {
+		return b;
+	}
+	if (!b) {
+		return a;
+	}
+	if (n[a].priority > n[b].priority) {
+		n[a].right = stackdist_merge(n, n[a].right, b);
+		stackdist_update(n, a);
+		return a;
+	}
+	n[b].left = stackdist_merge(n, a, n[b].left);
+	stackdist_update(n, b);
+	return b;
+}
+
+/**
+ * Create an analyzer for every LRU cache of up to 2^C bytes with 2^B byte blocks
+ *
+ * @return The analyzer, or NULL if memory could not be allocated
+ */
+stackdist_t *stackdist_create(uint64_t C, uint64_t B)
+{
+	stackdist_t *sd = calloc(1, sizeof(stackdist_t));
+	if (!sd) {
+		return NULL;
+	}
+	sd->B = B;
+	sd->levels = C - B + 1;
+	sd->seed = 2463534242u;
+	sd->node_capacity = 1024 * sd->levels;
+	sd->nodes = calloc(sd->node_capacity, sizeof(stackdist_node_t));
+	sd->node_count = 1;
+	sd->roots = calloc(sd->levels, sizeof(uint32_t *));
+	sd->hist = calloc(sd->levels, sizeof(uint64_t *));
+	if (!sd->nodes || !sd->roots || !sd->hist || hashmap_init(&sd->blocks, 1024)) {
+		stackdist_destroy(sd);
+		return NULL;
+	}
+	for (uint64_t k = 0; k < sd->levels; k++) {
+		sd->roots[k] = calloc(1ull << k, sizeof(uint32_t));
+		sd->hist[k] = calloc((1ull << (C - B - k)) + 1, sizeof(uint64_t));
+		if (!sd->roots[k] || !sd->hist[k]) {
+			stackdist_destroy(sd);
+			return NULL;
+		}
+	}
+	return sd;
+}
+
+/**
+ * Record one access. Reads and writes affect LRU state identically, so the
+ * access type is not needed.
+ *
+ * @return The fully associative stack distance of the access, UINT64_MAX for
+ *         the first access to a block
+ */
+uint64_t stackdist_access(stackdist_t *sd, uint64_t address)
+{
+	uint64_t block = address >> sd->B;
+	uint64_t now = ++sd->time;
+	sd->accesses++;
+
+	int inserted;
+	uint64_t *slot = hashmap_put(&sd->blocks, block, sd->node_count, &inserted);
+	if (!slot) {
+		perror("stackdist");
+		exit(1);
+	}
+	uint64_t first = *slot;
+
+	if (inserted) {
+		if (sd->node_count + sd->levels > sd->node_capacity) {
+			size_t capacity = sd->node_capacity * 2;
+			stackdist_node_t *nodes = realloc(sd->nodes, capacity * sizeof(stackdist_node_t));
+			if (!nodes) {
+				perror("stackdist");
+				exit(1);
+			}
+			sd->nodes = nodes;
+			sd->node_capacity = capacity;
+		}
+		sd->node_count += sd->levels;
+		sd->cold_misses++;
+	}
+
+	uint64_t result = UINT64_MAX;
+	stackdist_node_t *n = sd->nodes;
+	for (uint64_t k = 0; k < sd->levels; k++) {
+		uint32_t x = (uint32_t)(first + k);
+		uint32_t *root = &sd->roots[k][block & ((1ull << k) - 1)];
+
+		if (!inserted) {
+			uint32_t older, newer, rest;
+			stackdist_split(n, *root, n[x].time, &older, &newer);
+			uint64_t distance = n[newer].size - 1;
+			stackdist_split(n, newer, n[x].time + 1, &newer, &rest);
+			*root = stackdist_merge(n, older, rest);
+
+			uint64_t limit = 1ull << (sd->levels - 1 - k);
+			sd->hist[k][distance < limit ? distance : limit]++;
+			if (k == 0) {
+				result = distance;
+			}
+		} else {
+			n[x].priority = stackdist_random(sd);
+		}
+
+		n[x].time = now;
+		n[x].size = 1;
+		n[x].left = 0;
+		n[x].right = 0;
+		*root = stackdist_merge(n, *root, x);
+	}
+	return result;
+}
+
+/**
+ * Number of misses an LRU cache of 2^C bytes with 2^S ways would have seen
+ */
+uint64_t stackdist_misses(const stackdist_t *sd, uint64_t C, uint64_t S)
+{
+	uint64_t k = C - sd->B - S;
+	uint64_t limit = 1ull << (sd->levels - 1 - k);
+	uint64_t misses = sd->cold_misses;
+	for (uint64_t d = 1ull << S; d <= limit; d++) {
+		misses += sd->hist[k][d];
+	}
+	return misses;
+}
+
+/**
+ * Print the miss curve of every L2 geometry as CSV
+ *
+ * l2_miss_rate is reported the way cache_cleanup computes it, relative to the
+ * misses of a direct-mapped 2^C1 byte L1. Because the L2 is inclusive and sees
+ * every access, its misses are exact for any geometry; the L1 misses are exact
+ * whenever the L2 has at least as many sets as the L1 (C2 - S >= C1), since
+ * only then can back-invalidations not disturb the L1 (column exact).
+ *
+ * @param C1 The L1 size used for l2_miss_rate, must not exceed the analyzer's C
+ */
+void stackdist_print_csv(const stackdist_t *sd, uint64_t C1, FILE *fout)
+{
+	uint64_t l1_misses = stackdist_misses(sd, C1, 0);
+	uint64_t C = sd->levels - 1 + sd->B;
+
+	fprintf(fout, "C2,S,B,accesses,l2_misses,l2_miss_rate,miss_ratio,exact\n");
+	for (uint64_t C2 = sd->B; C2 <= C; C2++) {
+		for (uint64_t S = 0; S <= C2 - sd->B; S++) {
+			uint64_t misses = stackdist_misses(sd, C2, S);
+			fprintf(fout, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%f,%f,%d\n",
+					C2, S, sd->B, sd->accesses, misses,
+					(double)misses / (double)l1_misses, (double)misses / (double)sd->accesses,
+					C2 - S >= C1);
+		}
+	}
+}
+
+void stackdist_destroy(stackdist_t *sd)
+{
+	if (!sd) {
+		return;
+	}
+	for (uint64_t k = 0; sd->roots && k < sd->levels; k++) {
+		free(sd->roots[k]);
+	}
+	for (uint64_t k = 0; sd->hist && k < sd->levels; k++) {
+		free(sd->hist[k]);
+	}
+	free(sd->roots);
+	free(sd->hist);
+	free(sd->nodes);
+	hashmap_free(&sd->blocks);
+	free(sd);
+}
@@ -0,0 +1,49 @@
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <stdio.h>
+#include "hashmap.h"
+
+/**
+ * LRU stack distance (Mattson) analyzer
+ *
+ * For every number of sets 2^k with k in [0, C - B] the analyzer keeps one
+ * recency tree per set, ordered by the time each block was last touched. The
+ * stack distance of an access is the number of distinct blocks of the same set
+ * touched since the previous access to its block, so an LRU cache with 2^k
+ * sets and 2^s ways misses exactly on the accesses whose distance is at least
+ * 2^s. One pass over the trace therefore yields the miss count of every
+ * (C2, S) geometry with block size 2^B and C2 <= C.
+ */
+typedef struct stackdist_node_t {
+	uint64_t time; /* Last access to the block; the tree key */
+	uint32_t size; /* Nodes in the subtree rooted here */
+	uint32_t priority;
+	uint32_t left;
+	uint32_t right;
+} stackdist_node_t;
+
+typedef struct stackdist_t {
+	uint64_t B;
+	uint64_t levels; /* Number of set counts tracked: 2^0 .. 2^(levels - 1) sets */
+	uint64_t time;
+	uint64_t accesses;
+	uint64_t cold_misses;
+
+	hashmap_t blocks; /* Block address -> index of its first node */
+	stackdist_node_t *nodes; /* levels consecutive nodes per block, node 0 is nil */
+	size_t node_count;
+	size_t node_capacity;
+	uint32_t seed;
+
+	uint32_t **roots; /* roots[k][set] for 2^k sets */
+	uint64_t **hist; /* hist[k][d] counts distance d, the last bucket collects anything larger */
+} stackdist_t;
+
+stackdist_t *stackdist_create(uint64_t C, uint64_t B);
+uint64_t stackdist_access(stackdist_t *sd, uint64_t address);
+uint64_t stackdist_misses(const stackdist_t *sd, uint64_t C, uint64_t S);
+void stackdist_print_csv(const stackdist_t *sd, uint64_t C1, FILE *fout);
+void stackdist_destroy(stackdist_t *sd);
+
+#endif
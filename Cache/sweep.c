@@ -0,0 +1,293 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sweep.h"
+#include <pthread.h>
+#include <string.h>
+#include <strings.h>
+
+typedef struct sweep_range_t {
+	uint64_t lo;
+	uint64_t hi;
+} sweep_range_t;
+
+/**
+ * Parse one "lo-hi" or "value" range of a grid specification
+ */
+static int sweep_parse_range(const char *text, sweep_range_t *range)
+{
+	char *end;
+	range->lo = strtoull(text, &end, 10);
+	if (end == text) {
+		return -1;
+	}
+	range->hi = range->lo;
+	if (*end == '-') {
+		text = end + 1;
+		range->hi = strtoull(text, &end, 10);
+		if (end == text) {
+			return -1;
+		}
+	}
+	return (*end == '\0' && range->lo <= range->hi) ? 0 : -1;
+}
+
+/**
+ * Expand a grid specification into the list of configurations it covers
+ *
+ * The specification is a comma separated list of KEY=lo-hi (or KEY=value)
+ * entries where KEY is one of C1, C2, S or B. Parameters that are not listed
+ * keep the value from defaults. Points that do not describe a valid cache
+ * (B > C1 or S + B > C2) are skipped.
+ *
+ * @param spec The grid, e.g. "C1=8-12,C2=14-18,S=0-4,B=5"
+ * @param defaults Values for parameters the grid does not mention
+ * @param configs Set to a malloc'd array of configurations
+ * @param count Set to the number of configurations
+ * @return 0 on success, -1 if spec could not be parsed
+ */
+int sweep_parse_grid(const char *spec, const sweep_config_t *defaults, sweep_config_t **configs, size_t *count)
+{
+	sweep_range_t c1 = { defaults->C1, defaults->C1 };
+	sweep_range_t c2 = { defaults->C2, defaults->C2 };
+	sweep_range_t s = { defaults->S, defaults->S };
+	sweep_range_t b = { defaults->B, defaults->B };
+
+	char *copy = strdup(spec);
+	if (!copy) {
+		return -1;
+	}
+	for (char *item = strtok(copy, ","); item; item = strtok(NULL, ",")) {
+		char *value = strchr(item, '=');
+		if (!value) {
+			free(copy);
+			return -1;
+		}
+		*value++ = '\0';
+
+		sweep_range_t *range;
+		if (!strcasecmp(item, "C1")) {
+			range = &c1;
+		} else if (!strcasecmp(item, "C2")) {
+			range = &c2;
+		} else if (!strcasecmp(item, "S")) {
+			range = &s;
+		} else if (!strcasecmp(item, "B")) {
+			range = &b;
+		} else {
+			free(copy);
+			return -1;
+		}
+		if (sweep_parse_range(value, range)) {
+			free(copy);
+			return -1;
+		}
+	}
+	free(copy);
+
+	size_t capacity = (c1.hi - c1.lo + 1) * (c2.hi - c2.lo + 1) * (s.hi - s.lo + 1) * (b.hi - b.lo + 1);
+	*configs = malloc(sizeof(sweep_config_t) * capacity);
+	if (!*configs) {
+		return -1;
+	}
+	*count = 0;
+	for (uint64_t C1 = c1.lo; C1 <= c1.hi; C1++) {
+		for (uint64_t C2 = c2.lo; C2 <= c2.hi; C2++) {
+			for (uint64_t S = s.lo; S <= s.hi; S++) {
+				for (uint64_t B = b.lo; B <= b.hi; B++) {
+					if (B > C1 || S + B > C2) {
+						continue;
+					}
+					sweep_config_t *config = *configs + (*count)++;
+					config->C1 = C1;
+					config->C2 = C2;
+					config->S = S;
+					config->B = B;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+ * Create one cache context per configuration
+ *
+ * @param configs The configurations to simulate
+ * @param count The number of configurations
+ * @param timing Supplies the l1/l2/memory access times every configuration is evaluated with
+ * @return The sweep, or NULL if memory could not be allocated
+ */
+sweep_t *sweep_create(const sweep_config_t *configs, size_t count, const struct cache_stats_t *timing)
+{
+	sweep_t *sweep = calloc(1, sizeof(sweep_t));
+	if (!sweep) {
+		return NULL;
+	}
+	sweep->configs = malloc(sizeof(sweep_config_t) * count);
+	sweep->ctxs = calloc(count, sizeof(cache_ctx_t *));
+	sweep->stats = calloc(count, sizeof(struct cache_stats_t));
+	if (!sweep->configs || !sweep->ctxs || !sweep->stats) {
+		sweep_destroy(sweep);
+		return NULL;
+	}
+	memcpy(sweep->configs, configs, sizeof(sweep_config_t) * count);
+	sweep->count = count;
+
+	for (size_t i = 0; i < count; i++) {
+		sweep->ctxs[i] = cache_create(configs[i].C1, configs[i].C2, configs[i].S, configs[i].B);
+		if (!sweep->ctxs[i]) {
+			sweep_destroy(sweep);
+			return NULL;
+		}
+		sweep->stats[i].l1_access_time = timing->l1_access_time;
+		sweep->stats[i].l2_access_time = timing->l2_access_time;
+		sweep->stats[i].memory_access_time = timing->memory_access_time;
+	}
+	return sweep;
+}
+
+/**
+ * Feed one access of the trace to every configuration
+ */
+void sweep_access(sweep_t *sweep, char rw, uint64_t address)
+{
+	for (size_t i = 0; i < sweep->count; i++) {
+		cache_access_ctx(sweep->ctxs[i], rw, address, &sweep->stats[i]);
+	}
+}
+
+/**
+ * Feed a block of accesses of the trace to every configuration
+ */
+void sweep_access_batch(sweep_t *sweep, const char *rw, const uint64_t *address, size_t n)
+{
+	for (size_t i = 0; i < sweep->count; i++) {
+		cache_access_batch_ctx(sweep->ctxs[i], rw, address, n, &sweep->stats[i]);
+	}
+}
+
+/**
+ * State shared by the workers of sweep_run_parallel
+ */
+typedef struct sweep_pool_t {
+	sweep_t *sweep;
+	const trace_buffer_t *trace;
+	pthread_mutex_t lock;
+	size_t next; /* Next configuration nobody has claimed yet */
+} sweep_pool_t;
+
+/**
+ * Worker of sweep_run_parallel. Claims one configuration at a time and
+ * replays the whole shared trace against it. Every configuration has its own
+ * context and stats, so the only shared write is the claim counter.
+ */
+static void *sweep_worker(void *arg)
+{
+	sweep_pool_t *pool = arg;
+	const trace_buffer_t *trace = pool->trace;
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		size_t i = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		if (i >= pool->sweep->count) {
+			return NULL;
+		}
+
+		cache_ctx_t *ctx = pool->sweep->ctxs[i];
+		struct cache_stats_t *stats = &pool->sweep->stats[i];
+		cache_access_batch_ctx(ctx, trace->rw, trace->address, trace->count, stats);
+	}
+}
+
+/**
+ * Replay a decoded trace against every configuration using a pool of threads
+ *
+ * @param sweep The configurations to simulate
+ * @param trace The decoded trace, shared read-only between the workers
+ * @param threads Number of worker threads
+ * @return 0 on success, -1 if the workers could not be started
+ */
+int sweep_run_parallel(sweep_t *sweep, const trace_buffer_t *trace, int threads)
+{
+	sweep_pool_t pool;
+	pool.sweep = sweep;
+	pool.trace = trace;
+	pool.next = 0;
+	if (pthread_mutex_init(&pool.lock, NULL)) {
+		return -1;
+	}
+
+	pthread_t *workers = malloc(sizeof(pthread_t) * threads);
+	if (!workers) {
+		pthread_mutex_destroy(&pool.lock);
+		return -1;
+	}
+	int started = 0;
+	while (started < threads && !pthread_create(&workers[started], NULL, sweep_worker, &pool)) {
+		started++;
+	}
+	/* If fewer threads could be started the ones that did still drain the queue */
+	if (started == 0) {
+		sweep_worker(&pool);
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i], NULL);
+	}
+
+	free(workers);
+	pthread_mutex_destroy(&pool.lock);
+	return 0;
+}
+
+/**
+ * Compute the final statistics of every configuration
+ */
+void sweep_finish(sweep_t *sweep)
+{
+	for (size_t i = 0; i < sweep->count; i++) {
+		cache_finalize_stats(&sweep->stats[i]);
+	}
+}
+
+/**
+ * Print one CSV row of cache_stats_t per configuration, preceded by a header row
+ */
+void sweep_print_csv(const sweep_t *sweep, FILE *fout)
+{
+	fprintf(fout, "C1,C2,S,B,accesses,reads,read_misses,writes,write_misses,misses,write_backs,"
+			"l1_read_misses,l1_write_misses,l2_read_misses,l2_write_misses,"
+			"l1_access_time,l2_access_time,memory_access_time,"
+			"l1_miss_rate,l2_miss_rate,miss_rate,l2_avg_access_time,avg_access_time\n");
+	for (size_t i = 0; i < sweep->count; i++) {
+		const sweep_config_t *c = &sweep->configs[i];
+		const struct cache_stats_t *p = &sweep->stats[i];
+		fprintf(fout, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",", c->C1, c->C2, c->S, c->B);
+		fprintf(fout, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",",
+				p->accesses, p->reads, p->read_misses, p->writes, p->write_misses, p->misses, p->write_backs);
+		fprintf(fout, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",",
+				p->l1_read_misses, p->l1_write_misses, p->l2_read_misses, p->l2_write_misses);
+		fprintf(fout, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",",
+				p->l1_access_time, p->l2_access_time, p->memory_access_time);
+		fprintf(fout, "%f,%f,%f,%f,%f\n",
+				p->l1_miss_rate, p->l2_miss_rate, p->miss_rate, p->l2_avg_access_time, p->avg_access_time);
+	}
+}
+
+/**
+ * Release a sweep and all of its contexts
+ */
+void sweep_destroy(sweep_t *sweep)
+{
+	if (!sweep) {
+		return;
+	}
+	if (sweep->ctxs) {
+		for (size_t i = 0; i < sweep->count; i++) {
+			cache_destroy(sweep->ctxs[i]);
+		}
+	}
+	free(sweep->configs);
+	free(sweep->ctxs);
+	free(sweep->stats);
+	free(sweep);
+}
@@ -0,0 +1,38 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdio.h>
+#include "cachesim.h"
+#include "trace.h"
+
+/**
+ * One point of a design space sweep. All values are in bits, exactly as
+ * they are passed to cache_init.
+ */
+typedef struct sweep_config_t {
+	uint64_t C1;
+	uint64_t C2;
+	uint64_t S;
+	uint64_t B;
+} sweep_config_t;
+
+/**
+ * A set of independent cache contexts that are all driven by the same trace
+ */
+typedef struct sweep_t {
+	size_t count;
+	sweep_config_t *configs;
+	cache_ctx_t **ctxs;
+	struct cache_stats_t *stats;
+} sweep_t;
+
+int sweep_parse_grid(const char *spec, const sweep_config_t *defaults, sweep_config_t **configs, size_t *count);
+sweep_t *sweep_create(const sweep_config_t *configs, size_t count, const struct cache_stats_t *timing);
+void sweep_access(sweep_t *sweep, char rw, uint64_t address);
+void sweep_access_batch(sweep_t *sweep, const char *rw, const uint64_t *address, size_t n);
+int sweep_run_parallel(sweep_t *sweep, const trace_buffer_t *trace, int threads);
+void sweep_finish(sweep_t *sweep);
+void sweep_print_csv(const sweep_t *sweep, FILE *fout);
+void sweep_destroy(sweep_t *sweep);
+
+#endif
@@ -0,0 +1,114 @@
+#include "tagstore.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TAG_STORE_X86 1
+#include <immintrin.h>
+#endif
+
+static int64_t tag_store_find_scalar(const tag_store *store, uint64_t set, uint64_t tag)
+{
+	uint64_t ways = 1ull << store->S;
+	const uint64_t *tags = store->tags + (set << store->S);
+	const uint8_t *valid = store->valid + (set << store->S);
+	for (uint64_t i = 0; i < ways; i++) {
+		if (tags[i] == tag && valid[i] > 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+#ifdef TAG_STORE_X86
+__attribute__((target("sse4.1")))
+static int64_t tag_store_find_sse(const tag_store *store, uint64_t set, uint64_t tag)
+{
+	uint64_t ways = 1ull << store->S;
+	const uint64_t *tags = store->tags + (set << store->S);
+	const uint8_t *valid = store->valid + (set << store->S);
+	__m128i key = _mm_set1_epi64x(tag);
+	for (uint64_t i = 0; i < ways; i += 2) {
+		__m128i line = _mm_loadu_si128((const __m128i *)(tags + i));
+		int mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpeq_epi64(line, key)));
+		/* An invalid way can still hold a stale copy of the tag */
+		for (; mask; mask &= mask - 1) {
+			uint64_t way = i + __builtin_ctz(mask);
+			if (valid[way] > 0) {
+				return way;
+			}
+		}
+	}
+	return -1;
+}
+
+__attribute__((target("avx2")))
+static int64_t tag_store_find_avx2(const tag_store *store, uint64_t set, uint64_t tag)
+{
+	uint64_t ways = 1ull << store->S;
+	const uint64_t *tags = store->tags + (set << store->S);
+	const uint8_t *valid = store->valid + (set << store->S);
+	__m256i key = _mm256_set1_epi64x(tag);
+	for (uint64_t i = 0; i < ways; i += 4) {
+		__m256i line = _mm256_loadu_si256((const __m256i *)(tags + i));
+		int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(line, key)));
+		for (; mask; mask &= mask - 1) {
+			uint64_t way = i + __builtin_ctz(mask);
+			if (valid[way] > 0) {
+				return way;
+			}
+		}
+	}
+	return -1;
+}
+#endif
+
+/**
+ * Allocate an empty tag store
+ *
+ * @param store The store to initialize
+ * @param sets Number of sets
+ * @param S Each set has 2^S ways
+ * @return 0 on success, -1 if memory could not be allocated
+ */
+int tag_store_init(tag_store *store, uint64_t sets, uint64_t S)
+{
+	uint64_t blocks = sets << S;
+	store->S = S;
+	store->tags = calloc(blocks, sizeof(uint64_t));
+	store->valid = calloc(blocks, sizeof(uint8_t));
+	store->dirty = calloc(blocks, sizeof(uint8_t));
+	store->age = calloc(blocks, sizeof(uint64_t));
+	store->prefetched = calloc(blocks, sizeof(uint8_t));
+	if (!store->tags || !store->valid || !store->dirty || !store->age || !store->prefetched) {
+		tag_store_free(store);
+		return -1;
+	}
+
+	/* The vector loops read whole vectors, so they need at least that many ways */
+	store->find = tag_store_find_scalar;
+	store->lanes = 1;
+#ifdef TAG_STORE_X86
+	__builtin_cpu_init();
+	if (S >= 2 && __builtin_cpu_supports("avx2")) {
+		store->find = tag_store_find_avx2;
+		store->lanes = 4;
+	} else if (S >= 1 && __builtin_cpu_supports("sse4.1")) {
+		store->find = tag_store_find_sse;
+		store->lanes = 2;
+	}
+#endif
+	return 0;
+}
+
+void tag_store_free(tag_store *store)
+{
+	free(store->tags);
+	free(store->valid);
+	free(store->dirty);
+	free(store->age);
+	free(store->prefetched);
+	store->tags = NULL;
+	store->valid = NULL;
+	store->dirty = NULL;
+	store->age = NULL;
+	store->prefetched = NULL;
+}
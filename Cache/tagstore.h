@@ -0,0 +1,95 @@
+#ifndef TAGSTORE_H
+#define TAGSTORE_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Structure-of-arrays tag store of a set associative cache. Block i of set s
+ * is entry (s << S) + i of every array, so each set's tags are contiguous and
+ * can be compared several ways at a time.
+ */
+typedef struct tag_store_t {
+	uint64_t S; /* 2^S ways per set */
+	uint64_t *tags;
+	uint8_t *valid;
+	uint8_t *dirty;
+	uint64_t *age; /* Time of the last access, used by LRU */
+	uint8_t *prefetched; /* Filled by the L2 prefetcher and not used yet */
+
+	/* Way lookup, picked at runtime for the widest compare the CPU supports */
+	int64_t (*find)(const struct tag_store_t *store, uint64_t set, uint64_t tag);
+	unsigned int lanes; /* Tags find compares at once: 1, 2 (SSE4.1) or 4 (AVX2) */
+} tag_store;
+
+/* Tags of one set as compared by tag_store_scan */
+typedef uint64_t tag_store_vec2 __attribute__((vector_size(16)));
+typedef uint64_t tag_store_vec4 __attribute__((vector_size(32)));
+
+int tag_store_init(tag_store *store, uint64_t sets, uint64_t S);
+void tag_store_free(tag_store *store);
+
+/**
+ * Find the way of a set holding a valid block with the given tag
+ *
+ * @return The way, or -1 if the tag is not in the set
+ */
+static inline int64_t tag_store_find(const tag_store *store, uint64_t set, uint64_t tag)
+{
+	return store->find(store, set, tag);
+}
+
+/*
+ * The loops of tag_store_scan. They use generic vector types rather than
+ * intrinsics, so they inline into any caller and compile to SSE4.1 or AVX2
+ * compares in callers built for those targets.
+ */
+#define TAG_STORE_SCAN_VEC(type, width) \
+	type key = { 0 }; \
+	key += tag; \
+	for (uint64_t i = 0; i < (1ull << S); i += width) { \
+		type line; \
+		memcpy(&line, tags + i, sizeof(line)); \
+		type eq = line == key; \
+		uint64_t any = 0; \
+		for (unsigned int j = 0; j < width; j++) { \
+			any |= eq[j]; \
+		} \
+		/* An invalid way can still hold a stale copy of the tag */ \
+		for (unsigned int j = 0; any && j < width; j++) { \
+			if (eq[j] && valid[i + j] > 0) { \
+				return i + j; \
+			} \
+		} \
+	} \
+	return -1;
+
+/**
+ * tag_store_find for callers that know the geometry at compile time. With
+ * constant S and lanes the whole set scan unrolls into straight-line
+ * compares, lanes tags at a time; lanes must not exceed 2^S. lanes 0 falls
+ * back to the runtime dispatch of tag_store_find.
+ */
+static inline __attribute__((always_inline)) int64_t tag_store_scan(const tag_store *store, uint64_t set, uint64_t tag, uint64_t S, unsigned int lanes)
+{
+	if (lanes == 0) {
+		return store->find(store, set, tag);
+	}
+	const uint64_t *tags = store->tags + (set << S);
+	const uint8_t *valid = store->valid + (set << S);
+	if (lanes == 4) {
+		TAG_STORE_SCAN_VEC(tag_store_vec4, 4)
+	}
+	if (lanes == 2) {
+		TAG_STORE_SCAN_VEC(tag_store_vec2, 2)
+	}
+	for (uint64_t i = 0; i < (1ull << S); i++) {
+		if (tags[i] == tag && valid[i] > 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+#endif
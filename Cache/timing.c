@@ -0,0 +1,172 @@
+#include "timing.h"
+#include <string.h>
+
+/**
+ * Set up the cycle model
+ *
+ * @param state The state to initialize
+ * @param config MSHRs per level and the memory transfer interval
+ * @return 0 on success, -1 if the configuration is invalid or memory could not be allocated
+ */
+int timing_init(timing_state *state, const struct cache_timing_config_t *config)
+{
+	memset(state, 0, sizeof(timing_state));
+	if (config->l1_mshrs == 0 || config->l1_mshrs > TIMING_MAX_MSHRS ||
+			config->l2_mshrs == 0 || config->l2_mshrs > TIMING_MAX_MSHRS) {
+		return -1;
+	}
+	state->l1Mshrs = config->l1_mshrs;
+	state->l2Mshrs = config->l2_mshrs;
+	state->memoryInterval = config->memory_interval;
+	state->mshr1 = calloc(state->l1Mshrs, sizeof(timing_mshr));
+	state->mshr2 = calloc(state->l2Mshrs, sizeof(timing_mshr));
+	if (!state->mshr1 || !state->mshr2) {
+		timing_free(state);
+		return -1;
+	}
+	return 0;
+}
+
+void timing_free(timing_state *state)
+{
+	free(state->mshr1);
+	free(state->mshr2);
+	state->mshr1 = NULL;
+	state->mshr2 = NULL;
+}
+
+/**
+ * The MSHR that is outstanding for a block at cycle t, or NULL
+ */
+static timing_mshr *timing_pending(timing_mshr *mshrs, uint64_t count, uint64_t block, uint64_t t)
+{
+	for (uint64_t i = 0; i < count; i++) {
+		if (mshrs[i].done > t && mshrs[i].block == block) {
+			return mshrs + i;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * The MSHR that frees up first, which is free at cycle t if any is
+ */
+static timing_mshr *timing_first_free(timing_mshr *mshrs, uint64_t count)
+{
+	timing_mshr *first = mshrs;
+	for (uint64_t i = 1; i < count; i++) {
+		if (mshrs[i].done < first->done) {
+			first = mshrs + i;
+		}
+	}
+	return first;
+}
+
+/**
+ * Start a block transfer on the memory channel
+ *
+ * @return The cycle the transfer starts
+ */
+static uint64_t timing_transfer(timing_state *state, uint64_t t)
+{
+	uint64_t start = t > state->channelFree ? t : state->channelFree;
+	state->channelFree = start + state->memoryInterval;
+	return start;
+}
+
+/**
+ * Advance the model by one access
+ *
+ * @param state The model
+ * @param block The block address of the access (address >> B)
+ * @param level Where the access was served: 1 for the L1, 2 for the L2, 3 for memory
+ * @param transfers Other blocks the access moved to or from memory (write-backs, prefetches)
+ * @param latency The stats holding the L1, L2 and memory access times
+ */
+void timing_access(timing_state *state, uint64_t block, int level, uint64_t transfers, const struct cache_stats_t *latency)
+{
+	uint64_t issue = state->now;
+	uint64_t t = issue;
+	uint64_t done;
+
+	timing_mshr *pending = timing_pending(state->mshr1, state->l1Mshrs, block, t);
+	if (pending) {
+		/* A hit on, or another miss to, a block that is still being filled */
+		state->merges++;
+		done = pending->done;
+	} else if (level == 1) {
+		done = t + latency->l1_access_time;
+	} else {
+		timing_mshr *mshr = timing_first_free(state->mshr1, state->l1Mshrs);
+		if (mshr->done > t) {
+			state->stallCycles += mshr->done - t;
+			t = mshr->done;
+		}
+		uint64_t arrival = t + latency->l1_access_time + latency->l2_access_time;
+		if (level == 2) {
+			done = arrival;
+		} else {
+			timing_mshr *mshr2 = timing_pending(state->mshr2, state->l2Mshrs, block, arrival);
+			if (mshr2) {
+				done = mshr2->done;
+			} else {
+				mshr2 = timing_first_free(state->mshr2, state->l2Mshrs);
+				if (mshr2->done > arrival) {
+					arrival = mshr2->done;
+				}
+				uint64_t start = timing_transfer(state, arrival);
+				done = start + latency->memory_access_time;
+				mshr2->block = block;
+				mshr2->done = done;
+
+				/* Transfers start in order, so the busy periods can be merged as they come */
+				if (start >= state->busyEnd) {
+					state->busyCycles += done - start;
+				} else if (done > state->busyEnd) {
+					state->busyCycles += done - state->busyEnd;
+				}
+				if (done > state->busyEnd) {
+					state->busyEnd = done;
+				}
+				state->memoryCycles += done - start;
+				state->memoryRequests++;
+			}
+		}
+		mshr->block = block;
+		mshr->done = done;
+	}
+	for (uint64_t i = 0; i < transfers; i++) {
+		timing_transfer(state, t);
+	}
+
+	uint64_t cycles = done - issue;
+	unsigned int bucket = 0;
+	while (bucket + 1 < CACHE_TIMING_BUCKETS && (cycles >> (bucket + 1))) {
+		bucket++;
+	}
+	state->histogram[bucket]++;
+	state->latencySum += cycles;
+	state->accesses++;
+	if (done > state->end) {
+		state->end = done;
+	}
+	state->now = t + 1;
+}
+
+/**
+ * Summarize the model after the last access
+ */
+void timing_estimate(const timing_state *state, struct cache_timing_stats_t *timing)
+{
+	memset(timing, 0, sizeof(struct cache_timing_stats_t));
+	timing->cycles = state->end > state->now ? state->end : state->now;
+	timing->stall_cycles = state->stallCycles;
+	timing->mshr_merges = state->merges;
+	timing->memory_requests = state->memoryRequests;
+	memcpy(timing->latency_histogram, state->histogram, sizeof(state->histogram));
+
+	timing->accesses_per_cycle = timing->cycles ? (double)state->accesses / (double)timing->cycles : 0;
+	timing->avg_latency = state->accesses ? (double)state->latencySum / (double)state->accesses : 0;
+	timing->mlp = state->busyCycles ? (double)state->memoryCycles / (double)state->busyCycles : 0;
+	timing->memory_busy = timing->cycles ? (double)state->busyCycles / (double)timing->cycles : 0;
+}
@@ -0,0 +1,48 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "cachesim.h"
+
+/* Most MSHRs per level */
+#define TIMING_MAX_MSHRS 256
+
+/* An outstanding miss of one block */
+typedef struct timing_mshr_t {
+	uint64_t block;
+	uint64_t done; /* Cycle the fill completes; the entry is free from then on */
+} timing_mshr;
+
+/**
+ * Cycle model driven by the outcome of every access of the functional
+ * simulation. The core issues one access per cycle in trace order and never
+ * waits for a result; it only stalls when every L1 MSHR is busy. L2 misses
+ * also hold an L2 MSHR and are served by a memory channel that starts one
+ * block transfer every memoryInterval cycles. Write-backs and L2 prefetches
+ * take transfer slots as well but nothing waits on them.
+ */
+typedef struct timing_state_t {
+	uint64_t l1Mshrs, l2Mshrs, memoryInterval;
+	timing_mshr *mshr1;
+	timing_mshr *mshr2;
+
+	uint64_t now; /* Issue cycle of the next access */
+	uint64_t end; /* Last completion so far */
+	uint64_t channelFree; /* First cycle the memory channel can start a transfer */
+	uint64_t busyEnd; /* End of the current period with memory requests in flight */
+	uint64_t busyCycles;
+	uint64_t memoryCycles; /* Sum of the time every memory request was in flight */
+
+	uint64_t accesses;
+	uint64_t latencySum;
+	uint64_t stallCycles;
+	uint64_t merges;
+	uint64_t memoryRequests;
+	uint64_t histogram[CACHE_TIMING_BUCKETS];
+} timing_state;
+
+int timing_init(timing_state *state, const struct cache_timing_config_t *config);
+void timing_free(timing_state *state);
+void timing_access(timing_state *state, uint64_t block, int level, uint64_t transfers, const struct cache_stats_t *latency);
+void timing_estimate(const timing_state *state, struct cache_timing_stats_t *timing);
+
+#endif
@@ -0,0 +1,652 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+#include "zstream.h"
+#include "tracegen.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TRACE_READ_CHUNK (1 << 20)
+
+/* Records trace_reduce keeps open for folding, at 32 bytes each */
+#define TRACE_REDUCE_WINDOW (1 << 16)
+
+/* Longest encoded record: a 64 bit address delta and two 64 bit repeat counts */
+#define TRACE_MAX_RECORD 33
+
+/**
+ * Read the rest of a non-seekable binary stream (e.g. a pipe) into memory
+ */
+static int trace_slurp(trace_t *trace, FILE *fin)
+{
+	size_t capacity = TRACE_READ_CHUNK;
+	size_t size = 0;
+	uint8_t *buffer = malloc(capacity);
+	if (!buffer) {
+		return -1;
+	}
+	for (;;) {
+		if (size == capacity) {
+			capacity *= 2;
+			uint8_t *grown = realloc(buffer, capacity);
+			if (!grown) {
+				free(buffer);
+				return -1;
+			}
+			buffer = grown;
+		}
+		size_t n = fread(buffer + size, 1, capacity - size, fin);
+		if (n == 0) {
+			break;
+		}
+		size += n;
+	}
+	trace->map = buffer;
+	trace->map_size = size;
+	trace->mapped = 0;
+	return 0;
+}
+
+/**
+ * Validate the header of a binary trace held in trace->map and point the
+ * decoder at its first record
+ */
+static int trace_attach(trace_t *trace)
+{
+	trace_header_t header;
+	size_t size = sizeof(header);
+	if (trace->map_size < size) {
+		return -1;
+	}
+	memcpy(&header, trace->map, size);
+	if (memcmp(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN)) {
+		return -1;
+	}
+	if (header.version == TRACE_VERSION_REDUCED && header.flags == TRACE_FLAG_REDUCED) {
+		size += sizeof(trace_reduction_t);
+		if (trace->map_size < size) {
+			return -1;
+		}
+		memcpy(&trace->reduction, (const uint8_t *)trace->map + sizeof(header), sizeof(trace_reduction_t));
+		trace->reduced = 1;
+	} else if (header.version != TRACE_VERSION || header.flags) {
+		return -1;
+	}
+	if (header.bytes > trace->map_size - size) {
+		return -1;
+	}
+
+	trace->pos = (const uint8_t *)trace->map + size;
+	trace->end = trace->pos + header.bytes;
+	trace->prev = 0;
+	return 0;
+}
+
+/**
+ * Open a text or binary trace for replay. Binary traces in regular files are
+ * mapped into memory so that trace_next never touches stdio. Either kind may
+ * be gzip, xz or zstd compressed (see zstream.h).
+ *
+ * @param path The trace to open, or NULL to read from stdin
+ * @return The opened trace, or NULL with an error printed to stderr
+ */
+trace_t *trace_open(const char *path)
+{
+	FILE *fin = zstream_open(path);
+	if (!fin) {
+		perror(path ? path : "stdin");
+		return NULL;
+	}
+
+	trace_t *trace = calloc(1, sizeof(trace_t));
+	if (!trace) {
+		perror("trace");
+		goto fail;
+	}
+
+	int first = getc(fin);
+	if (first == EOF || first != (unsigned char)TRACE_MAGIC[0]) {
+		if (first != EOF) {
+			ungetc(first, fin);
+		}
+		trace->fin = fin;
+		return trace;
+	}
+	ungetc(first, fin);
+
+	struct stat st;
+	if (fstat(fileno(fin), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fin), 0);
+		if (map == MAP_FAILED) {
+			perror("trace: mmap");
+			goto fail;
+		}
+		posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+		trace->map = map;
+		trace->map_size = st.st_size;
+		trace->mapped = 1;
+	} else if (trace_slurp(trace, fin)) {
+		perror("trace");
+		goto fail;
+	}
+	if (fin != stdin) {
+		fclose(fin);
+	}
+	fin = NULL;
+
+	if (trace_attach(trace)) {
+		fprintf(stderr, "trace: %s is not a valid binary trace\n", path ? path : "stdin");
+		goto fail;
+	}
+	return trace;
+
+fail:
+	if (fin && fin != stdin) {
+		fclose(fin);
+	}
+	trace_close(trace);
+	return NULL;
+}
+
+/**
+ * Replay a synthetic workload instead of a file
+ *
+ * @param spec The workload, as described at tracegen_parse
+ * @return The trace, or NULL with an error printed to stderr
+ */
+trace_t *trace_generate(const char *spec)
+{
+	tracegen_config_t config;
+	if (tracegen_parse(spec, &config)) {
+		fprintf(stderr, "trace: cannot parse the workload %s\n", spec);
+		return NULL;
+	}
+	trace_t *trace = calloc(1, sizeof(trace_t));
+	if (!trace) {
+		perror("trace");
+		return NULL;
+	}
+	trace->generator = tracegen_stream_create(&config);
+	if (!trace->generator) {
+		fprintf(stderr, "trace: invalid workload parameters or out of memory: %s\n", spec);
+		free(trace);
+		return NULL;
+	}
+	return trace;
+}
+
+/**
+ * Release a trace returned by trace_open or trace_generate
+ */
+void trace_close(trace_t *trace)
+{
+	if (!trace) {
+		return;
+	}
+	if (trace->fin && trace->fin != stdin) {
+		fclose(trace->fin);
+	}
+	tracegen_stream_destroy(trace->generator);
+	if (trace->map) {
+		if (trace->mapped) {
+			munmap(trace->map, trace->map_size);
+		} else {
+			free(trace->map);
+		}
+	}
+	free(trace);
+}
+
+/**
+ * Slow path of trace_next for text, generated and reduced traces. Parses one
+ * "rw address" line with the same fscanf format the driver has always used.
+ * Marker lines ("m id", id in hex) are not returned. The ones passed on the
+ * way to the record are counted in trace->markers, and the id of the first
+ * is latched in trace->marker as soon as its line is parsed.
+ */
+int trace_next_text(trace_t *trace, char *rw, uint64_t *address)
+{
+	if (trace->reduced) {
+		uint64_t reads, writes;
+		return trace_next_reduced(trace, rw, address, &reads, &writes);
+	}
+	if (trace->generator) {
+		int pid;
+		return tracegen_stream_next(trace->generator, &pid, rw, address);
+	}
+	trace->markers = 0;
+	while (!feof(trace->fin)) {
+		int ret = fscanf(trace->fin, "%c %" PRIx64 "\n", rw, address);
+		if (ret == 2) {
+			if (*rw == 'm') {
+				if (trace->markers++ == 0) {
+					trace->marker = *address;
+				}
+				continue;
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Fetch the next access of a multi-core trace. Multi-core traces are text
+ * only, one "core rw address" line per access with a decimal core id.
+ * Lines that do not parse are skipped. A generated trace issues the accesses
+ * of process i on core i.
+ *
+ * @return 1 if a record was read, 0 at the end of the trace or if the trace is binary
+ */
+int trace_next_core(trace_t *trace, unsigned int *core, char *rw, uint64_t *address)
+{
+	if (trace->generator) {
+		int pid;
+		if (!tracegen_stream_next(trace->generator, &pid, rw, address)) {
+			return 0;
+		}
+		*core = (unsigned int)pid;
+		return 1;
+	}
+	if (!trace->fin) {
+		return 0;
+	}
+	while (!feof(trace->fin)) {
+		int ret = fscanf(trace->fin, "%u %c %" PRIx64 "\n", core, rw, address);
+		if (ret == 3) {
+			return 1;
+		}
+		if (ret != EOF && fscanf(trace->fin, "%*[^\n]\n") == EOF) {
+			break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Decode the remainder of a trace into memory
+ *
+ * @param trace The trace to read
+ * @param buffer Filled with the decoded records; release with trace_buffer_free
+ * @return 0 on success, -1 if memory could not be allocated or the trace is corrupt
+ */
+int trace_load(trace_t *trace, trace_buffer_t *buffer)
+{
+	size_t capacity = TRACE_READ_CHUNK;
+	buffer->count = 0;
+	buffer->rw = malloc(capacity);
+	buffer->address = malloc(sizeof(uint64_t) * capacity);
+	if (!buffer->rw || !buffer->address) {
+		trace_buffer_free(buffer);
+		return -1;
+	}
+
+	char rw;
+	uint64_t address;
+	while (trace_next(trace, &rw, &address)) {
+		if (buffer->count == capacity) {
+			capacity *= 2;
+			char *grown_rw = realloc(buffer->rw, capacity);
+			if (grown_rw) {
+				buffer->rw = grown_rw;
+			}
+			uint64_t *grown_address = realloc(buffer->address, sizeof(uint64_t) * capacity);
+			if (grown_address) {
+				buffer->address = grown_address;
+			}
+			if (!grown_rw || !grown_address) {
+				trace_buffer_free(buffer);
+				return -1;
+			}
+		}
+		buffer->rw[buffer->count] = rw;
+		buffer->address[buffer->count] = address;
+		buffer->count++;
+	}
+	if (trace->corrupt) {
+		trace_buffer_free(buffer);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Decode up to n records into two arrays, for cache_access_batch
+ *
+ * @return The number of records read, less than n only at the end of the trace
+ */
+size_t trace_read(trace_t *trace, char *rw, uint64_t *address, size_t n)
+{
+	size_t count = 0;
+	while (count < n && trace_next(trace, rw + count, address + count)) {
+		count++;
+	}
+	return count;
+}
+
+/**
+ * Skip records of a trace, e.g. the ones a restored checkpoint already
+ * simulated. Binary traces still have to be decoded because every address is
+ * relative to the previous one.
+ *
+ * @return The number of records skipped, less than n at the end of the trace
+ */
+uint64_t trace_skip(trace_t *trace, uint64_t n)
+{
+	char rw;
+	uint64_t address;
+	uint64_t count = 0;
+	while (count < n && trace_next(trace, &rw, &address)) {
+		count++;
+	}
+	return count;
+}
+
+void trace_buffer_free(trace_buffer_t *buffer)
+{
+	free(buffer->rw);
+	free(buffer->address);
+	buffer->rw = NULL;
+	buffer->address = NULL;
+	buffer->count = 0;
+}
+
+/**
+ * Append a little endian base-128 varint
+ *
+ * @return The number of bytes written
+ */
+static size_t trace_put_varint(uint8_t *out, uint64_t value)
+{
+	size_t len = 0;
+	while (value >= 0x80) {
+		out[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[len++] = (uint8_t)value;
+	return len;
+}
+
+/**
+ * Encode one record (see trace.h)
+ *
+ * @param delta The address minus the address of the previous record, in
+ *        blocks for reduced traces
+ * @param reduced Whether this is a record of a reduced trace
+ * @param reads Repeats of a reduced record
+ * @return The number of bytes written, at most TRACE_MAX_RECORD
+ */
+static size_t trace_encode(uint8_t *out, char rw, uint64_t delta, int reduced, uint64_t reads, uint64_t writes)
+{
+	uint64_t value = trace_zigzag((int64_t)delta);
+	int repeats = reads || writes;
+	size_t len = 0;
+	uint8_t byte;
+	if (reduced) {
+		byte = (uint8_t)(((value & 0x1f) << 2) | (repeats << 1) | (rw != 'r'));
+		value >>= 5;
+	} else {
+		byte = (uint8_t)(((value & 0x3f) << 1) | (rw != 'r'));
+		value >>= 6;
+	}
+	while (value) {
+		out[len++] = byte | 0x80;
+		byte = value & 0x7f;
+		value >>= 7;
+	}
+	out[len++] = byte;
+	if (repeats && reads < 16 && writes < 8) {
+		out[len++] = (uint8_t)(reads | writes << 4);
+	} else if (repeats) {
+		out[len++] = 0x80;
+		len += trace_put_varint(out + len, reads);
+		len += trace_put_varint(out + len, writes);
+	}
+	return len;
+}
+
+/**
+ * Convert the rest of a trace, usually a text or generated one, into the
+ * binary trace format
+ *
+ * @param trace The trace to convert
+ * @param fout A seekable output file; the header is rewritten once the record count is known
+ * @return The number of records written
+ */
+uint64_t trace_convert(trace_t *trace, FILE *fout)
+{
+	trace_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+	header.version = TRACE_VERSION;
+	fwrite(&header, sizeof(header), 1, fout);
+
+	char rw;
+	uint64_t address;
+	uint64_t prev = 0;
+	uint8_t record[TRACE_MAX_RECORD];
+	while (trace_next(trace, &rw, &address)) {
+		size_t len = trace_encode(record, rw, address - prev, 0, 0, 0);
+		fwrite(record, 1, len, fout);
+
+		prev = address;
+		header.records++;
+		header.bytes += len;
+	}
+
+	fseek(fout, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fout);
+	return header.records;
+}
+
+/**
+ * Write the rest of a trace as a text trace
+ *
+ * @param cores Write a multi-core trace of "core rw address" lines (see
+ *        trace_next_core) instead of "rw address" lines
+ * @return The number of records written
+ */
+uint64_t trace_write_text(trace_t *trace, FILE *fout, int cores)
+{
+	unsigned int core;
+	char rw;
+	uint64_t address;
+	uint64_t records = 0;
+	if (cores) {
+		while (trace_next_core(trace, &core, &rw, &address)) {
+			fprintf(fout, "%u %c %" PRIx64 "\n", core, rw, address);
+			records++;
+		}
+	} else {
+		while (trace_next(trace, &rw, &address)) {
+			fprintf(fout, "%c %" PRIx64 "\n", rw, address);
+			records++;
+		}
+	}
+	return records;
+}
+
+/* Read a varint of a reduced record, NULL if the trace ends inside it or it overflows */
+static const uint8_t *trace_get_varint(const uint8_t *pos, const uint8_t *end, uint64_t *value)
+{
+	unsigned int shift = 0;
+	*value = 0;
+	while (pos < end && shift <= 63) {
+		uint8_t byte = *pos++;
+		*value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return pos;
+		}
+		shift += 7;
+	}
+	return NULL;
+}
+
+/**
+ * Fetch the next record of a trace together with its repeats. Every trace
+ * can be read this way; only reduced traces have repeats.
+ *
+ * @param reads Set to the number of reads of the record's block folded into it
+ * @param writes The same for writes
+ * @return 1 if a record was read, 0 at the end of the trace
+ */
+int trace_next_reduced(trace_t *trace, char *rw, uint64_t *address, uint64_t *reads, uint64_t *writes)
+{
+	*reads = 0;
+	*writes = 0;
+	if (!trace->reduced) {
+		return trace_next(trace, rw, address);
+	}
+	if (trace->pos >= trace->end) {
+		return 0;
+	}
+
+	const uint8_t *pos = trace->pos;
+	uint8_t byte = *pos++;
+	uint64_t delta = (byte >> 2) & 0x1f;
+	unsigned int shift = 5;
+	int repeats = byte & 2;
+	*rw = (byte & 1) ? 'w' : 'r';
+	while (byte & 0x80) {
+		if (pos == trace->end || shift > 63) {
+			return trace_fail(trace);
+		}
+		byte = *pos++;
+		delta |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	}
+	if (repeats) {
+		if (pos < trace->end && !(*pos & 0x80)) {
+			*reads = *pos & 0xf;
+			*writes = *pos++ >> 4;
+		} else {
+			pos = pos < trace->end ? trace_get_varint(pos + 1, trace->end, reads) : NULL;
+			pos = pos ? trace_get_varint(pos, trace->end, writes) : NULL;
+			if (!pos) {
+				return trace_fail(trace);
+			}
+		}
+	}
+	trace->pos = pos;
+
+	trace->prev += (uint64_t)trace_unzigzag(delta) << trace->reduction.block_bits;
+	*address = trace->prev;
+	return 1;
+}
+
+/* A record of trace_reduce that may still get repeats */
+typedef struct trace_pending_t {
+	uint64_t address;
+	uint64_t reads;
+	uint64_t writes;
+	char rw;
+} trace_pending_t;
+
+/* Write a record of trace_reduce, prev is the previous block */
+static void trace_emit(const trace_pending_t *record, FILE *fout, uint64_t *prev, uint32_t block_bits, trace_header_t *header)
+{
+	uint8_t out[TRACE_MAX_RECORD];
+	uint64_t block = record->address >> block_bits;
+	size_t len = trace_encode(out, record->rw, block - *prev, 1, record->reads, record->writes);
+	fwrite(out, 1, len, fout);
+	*prev = block;
+	header->records++;
+	header->bytes += len;
+}
+
+/**
+ * Write the rest of a trace as a reduced trace. Every access that hits in a
+ * direct-mapped L1 of 2^l1_bits bytes with 2^block_bits byte blocks is folded
+ * into the record that last brought its block into that L1, as a repeat.
+ * Such an access hits in every direct-mapped L1 with at least as many sets,
+ * so replaying the repeats as hits (see cache_access_weighted_ctx) gives the
+ * statistics of the original trace. With l1_bits == block_bits only runs of
+ * accesses to one block are folded, which holds for any L1 with blocks of at
+ * least 2^block_bits bytes.
+ *
+ * Records are written once TRACE_REDUCE_WINDOW newer ones exist; a block
+ * whose record was written gets a new record on its next access. Only the
+ * block of every address is kept, which is all the replay looks at.
+ *
+ * @param reduction block_bits and l1_bits; accesses is set to the number of
+ *        accesses read
+ * @param records Set to the number of records written
+ * @return 0 on success, -1 if the parameters are invalid or memory could not
+ *         be allocated
+ */
+int trace_reduce(trace_t *trace, FILE *fout, trace_reduction_t *reduction, uint64_t *records)
+{
+	if (trace->reduced || reduction->block_bits > 63 || reduction->l1_bits < reduction->block_bits ||
+			reduction->l1_bits - reduction->block_bits > TRACE_REDUCE_MAX_SET_BITS) {
+		return -1;
+	}
+	uint64_t sets = 1ull << (reduction->l1_bits - reduction->block_bits);
+	uint64_t *resident = malloc(sizeof(uint64_t) * sets); /* Sequence number of the record of each set */
+	trace_pending_t *window = malloc(sizeof(trace_pending_t) * TRACE_REDUCE_WINDOW);
+	if (!resident || !window) {
+		free(resident);
+		free(window);
+		return -1;
+	}
+	/* Sequence numbers start at 1, 0 marks a set without an open record */
+	memset(resident, 0, sizeof(uint64_t) * sets);
+	uint64_t head = 1;
+	uint64_t tail = 1;
+
+	trace_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, TRACE_MAGIC_LEN);
+	header.version = TRACE_VERSION_REDUCED;
+	header.flags = TRACE_FLAG_REDUCED;
+	reduction->accesses = 0;
+	fwrite(&header, sizeof(header), 1, fout);
+	fwrite(reduction, sizeof(trace_reduction_t), 1, fout);
+
+	char rw;
+	uint64_t address;
+	uint64_t prev = 0;
+	while (trace_next(trace, &rw, &address)) {
+		reduction->accesses++;
+		uint64_t block = address >> reduction->block_bits;
+		uint64_t set = block & (sets - 1);
+		if (resident[set]) {
+			trace_pending_t *record = window + resident[set] % TRACE_REDUCE_WINDOW;
+			if (record->address >> reduction->block_bits == block) {
+				if (rw == 'r') {
+					record->reads++;
+				} else {
+					record->writes++;
+				}
+				continue;
+			}
+		}
+
+		if (tail - head == TRACE_REDUCE_WINDOW) {
+			const trace_pending_t *oldest = window + head % TRACE_REDUCE_WINDOW;
+			uint64_t oldestSet = (oldest->address >> reduction->block_bits) & (sets - 1);
+			if (resident[oldestSet] == head) {
+				resident[oldestSet] = 0;
+			}
+			trace_emit(oldest, fout, &prev, reduction->block_bits, &header);
+			head++;
+		}
+		trace_pending_t *record = window + tail % TRACE_REDUCE_WINDOW;
+		record->address = address;
+		record->reads = 0;
+		record->writes = 0;
+		record->rw = rw;
+		resident[set] = tail++;
+	}
+	for (; head < tail; head++) {
+		trace_emit(window + head % TRACE_REDUCE_WINDOW, fout, &prev, reduction->block_bits, &header);
+	}
+	free(resident);
+	free(window);
+
+	fseek(fout, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fout);
+	fwrite(reduction, sizeof(trace_reduction_t), 1, fout);
+	*records = header.records;
+	return 0;
+}
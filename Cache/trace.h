@@ -0,0 +1,167 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Binary trace format
+ *
+ * A binary trace starts with a trace_header_t followed by one variable length
+ * record per access. Bit 0 of the first byte of a record is the rw bit (1 for
+ * a write). The remaining bits hold zigzag(address - previous_address) as a
+ * little endian base-128 varint: 6 payload bits in the first byte, 7 in every
+ * following byte, with bit 7 set on every byte except the last. Sequential and
+ * strided streams therefore encode in one or two bytes per access.
+ * The first byte of the magic is not printable, which lets trace_open tell a
+ * binary trace apart from a text trace without any extra flags.
+ *
+ * Reduced traces (see trace_reduce) are version 2 with TRACE_FLAG_REDUCED set
+ * and a trace_reduction_t right after the header. Their deltas count blocks
+ * of 2^block_bits bytes, and bit 1 of the first byte of a record says whether
+ * repeats follow the record, which leaves 5 payload bits in the first byte.
+ * The repeats are the number of reads and of writes of the record's block
+ * that were folded into the record: one byte holding reads in bits 0-3 and
+ * writes in bits 4-6, or 0x80 followed by the two counts as plain varints.
+ * Plain traces are still written as version 1.
+ */
+#define TRACE_MAGIC "\x89" "CST\r\n\x1a\n"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_VERSION 1
+#define TRACE_VERSION_REDUCED 2
+
+#define TRACE_FLAG_REDUCED 1
+
+/* Most L1 sets trace_reduce models, 2^(l1_bits - block_bits) */
+#define TRACE_REDUCE_MAX_SET_BITS 24
+
+/* Records the driver decodes per trace_read call */
+#define TRACE_BLOCK 4096
+
+typedef struct trace_header_t {
+	char magic[TRACE_MAGIC_LEN];
+	uint32_t version;
+	uint32_t flags;
+	uint64_t records; /* Number of records that follow the header */
+	uint64_t bytes; /* Number of encoded bytes that follow the header */
+} trace_header_t;
+
+/**
+ * How a reduced trace was reduced. Accesses to the same 2^block_bits byte
+ * block that hit in a direct-mapped 2^l1_bits byte L1 were folded into the
+ * record that brought the block in; l1_bits == block_bits only folds runs of
+ * consecutive accesses to one block.
+ */
+typedef struct trace_reduction_t {
+	uint32_t block_bits;
+	uint32_t l1_bits;
+	uint64_t accesses; /* Accesses of the original trace */
+} trace_reduction_t;
+
+/**
+ * A trace that is being replayed. Text traces are read through stdio exactly
+ * like the driver always did; binary traces are mapped into memory and decoded
+ * in place by trace_next; generated traces come straight from a synthetic
+ * workload (see tracegen.h) without ever being written out.
+ */
+typedef struct trace_t {
+	FILE *fin; /* Text input, NULL for binary traces */
+	const uint8_t *pos; /* Next encoded record, NULL for text traces */
+	const uint8_t *end;
+	uint64_t prev; /* Address of the previous record */
+	uint64_t markers; /* Marker lines ("m id") right before the record just read, or before the end; text traces only */
+	uint64_t marker; /* Id of the first of those markers */
+	struct tracegen_stream_t *generator; /* Source of a generated trace, NULL otherwise */
+	int reduced; /* Whether records carry repeats, see trace_next_reduced */
+	trace_reduction_t reduction; /* Only valid for reduced traces */
+	int corrupt; /* Set when a record runs past the end or overflows 64 bits */
+
+	void *map; /* Start of the mapping (or buffer) holding the trace */
+	size_t map_size;
+	int mapped; /* Whether map came from mmap or from malloc */
+} trace_t;
+
+/**
+ * A fully decoded trace, kept as two parallel arrays so that several
+ * simulations can replay it concurrently without decoding it again
+ */
+typedef struct trace_buffer_t {
+	char *rw;
+	uint64_t *address;
+	size_t count;
+} trace_buffer_t;
+
+trace_t *trace_open(const char *path);
+trace_t *trace_generate(const char *spec);
+void trace_close(trace_t *trace);
+int trace_load(trace_t *trace, trace_buffer_t *buffer);
+size_t trace_read(trace_t *trace, char *rw, uint64_t *address, size_t n);
+uint64_t trace_skip(trace_t *trace, uint64_t n);
+void trace_buffer_free(trace_buffer_t *buffer);
+int trace_next_text(trace_t *trace, char *rw, uint64_t *address);
+int trace_next_core(trace_t *trace, unsigned int *core, char *rw, uint64_t *address);
+uint64_t trace_convert(trace_t *trace, FILE *fout);
+uint64_t trace_write_text(trace_t *trace, FILE *fout, int cores);
+int trace_next_reduced(trace_t *trace, char *rw, uint64_t *address, uint64_t *reads, uint64_t *writes);
+int trace_reduce(trace_t *trace, FILE *fout, trace_reduction_t *reduction, uint64_t *records);
+
+static inline uint64_t trace_zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t trace_unzigzag(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* Give up on a binary trace whose last record is cut off or too long */
+static inline int trace_fail(trace_t *trace)
+{
+	trace->pos = trace->end;
+	trace->corrupt = 1;
+	return 0;
+}
+
+/**
+ * Fetch the next access from a trace
+ *
+ * @param trace The trace returned by trace_open
+ * @param rw Set to READ or WRITE
+ * @param address Set to the address of the access
+ * @return 1 if a record was read, 0 at the end of the trace or on a corrupt
+ *         record (trace->corrupt is set then)
+ *
+ * The repeats of reduced traces are dropped, see trace_next_reduced.
+ */
+static inline int trace_next(trace_t *trace, char *rw, uint64_t *address)
+{
+	if (!trace->pos || trace->reduced) {
+		return trace_next_text(trace, rw, address);
+	}
+	if (trace->pos >= trace->end) {
+		return 0;
+	}
+
+	const uint8_t *pos = trace->pos;
+	uint8_t byte = *pos++;
+	uint64_t delta = (byte >> 1) & 0x3f;
+	unsigned int shift = 6;
+	*rw = (byte & 1) ? 'w' : 'r';
+	while (byte & 0x80) {
+		if (pos == trace->end || shift > 63) {
+			return trace_fail(trace);
+		}
+		byte = *pos++;
+		delta |= (uint64_t)(byte & 0x7f) << shift;
+		shift += 7;
+	}
+	trace->pos = pos;
+
+	trace->prev += (uint64_t)trace_unzigzag(delta);
+	*address = trace->prev;
+	return 1;
+}
+
+#endif
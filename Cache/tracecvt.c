@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "trace.h"
+
+void print_help_and_exit(void) {
+    printf("tracecvt [OPTIONS] -o out.bin < traces/file.trace\n");
+    printf("  -i file\tTrace to convert, may be compressed (default stdin)\n");
+    printf("  -g spec\tConvert a synthetic workload instead, e.g. -g matrix,dimension=256\n");
+    printf("\t\t(see tracegen_parse)\n");
+    printf("  -o file\tTrace to write, binary unless -t or -n is given\n");
+    printf("  -t\t\tWrite a text trace\n");
+    printf("  -n\t\tRead and write a multi-core text trace (\"core rw address\" lines);\n");
+    printf("\t\ta generated workload runs process i on core i\n");
+    printf("  -r B[,C1]\tWrite a reduced trace: fold runs of accesses to one 2^B byte block\n");
+    printf("\t\tor, with C1, every hit in a direct-mapped 2^C1 byte L1 into one record\n");
+    printf("  -h\t\tThis helpful output\n");
+    exit(0);
+}
+
+int main(int argc, char* argv[]) {
+    int opt;
+    const char* in = NULL;
+    const char* workload = NULL;
+    const char* out = NULL;
+    int text = 0;
+    int cores = 0;
+    trace_reduction_t reduction;
+    int reduce = 0;
+
+    while(-1 != (opt = getopt(argc, argv, "i:g:o:tnr:h"))) {
+        switch(opt) {
+            case 'i':
+                in = optarg;
+                break;
+            case 'g':
+                workload = optarg;
+                break;
+            case 'o':
+                out = optarg;
+                break;
+            case 't':
+                text = 1;
+                break;
+            case 'n':
+                cores = 1;
+                break;
+            case 'r': {
+                int fields = sscanf(optarg, "%" SCNu32 ",%" SCNu32, &reduction.block_bits, &reduction.l1_bits);
+                if (fields < 1) {
+                    print_help_and_exit();
+                }
+                if (fields == 1) {
+                    reduction.l1_bits = reduction.block_bits;
+                }
+                reduce = 1;
+                break;
+            }
+            case 'h':
+            default:
+                print_help_and_exit();
+                break;
+        }
+    }
+    if (!out || (reduce && (text || cores))) {
+        print_help_and_exit();
+    }
+
+    trace_t* trace = workload ? trace_generate(workload) : trace_open(in);
+    if (!trace) {
+        return 1;
+    }
+    if (trace->reduced) {
+        fprintf(stderr, "%s is a reduced trace, convert the original instead\n", in ? in : "stdin");
+        return 1;
+    }
+
+    FILE* fout = fopen(out, text || cores ? "w" : "wb");
+    if (!fout) {
+        perror(out);
+        return 1;
+    }
+
+    uint64_t records;
+    if (reduce && trace_reduce(trace, fout, &reduction, &records)) {
+        fprintf(stderr, "Cannot reduce for 2^%" PRIu32 " byte blocks and a 2^%" PRIu32 " byte L1\n",
+                reduction.block_bits, reduction.l1_bits);
+        return 1;
+    }
+    if (!reduce) {
+        records = text || cores ? trace_write_text(trace, fout, cores) : trace_convert(trace, fout);
+    }
+    if (trace->corrupt) {
+        fprintf(stderr, "The input trace is truncated or corrupt\n");
+        return 1;
+    }
+    if (reduce) {
+        printf("Reduced %" PRIu64 " accesses to %" PRIu64 " records\n", reduction.accesses, records);
+        /* The conditions of cache_check_reduction, which cachesim enforces on replay */
+        printf("Replays exactly with blocks of at least 2^%" PRIu32 " bytes, a write-allocate L1,\n", reduction.block_bits);
+        printf("and without -p, -A, -T, -W, -f or -F");
+        if (reduction.l1_bits > reduction.block_bits) {
+            printf(", on a direct-mapped L1 of\nat least 2^%" PRIu32 " bytes with 2^%" PRIu32 " byte blocks and an exclusive L2",
+                   reduction.l1_bits, reduction.block_bits);
+        }
+        printf("\n");
+    } else {
+        printf("Converted %" PRIu64 " records\n", records);
+    }
+
+    fclose(fout);
+    trace_close(trace);
+    return 0;
+}
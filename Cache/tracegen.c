@@ -0,0 +1,413 @@
+#include "tracegen.h"
+#include <math.h>
+#include <string.h>
+
+static const char *const PATTERN_NAMES[] = { "sequential", "strided", "random", "ptrchase", "zipf", "matrix" };
+
+/* xorshift64*, seeded through splitmix64 so that any seed works */
+static uint64_t tracegen_random(tracegen_t *gen)
+{
+	gen->rng ^= gen->rng >> 12;
+	gen->rng ^= gen->rng << 25;
+	gen->rng ^= gen->rng >> 27;
+	return gen->rng * 0x2545f4914f6cdd1dull;
+}
+
+static uint64_t tracegen_seed(uint64_t seed)
+{
+	uint64_t z = seed + 0x9e3779b97f4a7c15ull;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+
+/* Uniform in [0, n) for n < 2^32 */
+static uint64_t tracegen_below(tracegen_t *gen, uint64_t n)
+{
+	return ((tracegen_random(gen) >> 32) * n) >> 32;
+}
+
+static int tracegen_power_of_two(uint64_t x)
+{
+	return x && !(x & (x - 1));
+}
+
+/**
+ * Link the nodes into a single random cycle (Sattolo's algorithm), so that
+ * the chase visits every node before it repeats
+ */
+static void tracegen_cycle(tracegen_t *gen)
+{
+	uint32_t *order = gen->next;
+	for (uint64_t i = 0; i < gen->items; i++) {
+		order[i] = (uint32_t)i;
+	}
+	for (uint64_t i = gen->items - 1; i > 0; i--) {
+		uint64_t j = tracegen_below(gen, i);
+		uint32_t swap = order[i];
+		order[i] = order[j];
+		order[j] = swap;
+	}
+	/* order is now a cyclic permutation: node i is followed by order[i] */
+}
+
+/**
+ * Build a generator
+ *
+ * @param config The pattern and its parameters
+ * @return The generator, or NULL if the parameters are invalid or memory
+ *         could not be allocated
+ */
+tracegen_t *tracegen_create(const tracegen_config_t *config)
+{
+	if (config->pattern > TRACEGEN_MATRIX) {
+		return NULL;
+	}
+	if (config->pattern == TRACEGEN_MATRIX) {
+		if (!config->tile || config->dimension % config->tile) {
+			return NULL;
+		}
+	} else if (!tracegen_power_of_two(config->footprint) || !tracegen_power_of_two(config->stride) ||
+			config->stride > config->footprint || config->footprint < TRACEGEN_WORD) {
+		return NULL;
+	}
+	tracegen_t *gen = calloc(1, sizeof(tracegen_t));
+	if (!gen) {
+		return NULL;
+	}
+	gen->config = *config;
+	gen->rng = tracegen_seed(config->seed);
+	gen->items = config->footprint / config->stride;
+
+	if (config->pattern == TRACEGEN_POINTER_CHASE || config->pattern == TRACEGEN_ZIPF) {
+		if (gen->items > TRACEGEN_MAX_ITEMS) {
+			tracegen_destroy(gen);
+			return NULL;
+		}
+	}
+	if (config->pattern == TRACEGEN_POINTER_CHASE) {
+		gen->next = malloc(sizeof(uint32_t) * gen->items);
+		if (!gen->next) {
+			tracegen_destroy(gen);
+			return NULL;
+		}
+		tracegen_cycle(gen);
+	} else if (config->pattern == TRACEGEN_ZIPF) {
+		gen->cdf = malloc(sizeof(double) * gen->items);
+		if (!gen->cdf) {
+			tracegen_destroy(gen);
+			return NULL;
+		}
+		double sum = 0;
+		for (uint64_t rank = 0; rank < gen->items; rank++) {
+			sum += pow((double)(rank + 1), -config->zipf_exponent);
+			gen->cdf[rank] = sum;
+		}
+		for (uint64_t rank = 0; rank < gen->items; rank++) {
+			gen->cdf[rank] /= sum;
+		}
+	}
+	return gen;
+}
+
+void tracegen_destroy(tracegen_t *gen)
+{
+	if (gen) {
+		free(gen->next);
+		free(gen->cdf);
+		free(gen);
+	}
+}
+
+/* The rank of a uniform draw in the Zipf CDF */
+static uint64_t tracegen_zipf(tracegen_t *gen)
+{
+	double u = (double)(tracegen_random(gen) >> 11) * (1.0 / 9007199254740992.0);
+	uint64_t lo = 0;
+	uint64_t hi = gen->items - 1;
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		if (gen->cdf[mid] < u) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/**
+ * The next word of C = A * B, computed tile by tile. Every step of the inner
+ * loop reads A[i][k] and B[k][j]; C[i][j] is written once k has run through
+ * the tile. The three matrices are stored row major one after another.
+ *
+ * @return The offset of the word from the start of A
+ */
+static uint64_t tracegen_matrix(tracegen_t *gen, char *rw)
+{
+	uint64_t n = gen->config.dimension;
+	uint64_t tile = gen->config.tile;
+	uint64_t *loop = gen->loop;
+	uint64_t i = loop[0] + loop[3];
+	uint64_t j = loop[1] + loop[4];
+	uint64_t k = loop[2] + loop[5];
+	uint64_t word;
+
+	*rw = 'r';
+	if (gen->step == 0) {
+		gen->step = 1;
+		return (i * n + k) * TRACEGEN_WORD;
+	}
+	if (gen->step == 1) {
+		word = n * n + k * n + j;
+		if (++loop[5] == tile) {
+			loop[5] = 0;
+			gen->step = 2;
+		} else {
+			gen->step = 0;
+		}
+		return word * TRACEGEN_WORD;
+	}
+
+	*rw = 'w';
+	word = 2 * n * n + i * n + j;
+	gen->step = 0;
+	/* Next j, i, then the next tile: kk fastest so that the C tile stays hot */
+	if (++loop[4] == tile) {
+		loop[4] = 0;
+		if (++loop[3] == tile) {
+			loop[3] = 0;
+			for (int level = 2; level >= 0; level--) {
+				loop[level] += tile;
+				if (loop[level] < n) {
+					break;
+				}
+				loop[level] = 0;
+			}
+		}
+	}
+	return word * TRACEGEN_WORD;
+}
+
+/**
+ * Generate the next access
+ *
+ * @param rw Set to 'r' or 'w'
+ * @param address Set to the address of the access
+ */
+void tracegen_next(tracegen_t *gen, char *rw, uint64_t *address)
+{
+	const tracegen_config_t *config = &gen->config;
+	uint64_t mask = config->footprint - 1;
+	uint64_t offset;
+	switch (config->pattern) {
+	case TRACEGEN_SEQUENTIAL:
+		offset = gen->position;
+		gen->position = (gen->position + TRACEGEN_WORD) & mask;
+		break;
+	case TRACEGEN_STRIDED:
+		offset = gen->position;
+		gen->position = (gen->position + config->stride) & mask;
+		break;
+	case TRACEGEN_RANDOM:
+		offset = tracegen_random(gen) & mask & ~(uint64_t)(TRACEGEN_WORD - 1);
+		break;
+	case TRACEGEN_POINTER_CHASE:
+		offset = gen->position * config->stride;
+		gen->position = gen->next[gen->position];
+		break;
+	case TRACEGEN_ZIPF:
+		/* Scatter the ranks so that the popular items are not adjacent */
+		offset = ((tracegen_zipf(gen) * 0x9e3779b97f4a7c15ull) & (gen->items - 1)) * config->stride;
+		break;
+	default:
+		/* The kernel decides what is read and written */
+		*address = config->base + tracegen_matrix(gen, rw);
+		return;
+	}
+	*address = config->base + offset;
+
+	double u = (double)(tracegen_random(gen) >> 11) * (1.0 / 9007199254740992.0);
+	*rw = u < config->write_fraction ? 'w' : 'r';
+}
+
+/**
+ * Generate n accesses into two parallel arrays, the layout of trace_read
+ */
+void tracegen_fill(tracegen_t *gen, char *rw, uint64_t *address, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		tracegen_next(gen, rw + i, address + i);
+	}
+}
+
+/**
+ * Bytes from config->base that the accesses of a configuration fall in, for
+ * checking that a workload fits an address space
+ */
+uint64_t tracegen_span(const tracegen_config_t *config)
+{
+	if (config->pattern == TRACEGEN_MATRIX) {
+		/* A, B and C one after the other */
+		return 3 * config->dimension * config->dimension * TRACEGEN_WORD;
+	}
+	return config->footprint;
+}
+
+static int tracegen_is(const char *key, size_t len, const char *name)
+{
+	return strlen(name) == len && !strncmp(key, name, len);
+}
+
+/**
+ * Parse a workload description such as "zipf,footprint=0x1000000,zipf=1.2".
+ * The pattern name (sequential, strided, random, ptrchase, zipf or matrix)
+ * comes first, followed by any of base, footprint, stride, writes (the write
+ * fraction), zipf (the exponent), seed, dimension, tile, processes, quantum
+ * and count. Numbers may be decimal or 0x hex. Unlisted parameters default to
+ * a 1MB footprint at address 0, 64 byte strides, 30% writes, a Zipf exponent
+ * of 0.99, 128x128 matrices in 16x16 tiles and 2^20 accesses of one
+ * process. Several processes take turns every 10000 accesses.
+ *
+ * @return 0 on success, -1 if the description is malformed
+ */
+int tracegen_parse(const char *spec, tracegen_config_t *config)
+{
+	memset(config, 0, sizeof(tracegen_config_t));
+	config->footprint = 1 << 20;
+	config->stride = 64;
+	config->write_fraction = 0.3;
+	config->zipf_exponent = 0.99;
+	config->seed = 1;
+	config->dimension = 128;
+	config->tile = 16;
+	config->processes = 1;
+	config->quantum = 10000;
+	config->count = 1 << 20;
+
+	size_t len = strcspn(spec, ",");
+	unsigned int pattern;
+	for (pattern = 0; pattern <= TRACEGEN_MATRIX; pattern++) {
+		if (tracegen_is(spec, len, PATTERN_NAMES[pattern])) {
+			break;
+		}
+	}
+	if (pattern > TRACEGEN_MATRIX) {
+		return -1;
+	}
+	config->pattern = (tracegen_pattern_t)pattern;
+
+	for (spec += len; *spec == ','; spec += len) {
+		spec++;
+		len = strcspn(spec, ",");
+		const char *value = memchr(spec, '=', len);
+		if (!value) {
+			return -1;
+		}
+		size_t key = value - spec;
+		char *end;
+		value++;
+		if (tracegen_is(spec, key, "writes")) {
+			config->write_fraction = strtod(value, &end);
+		} else if (tracegen_is(spec, key, "zipf")) {
+			config->zipf_exponent = strtod(value, &end);
+		} else {
+			uint64_t number = strtoull(value, &end, 0);
+			if (tracegen_is(spec, key, "base")) {
+				config->base = number;
+			} else if (tracegen_is(spec, key, "footprint")) {
+				config->footprint = number;
+			} else if (tracegen_is(spec, key, "stride")) {
+				config->stride = number;
+			} else if (tracegen_is(spec, key, "seed")) {
+				config->seed = number;
+			} else if (tracegen_is(spec, key, "dimension")) {
+				config->dimension = number;
+			} else if (tracegen_is(spec, key, "tile")) {
+				config->tile = number;
+			} else if (tracegen_is(spec, key, "processes")) {
+				config->processes = (unsigned int)number;
+			} else if (tracegen_is(spec, key, "quantum")) {
+				config->quantum = number;
+			} else if (tracegen_is(spec, key, "count")) {
+				config->count = number;
+			} else {
+				return -1;
+			}
+		}
+		if (end == value || end != spec + len) {
+			return -1;
+		}
+	}
+	return *spec ? -1 : 0;
+}
+
+/**
+ * Build a stream of config->count accesses (endless if 0) from
+ * config->processes generators
+ *
+ * @return The stream, or NULL if a generator cannot be built
+ */
+tracegen_stream_t *tracegen_stream_create(const tracegen_config_t *config)
+{
+	tracegen_stream_t *stream = calloc(1, sizeof(tracegen_stream_t));
+	if (!stream) {
+		return NULL;
+	}
+	stream->processes = config->processes ? config->processes : 1;
+	stream->quantum = config->quantum ? config->quantum : 1;
+	stream->left = stream->quantum;
+	stream->remaining = config->count;
+	stream->endless = !config->count;
+	stream->gens = calloc(stream->processes, sizeof(tracegen_t *));
+	if (!stream->gens) {
+		free(stream);
+		return NULL;
+	}
+	for (unsigned int pid = 0; pid < stream->processes; pid++) {
+		tracegen_config_t process = *config;
+		process.seed = config->seed + pid;
+		stream->gens[pid] = tracegen_create(&process);
+		if (!stream->gens[pid]) {
+			tracegen_stream_destroy(stream);
+			return NULL;
+		}
+	}
+	return stream;
+}
+
+/**
+ * Generate the next access of a stream
+ *
+ * @param pid Set to the process issuing the access
+ * @return 1 if an access was generated, 0 at the end of the stream
+ */
+int tracegen_stream_next(tracegen_stream_t *stream, int *pid, char *rw, uint64_t *address)
+{
+	if (!stream->endless) {
+		if (!stream->remaining) {
+			return 0;
+		}
+		stream->remaining--;
+	}
+	if (!stream->left) {
+		stream->current = (stream->current + 1) % stream->processes;
+		stream->left = stream->quantum;
+	}
+	stream->left--;
+	*pid = (int)stream->current;
+	tracegen_next(stream->gens[stream->current], rw, address);
+	return 1;
+}
+
+void tracegen_stream_destroy(tracegen_stream_t *stream)
+{
+	if (stream) {
+		for (unsigned int pid = 0; pid < stream->processes; pid++) {
+			tracegen_destroy(stream->gens[pid]);
+		}
+		free(stream->gens);
+		free(stream);
+	}
+}
@@ -0,0 +1,80 @@
+#ifndef TRACEGEN_H
+#define TRACEGEN_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+/*
+ * Synthetic access patterns
+ */
+typedef enum tracegen_pattern_t {
+	TRACEGEN_SEQUENTIAL, /* Consecutive words, wrapping around the footprint */
+	TRACEGEN_STRIDED, /* Every stride bytes, wrapping around the footprint */
+	TRACEGEN_RANDOM, /* Uniformly random words */
+	TRACEGEN_POINTER_CHASE, /* A random cycle through all stride byte nodes */
+	TRACEGEN_ZIPF, /* stride byte items with Zipf distributed popularity */
+	TRACEGEN_MATRIX /* A tiled multiplication of dimension x dimension word matrices */
+} tracegen_pattern_t;
+
+/**
+ * Parameters of a generator. Every generator is deterministic for a given
+ * configuration, so generated traces are reproducible.
+ */
+typedef struct tracegen_config_t {
+	tracegen_pattern_t pattern;
+	uint64_t base; /* First address of the footprint */
+	uint64_t footprint; /* Bytes the pattern covers, a power of two */
+	uint64_t stride; /* Step of TRACEGEN_STRIDED, node or item size of the others, a power of two */
+	double write_fraction; /* Probability of an access being a write */
+	double zipf_exponent; /* Skew of TRACEGEN_ZIPF, usually around 1 */
+	uint64_t seed;
+	uint64_t dimension; /* Rows of the TRACEGEN_MATRIX matrices, a multiple of tile */
+	uint64_t tile; /* Rows of a TRACEGEN_MATRIX tile */
+	unsigned int processes; /* Processes of a tracegen_stream_t, 0 means 1 */
+	uint64_t quantum; /* Accesses a process issues before the next one is scheduled */
+	uint64_t count; /* Length of a tracegen_stream_t, 0 for an endless stream */
+} tracegen_config_t;
+
+typedef struct tracegen_t {
+	tracegen_config_t config;
+	uint64_t rng;
+	uint64_t position; /* Offset or node of the next access */
+	uint64_t items; /* footprint / stride */
+	uint32_t *next; /* Successor of every node, TRACEGEN_POINTER_CHASE only */
+	double *cdf; /* Cumulative popularity by rank, TRACEGEN_ZIPF only */
+	uint64_t loop[6]; /* Tile rows ii, jj, kk and rows i, j, k within them, TRACEGEN_MATRIX only */
+	unsigned int step; /* Next operand of TRACEGEN_MATRIX: A, B or the write of C */
+} tracegen_t;
+
+/**
+ * A multi-process workload: one generator per process, each with the same
+ * pattern and its own seed, scheduled round robin every quantum accesses.
+ * Process ids start at 0, so they double as core ids of multi-core traces.
+ */
+typedef struct tracegen_stream_t {
+	tracegen_t **gens;
+	unsigned int processes;
+	uint64_t quantum;
+	unsigned int current;
+	uint64_t left; /* Accesses the current process has left in its quantum */
+	uint64_t remaining; /* Accesses until the end of the stream */
+	int endless;
+} tracegen_stream_t;
+
+/* Access size of the sequential and random patterns */
+#define TRACEGEN_WORD 8
+
+/* Most nodes or items of the pointer chase and Zipf patterns */
+#define TRACEGEN_MAX_ITEMS (1ull << 26)
+
+tracegen_t *tracegen_create(const tracegen_config_t *config);
+void tracegen_next(tracegen_t *gen, char *rw, uint64_t *address);
+void tracegen_fill(tracegen_t *gen, char *rw, uint64_t *address, size_t n);
+uint64_t tracegen_span(const tracegen_config_t *config);
+void tracegen_destroy(tracegen_t *gen);
+int tracegen_parse(const char *spec, tracegen_config_t *config);
+tracegen_stream_t *tracegen_stream_create(const tracegen_config_t *config);
+int tracegen_stream_next(tracegen_stream_t *stream, int *pid, char *rw, uint64_t *address);
+void tracegen_stream_destroy(tracegen_stream_t *stream);
+
+#endif
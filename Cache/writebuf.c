@@ -0,0 +1,148 @@
+#include "writebuf.h"
+#include <string.h>
+
+/**
+ * Set up a write buffer
+ *
+ * @param state The state to initialize
+ * @param config Number of entries and cycles per memory write
+ * @param B Blocks are 2^B bytes
+ * @return 0 on success, -1 if the configuration is invalid or memory could not be allocated
+ */
+int writebuf_init(writebuf_state *state, const struct cache_write_buffer_config_t *config, uint64_t B)
+{
+	memset(state, 0, sizeof(writebuf_state));
+	if (config->entries == 0 || config->entries > WRITEBUF_MAX_ENTRIES || config->drain_interval == 0) {
+		return -1;
+	}
+	state->capacity = config->entries;
+	state->drainInterval = config->drain_interval;
+	state->B = B;
+	/* Stores are tracked at their own size, so coalescing never changes the bytes written */
+	state->chunkShift = cache_store_shift(B);
+	uint64_t chunks = 1ull << (B - state->chunkShift);
+	state->maskWords = chunks > 64 ? chunks / 64 : 1;
+	state->fullMask = chunks >= 64 ? UINT64_MAX : (1ull << chunks) - 1;
+
+	state->fifo = calloc(state->capacity, sizeof(writebuf_entry));
+	state->masks = calloc(state->capacity * state->maskWords, sizeof(uint64_t));
+	if (!state->fifo || !state->masks) {
+		return -1;
+	}
+	for (uint64_t i = 0; i < state->capacity; i++) {
+		state->fifo[i].mask = state->masks + i * state->maskWords;
+	}
+	return 0;
+}
+
+void writebuf_free(writebuf_state *state)
+{
+	free(state->fifo);
+	free(state->masks);
+	state->fifo = NULL;
+	state->masks = NULL;
+}
+
+/**
+ * Mark the bytes of a write in an entry
+ *
+ * @return The number of chunks that were not written before
+ */
+static uint64_t writebuf_mark(const writebuf_state *state, writebuf_entry *entry, int whole, uint64_t chunk)
+{
+	if (whole) {
+		uint64_t added = 0;
+		for (uint64_t i = 0; i < state->maskWords; i++) {
+			added += (uint64_t)__builtin_popcountll(state->fullMask & ~entry->mask[i]);
+			entry->mask[i] = state->fullMask;
+		}
+		return added;
+	}
+	uint64_t *word = entry->mask + (chunk >> 6);
+	uint64_t bit = 1ull << (chunk & 63);
+	uint64_t added = !(*word & bit);
+	*word |= bit;
+	return added;
+}
+
+/**
+ * Write every block whose turn has come by cycle now and account the
+ * occupancy up to now
+ */
+static void writebuf_advance(writebuf_state *state, uint64_t now)
+{
+	while (state->count && state->nextDrain <= now) {
+		state->occupancySum += state->count * (state->nextDrain - state->lastTime);
+		state->lastTime = state->nextDrain;
+		state->head = (state->head + 1) % state->capacity;
+		state->count--;
+		state->nextDrain += state->drainInterval;
+	}
+	if (now > state->lastTime) {
+		state->occupancySum += state->count * (now - state->lastTime);
+		state->lastTime = now;
+	}
+}
+
+/**
+ * Queue a write to memory
+ *
+ * @param time Accesses issued so far
+ * @param address The address of the store, or of any byte of a written back block
+ * @param whole Whether the whole block is written (a write-back) or one store
+ * @return The bytes of memory traffic the write adds
+ */
+uint64_t writebuf_write(writebuf_state *state, uint64_t time, uint64_t address, int whole)
+{
+	uint64_t block = address >> state->B;
+	uint64_t chunk = (address & ((1ull << state->B) - 1)) >> state->chunkShift;
+	uint64_t now = time + state->stallCycles;
+	writebuf_advance(state, now);
+	state->writes++;
+
+	/* The head entry is already on its way to memory */
+	for (uint64_t i = 1; i < state->count; i++) {
+		writebuf_entry *entry = state->fifo + (state->head + i) % state->capacity;
+		if (entry->block == block) {
+			state->coalesced++;
+			return writebuf_mark(state, entry, whole, chunk) << state->chunkShift;
+		}
+	}
+
+	if (state->count == state->capacity) {
+		state->stalls++;
+		state->stallCycles += state->nextDrain - now;
+		now = state->nextDrain;
+		writebuf_advance(state, now);
+	}
+	if (state->count == 0) {
+		state->nextDrain = now + state->drainInterval;
+	}
+	writebuf_entry *entry = state->fifo + (state->head + state->count) % state->capacity;
+	entry->block = block;
+	memset(entry->mask, 0, sizeof(uint64_t) * state->maskWords);
+	state->count++;
+	if (state->count > state->maxOccupancy) {
+		state->maxOccupancy = state->count;
+	}
+	return writebuf_mark(state, entry, whole, chunk) << state->chunkShift;
+}
+
+/**
+ * Summarize the buffer after time accesses
+ */
+void writebuf_estimate(const writebuf_state *state, uint64_t time, struct cache_write_buffer_stats_t *buffer)
+{
+	/* Account the occupancy up to the end without changing the buffer */
+	writebuf_state end = *state;
+	writebuf_advance(&end, time + end.stallCycles);
+
+	memset(buffer, 0, sizeof(struct cache_write_buffer_stats_t));
+	buffer->writes = state->writes;
+	buffer->coalesced = state->coalesced;
+	buffer->memory_writes = state->writes - state->coalesced;
+	buffer->stalls = state->stalls;
+	buffer->stall_cycles = state->stallCycles;
+	buffer->max_occupancy = state->maxOccupancy;
+	buffer->avg_occupancy = end.lastTime ? (double)end.occupancySum / (double)end.lastTime : 0;
+}
@@ -0,0 +1,50 @@
+#ifndef WRITEBUF_H
+#define WRITEBUF_H
+
+#include "cachesim.h"
+
+/* Most entries of a write buffer */
+#define WRITEBUF_MAX_ENTRIES 1024
+
+/* One queued block and the parts of it that were written */
+typedef struct writebuf_entry_t {
+	uint64_t block;
+	uint64_t *mask; /* maskWords words, one bit per store sized chunk of 2^chunkShift bytes */
+} writebuf_entry;
+
+/**
+ * A FIFO of blocks waiting to be written to memory. Memory takes
+ * drainInterval cycles per block, one block at a time. Writes to a queued
+ * block other than the one being written are merged into it, so only the
+ * bytes that were not written yet add memory traffic. Time is the number of
+ * accesses issued plus the cycles the core stalled on a full buffer.
+ */
+typedef struct writebuf_state_t {
+	uint64_t capacity;
+	uint64_t drainInterval;
+	uint64_t B;
+	uint64_t chunkShift;
+	uint64_t maskWords;
+	uint64_t fullMask; /* Every word of the mask of a whole block */
+	writebuf_entry *fifo;
+	uint64_t *masks; /* Masks of all entries */
+	uint64_t head;
+	uint64_t count;
+
+	uint64_t nextDrain; /* Cycle the head entry is written */
+	uint64_t lastTime; /* Cycle occupancySum is accumulated to */
+	uint64_t occupancySum;
+
+	uint64_t writes;
+	uint64_t coalesced;
+	uint64_t stalls;
+	uint64_t stallCycles;
+	uint64_t maxOccupancy;
+} writebuf_state;
+
+int writebuf_init(writebuf_state *state, const struct cache_write_buffer_config_t *config, uint64_t B);
+void writebuf_free(writebuf_state *state);
+uint64_t writebuf_write(writebuf_state *state, uint64_t time, uint64_t address, int whole);
+void writebuf_estimate(const writebuf_state *state, uint64_t time, struct cache_write_buffer_stats_t *buffer);
+
+#endif
@@ -0,0 +1,448 @@
+#define _GNU_SOURCE /* fopencookie */
+
+#include "zstream.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define ZSTREAM_RING (1 << 22) /* Decoded bytes buffered ahead of the reader */
+#define ZSTREAM_CHUNK (1 << 16) /* Compressed bytes read at a time */
+#define ZSTREAM_MAGIC_LEN 6
+
+typedef enum zstream_format_t {
+	ZSTREAM_PLAIN,
+	ZSTREAM_GZIP,
+	ZSTREAM_XZ,
+	ZSTREAM_ZSTD
+} zstream_format_t;
+
+/**
+ * A decompressing stream. The decoder thread appends to the ring at head and
+ * the reader consumes from tail; both only ever grow; the ring offset is the
+ * counter modulo ZSTREAM_RING.
+ */
+typedef struct zstream_t {
+	FILE *fin; /* Compressed input */
+	zstream_format_t format;
+	const char *error; /* Why decoding failed, NULL if it did not */
+
+	uint8_t peek[ZSTREAM_MAGIC_LEN]; /* Bytes read to detect the format, decoded first */
+	size_t peek_len;
+	uint8_t in[ZSTREAM_CHUNK];
+
+	uint8_t *ring;
+	uint64_t head; /* Bytes decoded */
+	uint64_t tail; /* Bytes read */
+	int done; /* The decoder has finished */
+	int closing; /* The reader has closed the stream */
+
+	pthread_mutex_t lock;
+	pthread_cond_t produced;
+	pthread_cond_t consumed;
+	pthread_t thread;
+} zstream_t;
+
+static zstream_format_t zstream_detect(const uint8_t *magic, size_t len)
+{
+	if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		return ZSTREAM_GZIP;
+	}
+	if (len >= 6 && !memcmp(magic, "\xfd" "7zXZ\0", 6)) {
+		return ZSTREAM_XZ;
+	}
+	if (len >= 4 && !memcmp(magic, "\x28\xb5\x2f\xfd", 4)) {
+		return ZSTREAM_ZSTD;
+	}
+	return ZSTREAM_PLAIN;
+}
+
+static int zstream_supported(zstream_format_t format)
+{
+	switch (format) {
+#ifdef HAVE_ZLIB
+	case ZSTREAM_GZIP:
+#endif
+#ifdef HAVE_LZMA
+	case ZSTREAM_XZ:
+#endif
+#ifdef HAVE_ZSTD
+	case ZSTREAM_ZSTD:
+#endif
+	case ZSTREAM_PLAIN:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Read up to len bytes of compressed input, starting with the peeked bytes
+ */
+static size_t zstream_input(zstream_t *z, uint8_t *buf, size_t len)
+{
+	if (z->peek_len) {
+		size_t n = z->peek_len < len ? z->peek_len : len;
+		memcpy(buf, z->peek, n);
+		memmove(z->peek, z->peek + n, z->peek_len - n);
+		z->peek_len -= n;
+		return n;
+	}
+	return fread(buf, 1, len, z->fin);
+}
+
+/**
+ * Wait for free space in the ring
+ *
+ * @param len Set to the number of contiguous bytes that may be written
+ * @return Where to write, or NULL if the reader closed the stream
+ */
+static uint8_t *zstream_reserve(zstream_t *z, size_t *len)
+{
+	pthread_mutex_lock(&z->lock);
+	while (z->head - z->tail == ZSTREAM_RING && !z->closing) {
+		pthread_cond_wait(&z->consumed, &z->lock);
+	}
+	if (z->closing) {
+		pthread_mutex_unlock(&z->lock);
+		return NULL;
+	}
+	size_t offset = z->head % ZSTREAM_RING;
+	size_t space = ZSTREAM_RING - (z->head - z->tail);
+	*len = ZSTREAM_RING - offset < space ? ZSTREAM_RING - offset : space;
+	pthread_mutex_unlock(&z->lock);
+	return z->ring + offset;
+}
+
+/**
+ * Publish len bytes written after zstream_reserve to the reader
+ */
+static void zstream_commit(zstream_t *z, size_t len)
+{
+	if (!len) {
+		return;
+	}
+	pthread_mutex_lock(&z->lock);
+	z->head += len;
+	pthread_cond_signal(&z->produced);
+	pthread_mutex_unlock(&z->lock);
+}
+
+static void zstream_copy(zstream_t *z)
+{
+	for (;;) {
+		size_t len;
+		uint8_t *out = zstream_reserve(z, &len);
+		if (!out) {
+			return;
+		}
+		size_t n = zstream_input(z, out, len);
+		if (!n) {
+			return;
+		}
+		zstream_commit(z, n);
+	}
+}
+
+#ifdef HAVE_ZLIB
+static void zstream_gzip(zstream_t *z)
+{
+	z_stream s;
+	memset(&s, 0, sizeof(s));
+	/* 15 bit window, +32 accepts both gzip and zlib headers */
+	if (inflateInit2(&s, 15 + 32) != Z_OK) {
+		z->error = "cannot initialize zlib";
+		return;
+	}
+
+	int pending = 0; /* Inside a member that has not ended yet */
+	for (;;) {
+		if (s.avail_in == 0) {
+			s.avail_in = zstream_input(z, z->in, ZSTREAM_CHUNK);
+			s.next_in = z->in;
+			if (s.avail_in == 0) {
+				break;
+			}
+		}
+		size_t len;
+		uint8_t *out = zstream_reserve(z, &len);
+		if (!out) {
+			break;
+		}
+		s.next_out = out;
+		s.avail_out = len;
+		int ret = inflate(&s, Z_NO_FLUSH);
+		zstream_commit(z, len - s.avail_out);
+		pending = 1;
+		if (ret == Z_STREAM_END) {
+			/* gzip files may hold several members, e.g. from cat or pigz */
+			inflateReset(&s);
+			pending = 0;
+		} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			z->error = "corrupt gzip data";
+			break;
+		}
+	}
+	if (pending && !z->error && !z->closing) {
+		z->error = "truncated gzip data";
+	}
+	inflateEnd(&s);
+}
+#endif
+
+#ifdef HAVE_LZMA
+static void zstream_xz(zstream_t *z)
+{
+	lzma_stream s = LZMA_STREAM_INIT;
+	if (lzma_stream_decoder(&s, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+		z->error = "cannot initialize liblzma";
+		return;
+	}
+
+	lzma_action action = LZMA_RUN;
+	for (;;) {
+		if (s.avail_in == 0 && action == LZMA_RUN) {
+			s.avail_in = zstream_input(z, z->in, ZSTREAM_CHUNK);
+			s.next_in = z->in;
+			if (s.avail_in == 0) {
+				action = LZMA_FINISH;
+			}
+		}
+		size_t len;
+		uint8_t *out = zstream_reserve(z, &len);
+		if (!out) {
+			break;
+		}
+		s.next_out = out;
+		s.avail_out = len;
+		lzma_ret ret = lzma_code(&s, action);
+		zstream_commit(z, len - s.avail_out);
+		if (ret == LZMA_STREAM_END) {
+			break;
+		}
+		if (ret != LZMA_OK) {
+			z->error = ret == LZMA_BUF_ERROR ? "truncated xz data" : "corrupt xz data";
+			break;
+		}
+	}
+	lzma_end(&s);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static void zstream_zstd(zstream_t *z)
+{
+	ZSTD_DStream *d = ZSTD_createDStream();
+	if (!d) {
+		z->error = "cannot initialize libzstd";
+		return;
+	}
+	ZSTD_initDStream(d);
+
+	ZSTD_inBuffer in = { z->in, 0, 0 };
+	size_t hint = 0; /* 0 once the last frame is complete and flushed */
+	for (;;) {
+		if (in.pos == in.size) {
+			in.size = zstream_input(z, z->in, ZSTREAM_CHUNK);
+			in.pos = 0;
+			if (in.size == 0 && hint == 0) {
+				break;
+			}
+		}
+		size_t len;
+		uint8_t *out = zstream_reserve(z, &len);
+		if (!out) {
+			break;
+		}
+		ZSTD_outBuffer buffer = { out, len, 0 };
+		hint = ZSTD_decompressStream(d, &buffer, &in);
+		zstream_commit(z, buffer.pos);
+		if (ZSTD_isError(hint)) {
+			z->error = "corrupt zstd data";
+			break;
+		}
+		/* At the end of the input, keep going only while the decoder still flushes */
+		if (in.size == 0 && buffer.pos == 0) {
+			z->error = "truncated zstd data";
+			break;
+		}
+	}
+	ZSTD_freeDStream(d);
+}
+#endif
+
+static void *zstream_decode(void *arg)
+{
+	zstream_t *z = arg;
+	switch (z->format) {
+#ifdef HAVE_ZLIB
+	case ZSTREAM_GZIP:
+		zstream_gzip(z);
+		break;
+#endif
+#ifdef HAVE_LZMA
+	case ZSTREAM_XZ:
+		zstream_xz(z);
+		break;
+#endif
+#ifdef HAVE_ZSTD
+	case ZSTREAM_ZSTD:
+		zstream_zstd(z);
+		break;
+#endif
+	default:
+		zstream_copy(z);
+		break;
+	}
+	if (!z->error && ferror(z->fin)) {
+		z->error = "read error";
+	}
+
+	pthread_mutex_lock(&z->lock);
+	z->done = 1;
+	pthread_cond_signal(&z->produced);
+	pthread_mutex_unlock(&z->lock);
+	return NULL;
+}
+
+static ssize_t zstream_read(void *cookie, char *buf, size_t size)
+{
+	zstream_t *z = cookie;
+	pthread_mutex_lock(&z->lock);
+	while (z->head == z->tail && !z->done) {
+		pthread_cond_wait(&z->produced, &z->lock);
+	}
+	uint64_t available = z->head - z->tail;
+	pthread_mutex_unlock(&z->lock);
+
+	if (!available) {
+		if (z->error) {
+			/* A silently shortened trace would produce plausible but wrong statistics */
+			fprintf(stderr, "zstream: %s\n", z->error);
+			exit(1);
+		}
+		return 0;
+	}
+
+	/* The decoder never writes to [tail, head), so copy without holding the lock */
+	size_t offset = z->tail % ZSTREAM_RING;
+	size_t n = size;
+	if (n > available) {
+		n = available;
+	}
+	if (n > ZSTREAM_RING - offset) {
+		n = ZSTREAM_RING - offset;
+	}
+	memcpy(buf, z->ring + offset, n);
+
+	pthread_mutex_lock(&z->lock);
+	z->tail += n;
+	pthread_cond_signal(&z->consumed);
+	pthread_mutex_unlock(&z->lock);
+	return n;
+}
+
+static int zstream_close(void *cookie)
+{
+	zstream_t *z = cookie;
+	pthread_mutex_lock(&z->lock);
+	z->closing = 1;
+	pthread_cond_signal(&z->consumed);
+	pthread_mutex_unlock(&z->lock);
+	pthread_join(z->thread, NULL);
+
+	if (z->fin != stdin) {
+		fclose(z->fin);
+	}
+	pthread_mutex_destroy(&z->lock);
+	pthread_cond_destroy(&z->produced);
+	pthread_cond_destroy(&z->consumed);
+	free(z->ring);
+	free(z);
+	return 0;
+}
+
+/**
+ * Open a possibly compressed file for reading
+ *
+ * @param path The file to open, or NULL for stdin
+ * @return A stream of the decompressed contents, or NULL with errno set
+ *         (ENOTSUP if the file is compressed with a format that was not built in)
+ */
+FILE *zstream_open(const char *path)
+{
+	FILE *fin = path ? fopen(path, "rb") : stdin;
+	if (!fin) {
+		return NULL;
+	}
+
+	uint8_t magic[ZSTREAM_MAGIC_LEN];
+	size_t len = fread(magic, 1, sizeof(magic), fin);
+	zstream_format_t format = zstream_detect(magic, len);
+	if (!zstream_supported(format)) {
+		if (fin != stdin) {
+			fclose(fin);
+		}
+		errno = ENOTSUP;
+		return NULL;
+	}
+	/* Plain files are read directly if the peeked bytes can be given back */
+	if (format == ZSTREAM_PLAIN && fseek(fin, 0, SEEK_SET) == 0) {
+		return fin;
+	}
+
+	zstream_t *z = calloc(1, sizeof(zstream_t));
+	uint8_t *ring = malloc(ZSTREAM_RING);
+	if (!z || !ring) {
+		free(z);
+		free(ring);
+		if (fin != stdin) {
+			fclose(fin);
+		}
+		errno = ENOMEM;
+		return NULL;
+	}
+	z->fin = fin;
+	z->format = format;
+	z->ring = ring;
+	memcpy(z->peek, magic, len);
+	z->peek_len = len;
+	pthread_mutex_init(&z->lock, NULL);
+	pthread_cond_init(&z->produced, NULL);
+	pthread_cond_init(&z->consumed, NULL);
+
+	cookie_io_functions_t io = { zstream_read, NULL, NULL, zstream_close };
+	FILE *stream = NULL;
+	int err = pthread_create(&z->thread, NULL, zstream_decode, z);
+	if (!err) {
+		stream = fopencookie(z, "rb", io);
+		if (!stream) {
+			err = errno;
+			zstream_close(z);
+		}
+	} else {
+		if (fin != stdin) {
+			fclose(fin);
+		}
+		free(ring);
+		free(z);
+	}
+	if (!stream) {
+		errno = err;
+		return NULL;
+	}
+	setvbuf(stream, NULL, _IOFBF, ZSTREAM_CHUNK);
+	return stream;
+}
@@ -0,0 +1,19 @@
+#ifndef ZSTREAM_H
+#define ZSTREAM_H
+
+#include <stdio.h>
+
+/**
+ * Transparent decompression of trace files
+ *
+ * zstream_open recognizes gzip, xz and zstd input by its magic bytes and
+ * returns a stdio stream of the decompressed data. A background thread
+ * decodes into a ring buffer ahead of the reader, so decompression overlaps
+ * with the simulation. Plain input is returned unchanged.
+ *
+ * Support for every format is chosen at build time with HAVE_ZLIB, HAVE_LZMA
+ * and HAVE_ZSTD (see the Makefile).
+ */
+FILE *zstream_open(const char *path);
+
+#endif
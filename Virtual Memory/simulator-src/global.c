@@ -18,3 +18,13 @@ uint64_t rlt_size = 6;
 // TLB Size
 uint64_t tlb_size = 3;
 
+// TLB associativity in bits, at most tlb_size (fully associative)
+uint64_t tlb_ways = 3;
+
+// ASID size in bits. 0 flushes the TLB on every context switch instead.
+uint64_t tlb_asid_bits = 0;
+
+// Translate and handle page faults in the simulator (tlb_translate) instead
+// of tlb_lookup and page_lookup. Set by -w, -A and -T.
+uint64_t simulator_paging = 0;
+
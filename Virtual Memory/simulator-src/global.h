@@ -8,5 +8,8 @@ extern uint64_t virtual_address_size;
 extern uint64_t physical_address_size;
 extern uint64_t rlt_size;
 extern uint64_t tlb_size;
+extern uint64_t tlb_ways;
+extern uint64_t tlb_asid_bits;
+extern uint64_t simulator_paging;
 
 #endif
@@ -4,12 +4,15 @@
 #include "stats.h"
 #include "tlb.h"
 #include "reverselookup.h"
+#include "zstream.h"
+#include "tracegen.h"
 #include <getopt.h>
 #include <unistd.h>
 #include <string.h>
 #include <inttypes.h>
 
 void print_statistics(stats_t *stats);
+void add_page_walk_time(stats_t *stats);
 
 void print_help_and_exit() {
 	printf("vm-sim [OPTIONS] < traces/file.trace\n");
@@ -17,6 +20,16 @@ void print_help_and_exit() {
     printf("  -P P\t\tPhysical memory is 2^P bytes\n");
     printf("  -p p\t\tSize of each page is 2^p bytes\n");
     printf("  -t t\t\tSize of the TLB is 2^t entries\n");
+    printf("  -w w\t\tTLB sets have 2^w ways (default fully associative)\n");
+    printf("  -A a\t\tTag TLB entries with a-bit ASIDs instead of flushing on context switches\n");
+    printf("  -T kind\tPage table organization: flat (default), radix or hashed\n");
+    printf("\t\t-w, -A and -T translate and handle page faults (least frequently used) in the\n");
+    printf("\t\tsimulator instead of tlb_lookup and page_lookup; -T flat compares with the others\n");
+    printf("  -i file\tTrace to replay, plain or gzip/xz/zstd compressed (default stdin)\n");
+    printf("  -g spec\tSimulate a synthetic workload instead of a trace, e.g.\n");
+    printf("\t\t-g random,processes=4,quantum=1000,footprint=0x10000 (see tracegen_parse)\n");
+    printf("  -o file\tAlso write every access to a text trace, e.g. to keep a workload\n");
+    printf("  -S file\tWrite the statistics of every process to a CSV file\n");
     printf("  -d d\t\tDebug flag to print each physical address (1, 0)\n");
     printf("  -h\t\tThis helpful output\n");
     exit(0);
@@ -27,9 +40,7 @@ static int debug_flag = 0;
 
 void sim_access(int pid, char rw, uint64_t address, stats_t *stats)
 {
-	if (pid != old_pid) {
-		// Context switch - Clear the TLB
-		tlb_clear();
+	if (pid != old_pid || !current_process) {
 		current_process = get_process(pid);
 
 		// Create process if it does not exist
@@ -39,6 +50,11 @@ void sim_access(int pid, char rw, uint64_t address, stats_t *stats)
 			current_process = add_process(pid, name);
 		}
 		current_pagetable = current_process->pagetable;
+		current_table = current_process->table;
+		current_process->stats.switches++;
+
+		// Context switch - Clear the TLB or switch to the process's ASID
+		tlb_switch(&current_process->asid, &current_process->asid_generation);
 		old_pid = pid;
 	}
 
@@ -47,7 +63,12 @@ void sim_access(int pid, char rw, uint64_t address, stats_t *stats)
 	uint64_t offset = get_offset(address);
 
 	// Check TLB first
-	uint64_t ret = tlb_lookup(vpn, offset, rw, stats);
+	stats_t before = *stats;
+	uint64_t ret = simulator_paging ? tlb_translate(vpn, offset, rw, stats) : tlb_lookup(vpn, offset, rw, stats);
+	if (stats->translation_faults != before.translation_faults) {
+		stats->page_walk_references += pagetable_walk_references(current_table, vpn);
+	}
+	process_account(current_process, &before, stats);
 	if (debug_flag) {
 		printf("%" PRIu64 "lu\n", ret);	
 	}
@@ -55,11 +76,15 @@ void sim_access(int pid, char rw, uint64_t address, stats_t *stats)
 
 int main (int argc, char **argv)
 {
-	FILE *fin = stdin;
+	const char *trace_path = NULL;
+	const char *workload = NULL;
+	const char *export_path = NULL;
+	const char *process_stats_path = NULL;
+	int ways_set = 0;
 
 	int opt;
 
-	while (-1 != (opt = getopt(argc, argv, "V:P:p:t:i:d:h"))) {
+	while (-1 != (opt = getopt(argc, argv, "V:P:p:t:w:A:T:i:g:o:S:d:h"))) {
 		switch (opt) {
 			case 'V':
 				virtual_address_size = atoi(optarg);
@@ -73,8 +98,35 @@ int main (int argc, char **argv)
 			case 't':
 				tlb_size = atoi(optarg);
 				break;
+			case 'w':
+				tlb_ways = atoi(optarg);
+				ways_set = 1;
+				simulator_paging = 1;
+				break;
+			case 'A':
+				tlb_asid_bits = atoi(optarg);
+				if (tlb_asid_bits > 32) {
+					print_help_and_exit();
+				}
+				simulator_paging = 1;
+				break;
+			case 'T':
+				if (pagetable_parse_kind(optarg, &pagetable_kind)) {
+					print_help_and_exit();
+				}
+				simulator_paging = 1;
+				break;
 			case 'i':
-				fin = fopen(optarg, "r");
+				trace_path = optarg;
+				break;
+			case 'g':
+				workload = optarg;
+				break;
+			case 'o':
+				export_path = optarg;
+				break;
+			case 'S':
+				process_stats_path = optarg;
 				break;
 			case 'd':
 				debug_flag = atoi(optarg);
@@ -86,13 +138,55 @@ int main (int argc, char **argv)
 		}
 	}
 
+	// A generated workload is simulated directly, without a trace file
+	tracegen_stream_t *generator = NULL;
+	FILE *fin = NULL;
+	if (workload) {
+		tracegen_config_t config;
+		if (tracegen_parse(workload, &config)) {
+			perror_exit("Could not parse the workload");
+		}
+		// Every generated vpn has to have an entry in the page table
+		uint64_t span = tracegen_span(&config);
+		if (virtual_address_size < 64 && (config.base + span < config.base ||
+				config.base + span > (1ull << virtual_address_size))) {
+			perror_exit("The workload does not fit in the virtual address space");
+		}
+		generator = tracegen_stream_create(&config);
+		if (!generator) {
+			perror_exit("Invalid workload parameters");
+		}
+	} else {
+		// The trace may be gzip, xz or zstd compressed
+		fin = zstream_open(trace_path);
+		if (!fin) {
+			perror_exit("Could not open the trace");
+		}
+	}
+	FILE *fout = NULL;
+	if (export_path) {
+		fout = fopen(export_path, "w");
+		if (!fout) {
+			perror_exit("Could not open the trace to write");
+		}
+	}
+
 	rlt_size = physical_address_size - page_size;
+	if (!ways_set || tlb_ways > tlb_size) {
+		tlb_ways = tlb_size;
+	}
 
 	printf("VM settings\n");
 	printf("Page Size: %" PRIu64 "\n", page_size);
 	printf("Virual Address Size: %" PRIu64 "\n", virtual_address_size);
 	printf("Physical Address Size: %" PRIu64 "\n", physical_address_size);
 	printf("TLB size: %" PRIu64 "\n", tlb_size);
+	if (simulator_paging) {
+		printf("TLB ways: %" PRIu64 "\n", tlb_ways);
+		printf("ASID size: %" PRIu64 "\n", tlb_asid_bits);
+		printf("Page Table: %s\n", pagetable_kind == PAGETABLE_FLAT ? "flat"
+				: pagetable_kind == PAGETABLE_RADIX ? "radix" : "hashed");
+	}
 	printf("Debug Flag: %d\n", debug_flag);
 	printf("\n");
 
@@ -112,17 +206,37 @@ int main (int argc, char **argv)
 	char rw;
 	uint64_t address;
 	int pid;
-	while (!feof(fin)) {
+	if (generator) {
+		while (tracegen_stream_next(generator, &pid, &rw, &address)) {
+			if (fout) {
+				fprintf(fout, "%d %c %" PRIx64 "\n", pid, rw, address);
+			}
+			sim_access(pid, rw, address, stats);
+		}
+	}
+	while (fin && !feof(fin)) {
 		int ret = fscanf(fin, "%d %c %" PRIx64 "\n", &pid, &rw, &address);
 		if (ret == 3) {
 		 	//printf("%d, %c, %" PRIu64 "\n", pid, rw, address);
+			if (fout) {
+				fprintf(fout, "%d %c %" PRIx64 "\n", pid, rw, address);
+			}
 		 	sim_access(pid, rw, address, stats);
 		}
 	}
 
 	compute_stats(stats);
+	add_page_walk_time(stats);
 
 	print_statistics(stats);
+	if (process_stats_path) {
+		FILE *fstats = fopen(process_stats_path, "w");
+		if (!fstats) {
+			perror_exit("Could not open the process statistics file");
+		}
+		write_process_stats(fstats);
+		fclose(fstats);
+	}
 
 	// Free the hardware
 	tlb_free();
@@ -131,7 +245,13 @@ int main (int argc, char **argv)
 	free_processes();
 	// Free statistics struct
 	free(stats);
-	fclose(fin);
+	if (fin) {
+		fclose(fin);
+	}
+	if (fout) {
+		fclose(fout);
+	}
+	tracegen_stream_destroy(generator);
 
 	return 0;
 }
@@ -148,7 +268,33 @@ void print_statistics(stats_t *stats) {
     printf("TLB Read Time: %" PRIu64 "\n", stats->TLB_READ_TIME);
     printf("Memory Read Time: %" PRIu64 "\n", stats->MEMORY_READ_TIME);
     printf("Disk Read Time: %" PRIu64 "\n", stats->DISK_READ_TIME);
+    if (pagetable_kind != PAGETABLE_FLAT) {
+        printf("Page Walk Memory References: %" PRIu64 "\n", stats->page_walk_references);
+        printf("Page Table Memory: %" PRIu64 " bytes\n", pagetable_memory());
+    }
+    if (simulator_paging) {
+        printf("TLB Reach: %" PRIu64 " bytes\n", tlb_reach());
+        printf("TLB Hits: %" PRIu64 "\n", tlb_stats.hits);
+        printf("TLB Hits Kept Across Context Switches: %" PRIu64 " (%.2f%% of accesses)\n", tlb_stats.kept_hits,
+               stats->accesses ? 100.0 * tlb_stats.kept_hits / stats->accesses : 0.0);
+        printf("Context Switches: %" PRIu64 "\n", tlb_stats.switches);
+        printf("TLB Flushes: %" PRIu64 "\n", tlb_stats.flushes);
+        printf("TLB Shootdowns: %" PRIu64 "\n", tlb_stats.shootdowns);
+    }
     /* Average Access Times */
     printf("Average Access Time: %f\n", stats->AAT);
     
-}
\ No newline at end of file
+}
+
+/**
+ * compute_stats charges one memory read per TLB miss, which is the walk of a
+ * flat table. Radix and hashed tables take more references per walk; charge
+ * the extra ones too.
+ */
+void add_page_walk_time(stats_t *stats) {
+	if (!stats->accesses || stats->page_walk_references <= stats->translation_faults) {
+		return;
+	}
+	uint64_t extra = stats->page_walk_references - stats->translation_faults;
+	stats->AAT += (double) (extra * stats->MEMORY_READ_TIME) / stats->accesses;
+}
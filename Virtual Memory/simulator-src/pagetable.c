@@ -1,7 +1,350 @@
 #include "pagetable.h"
+#include "reverselookup.h"
+#include "tlb.h"
+#include <string.h>
 
 /*
  * Current pagetable register. This can be used in the TLB for updating page
  * table entries
  */
 pte_t *current_pagetable;
+
+// The same table behind the kind-independent accessors
+pagetable_t *current_table;
+
+// Organization of the page tables of new processes
+pagetable_kind_t pagetable_kind = PAGETABLE_FLAT;
+
+// Bytes used by all page tables
+static uint64_t total_bytes;
+
+#define RADIX_ENTRIES (1ull << PAGETABLE_RADIX_BITS)
+
+static void *pagetable_alloc(pagetable_t *pt, uint64_t bytes)
+{
+	void *p = calloc(1, bytes);
+	if (p) {
+		pt->bytes += bytes;
+		total_bytes += bytes;
+	}
+	return p;
+}
+
+/**
+ * Create an empty page table of 2^(virtual_address_size - page_size)
+ * entries. A flat table is allocated whole, the others only as pages are
+ * touched.
+ *
+ * @return The table, or NULL if it could not be allocated
+ */
+pagetable_t *pagetable_create(pagetable_kind_t kind)
+{
+	pagetable_t *pt = (pagetable_t *) calloc(1, sizeof(pagetable_t));
+	if (!pt) {
+		return NULL;
+	}
+	pt->kind = kind;
+	pt->vpn_bits = virtual_address_size - page_size;
+
+	switch (kind) {
+		case PAGETABLE_FLAT:
+			if (pt->vpn_bits < 48) {
+				pt->flat = pagetable_alloc(pt, sizeof(pte_t) << pt->vpn_bits);
+			}
+			if (!pt->flat) {
+				free(pt);
+				return NULL;
+			}
+			break;
+		case PAGETABLE_RADIX:
+			// The top level translates whatever bits the lower levels leave
+			pt->levels = (pt->vpn_bits + PAGETABLE_RADIX_BITS - 1) / PAGETABLE_RADIX_BITS;
+			if (pt->levels == 0) {
+				pt->levels = 1;
+			}
+			pt->root = pagetable_alloc(pt, pt->levels == 1 ? sizeof(pte_t) * RADIX_ENTRIES : sizeof(void *) * RADIX_ENTRIES);
+			if (!pt->root) {
+				free(pt);
+				return NULL;
+			}
+			break;
+		case PAGETABLE_HASHED:
+			pt->bucket_count = PAGETABLE_HASH_BUCKETS;
+			pt->buckets = pagetable_alloc(pt, sizeof(pagetable_node_t *) * pt->bucket_count);
+			if (!pt->buckets) {
+				free(pt);
+				return NULL;
+			}
+			break;
+	}
+	return pt;
+}
+
+static void radix_free(void **dir, uint64_t level, uint64_t levels)
+{
+	if (level + 1 < levels) {
+		for (uint64_t i = 0; i < RADIX_ENTRIES; i++) {
+			if (dir[i]) {
+				radix_free(dir[i], level + 1, levels);
+			}
+		}
+	}
+	free(dir);
+}
+
+void pagetable_destroy(pagetable_t *pt)
+{
+	if (!pt) {
+		return;
+	}
+	switch (pt->kind) {
+		case PAGETABLE_FLAT:
+			free(pt->flat);
+			break;
+		case PAGETABLE_RADIX:
+			radix_free(pt->root, 0, pt->levels);
+			break;
+		case PAGETABLE_HASHED:
+			for (uint64_t i = 0; i < pt->bucket_count; i++) {
+				pagetable_node_t *node = pt->buckets[i];
+				while (node) {
+					pagetable_node_t *next = node->next;
+					free(node);
+					node = next;
+				}
+			}
+			free(pt->buckets);
+			break;
+	}
+	total_bytes -= pt->bytes;
+	free(pt);
+}
+
+// Index of vpn within a directory or leaf at the given level, 0 being the top
+static inline uint64_t radix_index(const pagetable_t *pt, uint64_t vpn, uint64_t level)
+{
+	return (vpn >> (PAGETABLE_RADIX_BITS * (pt->levels - 1 - level))) & (RADIX_ENTRIES - 1);
+}
+
+static inline uint64_t hash_bucket(const pagetable_t *pt, uint64_t vpn)
+{
+	return ((vpn * 0x9E3779B97F4A7C15ull) >> 32) & (pt->bucket_count - 1);
+}
+
+// Double the buckets. Nodes are relinked, so entries do not move.
+static void hash_grow(pagetable_t *pt)
+{
+	uint64_t old_count = pt->bucket_count;
+	pagetable_node_t **old = pt->buckets;
+	pagetable_node_t **buckets = pagetable_alloc(pt, sizeof(pagetable_node_t *) * old_count * 2);
+	if (!buckets) {
+		// Keep the longer chains rather than failing the access
+		return;
+	}
+	pt->buckets = buckets;
+	pt->bucket_count = old_count * 2;
+	for (uint64_t i = 0; i < old_count; i++) {
+		pagetable_node_t *node = old[i];
+		while (node) {
+			pagetable_node_t *next = node->next;
+			uint64_t b = hash_bucket(pt, node->vpn);
+			node->next = buckets[b];
+			buckets[b] = node;
+			node = next;
+		}
+	}
+	free(old);
+	pt->bytes -= sizeof(pagetable_node_t *) * old_count;
+	total_bytes -= sizeof(pagetable_node_t *) * old_count;
+}
+
+/**
+ * Find the entry of a virtual page without allocating anything
+ *
+ * @return The entry, or NULL if the page was never touched (and so is not
+ *         valid)
+ */
+pte_t *pagetable_find(pagetable_t *pt, uint64_t vpn)
+{
+	switch (pt->kind) {
+		case PAGETABLE_FLAT:
+			return pt->flat + vpn;
+		case PAGETABLE_RADIX: {
+			void **dir = pt->root;
+			for (uint64_t level = 0; level + 1 < pt->levels; level++) {
+				dir = dir[radix_index(pt, vpn, level)];
+				if (!dir) {
+					return NULL;
+				}
+			}
+			return (pte_t *) dir + radix_index(pt, vpn, pt->levels - 1);
+		}
+		case PAGETABLE_HASHED:
+			for (pagetable_node_t *node = pt->buckets[hash_bucket(pt, vpn)]; node; node = node->next) {
+				if (node->vpn == vpn) {
+					return &node->pte;
+				}
+			}
+			return NULL;
+	}
+	return NULL;
+}
+
+/**
+ * Get the entry of a virtual page, allocating the parts of the table it
+ * needs. A new entry is not valid. Entries never move, so the pointer stays
+ * good until the table is destroyed.
+ *
+ * Flat tables can still be indexed directly through current_pagetable and
+ * task_struct->pagetable. Radix and hashed tables have no array, so with -T
+ * the simulator handles page lookups and faults itself (pagetable_lookup).
+ */
+pte_t *pagetable_entry(pagetable_t *pt, uint64_t vpn)
+{
+	pte_t *pte = pagetable_find(pt, vpn);
+	if (pte) {
+		return pte;
+	}
+
+	if (pt->kind == PAGETABLE_RADIX) {
+		void **dir = pt->root;
+		for (uint64_t level = 0; level + 1 < pt->levels; level++) {
+			void **slot = dir + radix_index(pt, vpn, level);
+			if (!*slot) {
+				int leaf = level + 2 == pt->levels;
+				*slot = pagetable_alloc(pt, leaf ? sizeof(pte_t) * RADIX_ENTRIES : sizeof(void *) * RADIX_ENTRIES);
+				if (!*slot) {
+					perror_exit("pagetable : Could not allocate memory for a page table level");
+				}
+			}
+			dir = *slot;
+		}
+		return (pte_t *) dir + radix_index(pt, vpn, pt->levels - 1);
+	}
+
+	// PAGETABLE_HASHED
+	if (pt->entries >= pt->bucket_count) {
+		hash_grow(pt);
+	}
+	pagetable_node_t *node = pagetable_alloc(pt, sizeof(pagetable_node_t));
+	if (!node) {
+		perror_exit("pagetable : Could not allocate memory for a page table entry");
+	}
+	uint64_t b = hash_bucket(pt, vpn);
+	node->vpn = vpn;
+	node->next = pt->buckets[b];
+	pt->buckets[b] = node;
+	pt->entries++;
+	return &node->pte;
+}
+
+/**
+ * Memory references a hardware walk of the table makes to translate vpn:
+ * one for a flat table, one per level down to the first missing one for a
+ * radix table, and one for the bucket plus one per node visited for a hashed
+ * table.
+ */
+uint64_t pagetable_walk_references(pagetable_t *pt, uint64_t vpn)
+{
+	uint64_t references = 1;
+	switch (pt->kind) {
+		case PAGETABLE_FLAT:
+			break;
+		case PAGETABLE_RADIX: {
+			void **dir = pt->root;
+			for (uint64_t level = 0; level + 1 < pt->levels; level++) {
+				dir = dir[radix_index(pt, vpn, level)];
+				if (!dir) {
+					break;
+				}
+				references++;
+			}
+			break;
+		}
+		case PAGETABLE_HASHED:
+			for (pagetable_node_t *node = pt->buckets[hash_bucket(pt, vpn)]; node; node = node->next) {
+				references++;
+				if (node->vpn == vpn) {
+					break;
+				}
+			}
+			break;
+	}
+	return references;
+}
+
+// Bytes used by the page tables of all processes
+uint64_t pagetable_memory(void)
+{
+	return total_bytes;
+}
+
+/**
+ * Take a frame for vpn of the running process: a free one, or else the one
+ * whose page was looked up the fewest times, writing it to disk if dirty.
+ */
+static uint64_t pagetable_fault(uint64_t vpn, stats_t *stats)
+{
+	uint64_t frames = 1llu << rlt_size;
+	uint64_t pfn = rlt_find_free();
+	if (pfn == frames) {
+		uint64_t fewest = UINT64_MAX;
+		for (uint64_t frame = 0; frame < frames; frame++) {
+			pte_t *pte = pagetable_find(rlt[frame].task_struct->table, rlt[frame].vpn);
+			if (pte->frequency < fewest) {
+				fewest = pte->frequency;
+				pfn = frame;
+			}
+		}
+		pte_t *victim = pagetable_find(rlt[pfn].task_struct->table, rlt[pfn].vpn);
+		tlb_evict(rlt[pfn].vpn, victim);
+		if (victim->dirty) {
+			stats->writes_to_disk++;
+		}
+		victim->valid = 0;
+		victim->dirty = 0;
+	}
+	rlt[pfn].task_struct = current_process;
+	rlt[pfn].vpn = vpn;
+	rlt[pfn].valid = 1;
+	stats->reads_from_disk++;
+	return pfn;
+}
+
+/**
+ * The simulator's page_lookup, which reaches entries through pagetable_entry
+ * and so works with every kind of table. Used by tlb_translate.
+ *
+ * @return The entry of vpn in the running process's table, made valid
+ */
+pte_t *pagetable_lookup(uint64_t vpn, stats_t *stats)
+{
+	pte_t *pte = pagetable_entry(current_table, vpn);
+	if (!pte->valid) {
+		stats->page_faults++;
+		pte->pfn = pagetable_fault(vpn, stats);
+		pte->valid = 1;
+		pte->dirty = 0;
+		pte->frequency = 0;
+	}
+	pte->frequency++;
+	return pte;
+}
+
+/**
+ * @param name flat, radix or hashed
+ * @return 0 on success, -1 for an unknown name
+ */
+int pagetable_parse_kind(const char *name, pagetable_kind_t *kind)
+{
+	if (!strcmp(name, "flat")) {
+		*kind = PAGETABLE_FLAT;
+	} else if (!strcmp(name, "radix")) {
+		*kind = PAGETABLE_RADIX;
+	} else if (!strcmp(name, "hashed")) {
+		*kind = PAGETABLE_HASHED;
+	} else {
+		return -1;
+	}
+	return 0;
+}
@@ -13,8 +13,62 @@ typedef struct page_table_entry_t {
 	uint64_t frequency;
 } pte_t;
 
+// How a process's page table is organized
+typedef enum pagetable_kind_t {
+	PAGETABLE_FLAT,   // One entry per virtual page, allocated up front
+	PAGETABLE_RADIX,  // Levels of PAGETABLE_RADIX_BITS, allocated as pages are touched
+	PAGETABLE_HASHED  // One entry per touched page, chained off a hash of the vpn
+} pagetable_kind_t;
+
+// Virtual page number bits translated by each level of a radix table
+#define PAGETABLE_RADIX_BITS 9
+
+// Initial buckets of a hashed table, doubled when it is more than full
+#define PAGETABLE_HASH_BUCKETS 1024
+
+typedef struct pagetable_node_t {
+	uint64_t vpn;
+	pte_t pte;
+	struct pagetable_node_t *next;
+} pagetable_node_t;
+
+typedef struct pagetable_t {
+	pagetable_kind_t kind;
+	uint64_t vpn_bits;
+
+	// PAGETABLE_FLAT
+	pte_t *flat;
+
+	// PAGETABLE_RADIX: directories of pointers down to leaves of entries
+	void *root;
+	uint64_t levels;
+
+	// PAGETABLE_HASHED
+	pagetable_node_t **buckets;
+	uint64_t bucket_count;
+	uint64_t entries;
+
+	// Memory used by the table
+	uint64_t bytes;
+} pagetable_t;
+
+extern pagetable_kind_t pagetable_kind;
+
+// The running process's flat table as an array indexed by vpn, NULL unless flat
 extern pte_t *current_pagetable;
 
+// The running process's table of any kind, for pagetable_entry/pagetable_find
+extern pagetable_t *current_table;
+
+pagetable_t *pagetable_create(pagetable_kind_t kind);
+void pagetable_destroy(pagetable_t *pt);
+pte_t *pagetable_entry(pagetable_t *pt, uint64_t vpn);
+pte_t *pagetable_find(pagetable_t *pt, uint64_t vpn);
+uint64_t pagetable_walk_references(pagetable_t *pt, uint64_t vpn);
+uint64_t pagetable_memory(void);
+pte_t *pagetable_lookup(uint64_t vpn, stats_t *stats);
+int pagetable_parse_kind(const char *name, pagetable_kind_t *kind);
+
 uint64_t page_lookup(uint64_t vpn, uint64_t offset, char rw, stats_t *stats);
 
 uint64_t page_fault_handler(uint64_t vpn, char rw, stats_t *stats);
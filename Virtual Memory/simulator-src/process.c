@@ -1,10 +1,40 @@
 #include "process.h"
+#include "reverselookup.h"
+#include "tlb.h"
 
 task_struct *current_process;
 
 static task_struct *head;
 static task_struct *tail;
 
+// Index of the processes by pid
+static task_struct **buckets;
+static uint64_t bucket_count;
+static uint64_t count;
+
+static inline uint64_t pid_bucket(int pid, uint64_t n)
+{
+	return (((uint32_t) pid * 0x9E3779B97F4A7C15ull) >> 32) & (n - 1);
+}
+
+// Double the buckets once there are more processes than buckets
+static void grow_index(void)
+{
+	uint64_t n = bucket_count ? bucket_count * 2 : PROCESS_HASH_BUCKETS;
+	task_struct **grown = (task_struct **) calloc(n, sizeof(task_struct *));
+	if (!grown) {
+		perror_exit("process : Could not allocate memory for the process index");
+	}
+	for (task_struct *curr = head; curr; curr = curr->next) {
+		uint64_t b = pid_bucket(curr->pid, n);
+		curr->hash_next = grown[b];
+		grown[b] = curr;
+	}
+	free(buckets);
+	buckets = grown;
+	bucket_count = n;
+}
+
 task_struct* add_process(int pid, char name[256])
 {
 	task_struct *new_process = (task_struct *) calloc(sizeof(task_struct), 1);
@@ -15,14 +45,13 @@ task_struct* add_process(int pid, char name[256])
 	new_process->pid = pid;
 	strcpy(new_process->name, name);
 
-	new_process->pagetable = (pte_t *) malloc(sizeof(pte_t) * (1 << (virtual_address_size - page_size)));
-	if (!new_process->pagetable) {
+	new_process->table = pagetable_create(pagetable_kind);
+	if (!new_process->table) {
 		perror_exit("process : Could not allocate memory for new process's page table");
 	}
-	for (uint64_t i = 0; i < (1ull << (virtual_address_size - page_size)); i++) {
-		new_process->pagetable[i].valid = 0;
-	}
+	new_process->pagetable = new_process->table->flat;
 	new_process->next = NULL;
+	new_process->prev = tail;
 
 	if (head == NULL) {
 		head = new_process;
@@ -31,32 +60,81 @@ task_struct* add_process(int pid, char name[256])
 		tail->next = new_process;
 		tail = new_process;
 	}
+
+	if (count >= bucket_count) {
+		// Rebuilding from the list indexes the new process too
+		count++;
+		grow_index();
+	} else {
+		uint64_t b = pid_bucket(pid, bucket_count);
+		new_process->hash_next = buckets[b];
+		buckets[b] = new_process;
+		count++;
+	}
 	return new_process;
 }
 
 task_struct *get_process(int pid)
 {
-	task_struct *curr = head;
-	while(curr) {
+	if (!bucket_count) {
+		return NULL;
+	}
+	task_struct *curr = buckets[pid_bucket(pid, bucket_count)];
+	while (curr) {
 		if (curr->pid == pid) {
 			return curr;
 		}
-		curr = curr->next;
+		curr = curr->hash_next;
 	}
 	return NULL;
 }
 
+/**
+ * Take a process out of the list and the index. Its translations leave the
+ * TLB, so that the next owner of its ASID cannot hit them, and its frames
+ * are freed. The caller owns it after that, including its page table.
+ *
+ * @return The process, or NULL if there is no process with this pid
+ */
 task_struct *remove_process(int pid)
 {
-	task_struct *curr = head;
-	task_struct *prev = NULL;
-	while (curr) {
-		prev = head;
-		if (curr->pid == pid) {
-			prev->next = curr->next;
-			break;
-		}
-		curr = curr->next;
+	if (!bucket_count) {
+		return NULL;
+	}
+	task_struct **link = &buckets[pid_bucket(pid, bucket_count)];
+	while (*link && (*link)->pid != pid) {
+		link = &(*link)->hash_next;
+	}
+	task_struct *curr = *link;
+	if (!curr) {
+		return NULL;
+	}
+	*link = curr->hash_next;
+
+	if (curr->prev) {
+		curr->prev->next = curr->next;
+	} else {
+		head = curr->next;
+	}
+	if (curr->next) {
+		curr->next->prev = curr->prev;
+	} else {
+		tail = curr->prev;
+	}
+	curr->next = NULL;
+	curr->prev = NULL;
+	curr->hash_next = NULL;
+	count--;
+
+	if (curr->asid_generation) {
+		tlb_shootdown(curr->asid, curr->asid_generation);
+	} else if (curr == current_process) {
+		// Without ASIDs the TLB only holds the running process's translations
+		tlb_clear();
+	}
+	rlt_release(curr);
+	if (curr == current_process) {
+		current_process = NULL;
 	}
 	return curr;
 }
@@ -66,8 +144,50 @@ void free_processes(void)
 	task_struct *curr = head;
 	while (curr) {
 		head = head->next;
-		free(curr->pagetable);
+		pagetable_destroy(curr->table);
 		free(curr);
 		curr = head;
 	}
+	tail = NULL;
+	free(buckets);
+	buckets = NULL;
+	bucket_count = 0;
+	count = 0;
+}
+
+uint64_t process_count(void)
+{
+	return count;
+}
+
+/**
+ * Charge a process with the difference of the global stats before and after
+ * one of its accesses
+ */
+void process_account(task_struct *process, const stats_t *before, const stats_t *after)
+{
+	process_stats_t *stats = &process->stats;
+	stats->accesses += after->accesses - before->accesses;
+	stats->reads += after->reads - before->reads;
+	stats->writes += after->writes - before->writes;
+	stats->translation_faults += after->translation_faults - before->translation_faults;
+	stats->page_faults += after->page_faults - before->page_faults;
+	stats->writes_to_disk += after->writes_to_disk - before->writes_to_disk;
+	stats->reads_from_disk += after->reads_from_disk - before->reads_from_disk;
+	stats->page_walk_references += after->page_walk_references - before->page_walk_references;
+}
+
+// One CSV line per process, in the order the processes were added
+void write_process_stats(FILE *fout)
+{
+	fprintf(fout, "pid,accesses,reads,writes,switches,translation_faults,page_faults,"
+			"writes_to_disk,reads_from_disk,page_walk_references,page_table_bytes\n");
+	for (task_struct *curr = head; curr; curr = curr->next) {
+		const process_stats_t *stats = &curr->stats;
+		fprintf(fout, "%d,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+				",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+				curr->pid, stats->accesses, stats->reads, stats->writes, stats->switches,
+				stats->translation_faults, stats->page_faults, stats->writes_to_disk,
+				stats->reads_from_disk, stats->page_walk_references, curr->table->bytes);
+	}
 }
@@ -6,19 +6,49 @@
 #include "global.h"
 #include "string.h"
 
+// What one process's accesses cost, a slice of the global stats_t
+typedef struct process_stats_t {
+	uint64_t accesses;
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t translation_faults;
+	uint64_t page_faults;
+	uint64_t writes_to_disk;
+	uint64_t reads_from_disk;
+	uint64_t page_walk_references;
+	uint64_t switches; // Times the process was switched to
+} process_stats_t;
+
 typedef struct task_struct_t {
 	int pid;
 	char name[256];
-	pte_t *pagetable;
+	pte_t *pagetable;    // The flat table's entries, NULL for other kinds
+	pagetable_t *table;  // The table of any kind
+	process_stats_t stats;
+
+	// TLB address space, see tlb_switch
+	uint32_t asid;
+	uint64_t asid_generation;
 
+	// All processes in the order they were added
 	struct task_struct_t *next;
+	struct task_struct_t *prev;
+
+	// Processes in the same bucket of the pid index
+	struct task_struct_t *hash_next;
 } task_struct;
 
+// Initial buckets of the pid index, doubled when it is more than full
+#define PROCESS_HASH_BUCKETS 256
+
 extern task_struct *current_process;
 
 task_struct *add_process(int pid, char name[256]);
 task_struct *get_process(int pid);
 task_struct *remove_process(int pid);
 void free_processes(void);
+uint64_t process_count(void);
+void process_account(task_struct *process, const stats_t *before, const stats_t *after);
+void write_process_stats(FILE *fout);
 
 #endif
@@ -2,6 +2,9 @@
 
 rlte_t *rlt;
 
+// No frame below this one is free
+static uint64_t free_hint;
+
 void rlt_init(void)
 {
 	rlt = calloc(sizeof(rlte_t), (1llu << rlt_size));
@@ -14,3 +17,30 @@ void rlt_free(void)
 {
 	free(rlt);
 }
+
+/**
+ * Find a free frame for the simulator's page fault handling
+ *
+ * @return The frame, or 2^rlt_size if every frame is in use
+ */
+uint64_t rlt_find_free(void)
+{
+	while (free_hint < (1llu << rlt_size) && rlt[free_hint].valid) {
+		free_hint++;
+	}
+	return free_hint;
+}
+
+// Free the frames of a process that goes away
+void rlt_release(task_struct *process)
+{
+	for (uint64_t pfn = 0; pfn < (1llu << rlt_size); pfn++) {
+		if (rlt[pfn].valid && rlt[pfn].task_struct == process) {
+			rlt[pfn].valid = 0;
+			rlt[pfn].task_struct = NULL;
+			if (pfn < free_hint) {
+				free_hint = pfn;
+			}
+		}
+	}
+}
@@ -16,5 +16,7 @@ extern rlte_t *rlt;
 
 void rlt_init(void);
 void rlt_free(void);
+uint64_t rlt_find_free(void);
+void rlt_release(task_struct *process);
 
 #endif
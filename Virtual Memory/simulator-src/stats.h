@@ -16,6 +16,9 @@ typedef struct stats_t
 	// Accesses that result in a TLB miss
 	uint64_t translation_faults;
 
+	// Memory references of the page table walks on TLB misses
+	uint64_t page_walk_references;
+
 	uint64_t writes_to_disk;
 	uint64_t reads_from_disk;
 	// Average Access Time
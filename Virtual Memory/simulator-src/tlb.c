@@ -1,27 +1,92 @@
 #include "tlb.h"
+#include "pagetable.h"
 #include <string.h>
 
 tlbe_t *tlb;
+tlb_stats_t tlb_stats;
+
+// Address space of the running process
+uint32_t current_asid;
+
+// ASIDs handed out in this generation. When they run out the TLB is
+// flushed and every process gets a new one on its next switch. 64 bits, so
+// that it reaches 2^32 with 32-bit ASIDs instead of wrapping.
+static uint64_t next_asid;
+static uint64_t asid_generation = 1;
+
+// Clock hand of every set
+static uint64_t *hands;
+
+static inline uint64_t tlb_ways_count(void)
+{
+    return 1ull << tlb_ways;
+}
+
+static inline tlbe_t *tlb_set(uint64_t vpn)
+{
+    uint64_t sets = 1ull << (tlb_size - tlb_ways);
+    return tlb + (vpn & (sets - 1)) * tlb_ways_count();
+}
+
+// Copy the dirty bit of a translation from tlb_translate to its page
+static inline void tlb_writeback(tlbe_t *entry)
+{
+    if (entry->valid && entry->dirty && entry->pte) {
+        entry->pte->dirty = 1;
+    }
+}
 
 void tlb_clear(void)
 {
+    for (uint64_t i = 0; i < (1ull << tlb_size); i++) {
+        tlb_writeback(&tlb[i]);
+    }
     memset(tlb, 0, sizeof(tlbe_t) * (1 << tlb_size));
+    tlb_stats.flushes++;
 }
 
+/**
+ * Invalidate the translations of vpn in every address space. The whole TLB
+ * is searched, since tlb_lookup may place entries anywhere. See tlb_evict for
+ * the TLB of tlb_translate.
+ */
 void tlb_clearOne(uint64_t vpn)
 {
-    for (uint64_t i = 0; i < (1 << tlb_size); i++) {
+    for (uint64_t i = 0; i < (1ull << tlb_size); i++) {
         if (tlb[i].valid && tlb[i].vpn == vpn) {
             memset(&tlb[i], 0, sizeof(tlbe_t));
-            break;
+        }
+    }
+}
+
+/**
+ * Invalidate the translation of one page when it is evicted, leaving the
+ * translations of vpn in other address spaces. Only the set of vpn is
+ * probed, where tlb_translate puts it.
+ *
+ * @param pte The page's entry, which tells the owning process's translation
+ *        from those of the others
+ */
+void tlb_evict(uint64_t vpn, pte_t *pte)
+{
+    tlbe_t *set = tlb_set(vpn);
+    for (uint64_t i = 0; i < tlb_ways_count(); i++) {
+        if (set[i].valid && set[i].pte == pte) {
+            tlb_writeback(&set[i]);
+            memset(&set[i], 0, sizeof(tlbe_t));
+            return;
         }
     }
 }
 
 void tlb_init(void)
 {
+    if (tlb_ways > tlb_size) {
+        tlb_ways = tlb_size;
+    }
     tlb = (tlbe_t *)calloc(sizeof(tlbe_t), (1 << tlb_size));
-    if (!tlb) {
+    hands = (uint64_t *)calloc(sizeof(uint64_t), 1ull << (tlb_size - tlb_ways));
+    if (!tlb || !hands) {
         perror_exit("tlb: Could not allocate memory for TLB");
     }
 }
@@ -29,4 +94,152 @@ void tlb_init(void)
 void tlb_free(void)
 {
     free(tlb);
+    free(hands);
+}
+
+/**
+ * Find the translation of vpn for the running process. Counts a hit and
+ * marks the entry used.
+ *
+ * @return The entry, or NULL on a TLB miss
+ */
+tlbe_t *tlb_find(uint64_t vpn)
+{
+    tlbe_t *set = tlb_set(vpn);
+    for (uint64_t i = 0; i < tlb_ways_count(); i++) {
+        if (set[i].valid && set[i].vpn == vpn && set[i].asid == current_asid) {
+            set[i].used = 1;
+            tlb_stats.hits++;
+            if (set[i].filled != tlb_stats.switches) {
+                tlb_stats.kept_hits++;
+            }
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Pick the entry a translation of vpn replaces: a free way of its set, or
+ * the next one the clock finds unused. tlb_fill writes back a victim's dirty
+ * bit if tlb_translate filled it.
+ */
+tlbe_t *tlb_victim(uint64_t vpn)
+{
+    tlbe_t *set = tlb_set(vpn);
+    uint64_t ways = tlb_ways_count();
+    for (uint64_t i = 0; i < ways; i++) {
+        if (!set[i].valid) {
+            return &set[i];
+        }
+    }
+    uint64_t *hand = hands + (set - tlb) / ways;
+    while (set[*hand].used) {
+        set[*hand].used = 0;
+        *hand = (*hand + 1) & (ways - 1);
+    }
+    tlbe_t *victim = &set[*hand];
+    *hand = (*hand + 1) & (ways - 1);
+    return victim;
+}
+
+void tlb_fill(tlbe_t *entry, uint64_t vpn, uint64_t pfn, uint8_t dirty)
+{
+    tlb_writeback(entry);
+    entry->vpn = vpn;
+    entry->pfn = pfn;
+    entry->valid = 1;
+    entry->dirty = dirty;
+    entry->used = 1;
+    entry->asid = current_asid;
+    entry->filled = tlb_stats.switches;
+    entry->pte = NULL;
+}
+
+/**
+ * Translate an access through the set-associative, ASID-tagged TLB. This
+ * stands in for tlb_lookup when simulator_paging is set, as tlb_lookup
+ * matches entries on the vpn alone. Only a miss calls pagetable_lookup, which
+ * handles any page fault.
+ *
+ * A write marks the TLB entry dirty. The page is marked when the entry is
+ * replaced, evicted or flushed, as with tlb_lookup, through the page table
+ * entry the translation came from, whichever process it belongs to.
+ *
+ * @return The physical address
+ */
+uint64_t tlb_translate(uint64_t vpn, uint64_t offset, char rw, stats_t *stats)
+{
+    stats->accesses++;
+    if (rw == 'w') {
+        stats->writes++;
+    } else {
+        stats->reads++;
+    }
+
+    tlbe_t *entry = tlb_find(vpn);
+    if (!entry) {
+        stats->translation_faults++;
+        pte_t *pte = pagetable_lookup(vpn, stats);
+        entry = tlb_victim(vpn);
+        tlb_fill(entry, vpn, pte->pfn, 0);
+        entry->pte = pte;
+    }
+    if (rw == 'w') {
+        entry->dirty = 1;
+    }
+    return (entry->pfn << page_size) | offset;
+}
+
+/**
+ * Switch the TLB to another process. Without ASIDs (tlb_asid_bits is 0) the
+ * whole TLB is flushed. With them, entries of other processes stay and the
+ * process keeps its ASID until the ASIDs of this generation run out.
+ *
+ * @param asid The process's ASID, replaced if it is from an old generation
+ * @param generation Generation asid was handed out in, 0 for none
+ */
+void tlb_switch(uint32_t *asid, uint64_t *generation)
+{
+    tlb_stats.switches++;
+    if (!tlb_asid_bits) {
+        tlb_clear();
+        return;
+    }
+    if (*generation != asid_generation) {
+        if (next_asid == (1ull << tlb_asid_bits)) {
+            tlb_clear();
+            asid_generation++;
+            next_asid = 0;
+        }
+        *asid = (uint32_t) next_asid++;
+        *generation = asid_generation;
+    }
+    current_asid = *asid;
+}
+
+/**
+ * Invalidate every entry of one address space when its process goes away
+ *
+ * @param generation Generation asid was handed out in. Entries of an older
+ *        one were flushed already and the ASID may belong to another process.
+ */
+void tlb_shootdown(uint32_t asid, uint64_t generation)
+{
+    if (generation != asid_generation) {
+        return;
+    }
+    for (uint64_t i = 0; i < (1ull << tlb_size); i++) {
+        if (tlb[i].valid && tlb[i].asid == asid) {
+            tlb_writeback(&tlb[i]);
+            memset(&tlb[i], 0, sizeof(tlbe_t));
+        }
+    }
+    tlb_stats.shootdowns++;
+}
+
+// Bytes of memory the TLB maps when it is full
+uint64_t tlb_reach(void)
+{
+    return (1ull << tlb_size) << page_size;
 }
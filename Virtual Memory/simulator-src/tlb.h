@@ -4,6 +4,7 @@
 #include "util.h"
 #include "global.h"
 #include "stats.h"
+#include "pagetable.h"
 
 typedef struct tlb_entry_t {
 	uint64_t vpn;
@@ -13,9 +14,31 @@ typedef struct tlb_entry_t {
 
 	// For clock sweeping the TLB
 	uint8_t used;
+
+	// Address space the translation belongs to, 0 without ASIDs
+	uint32_t asid;
+
+	// Context switches when the entry was filled
+	uint64_t filled;
+
+	// Page table entry of the translation, filled by tlb_translate only
+	pte_t *pte;
 } tlbe_t;
 
+// What the TLB saw through tlb_find and its shootdowns
+typedef struct tlb_stats_t {
+	uint64_t hits;
+	uint64_t kept_hits; // Hits on entries filled before the last context switch
+	uint64_t switches;
+	uint64_t flushes; // Whole TLB, on a switch without ASIDs or when ASIDs run out
+	uint64_t shootdowns; // Entries of one ASID
+} tlb_stats_t;
+
+// The TLB is 2^(tlb_size - tlb_ways) sets of 2^tlb_ways entries each. An
+// entry of a vpn is in set vpn % sets, at tlb[set * ways + way].
 extern tlbe_t * tlb;
+extern tlb_stats_t tlb_stats;
+extern uint32_t current_asid;
 
 uint64_t tlb_lookup(uint64_t vpn, uint64_t offset, char rw, stats_t *stats);
 
@@ -23,8 +46,18 @@ void tlb_clear(void);
 
 void tlb_clearOne(uint64_t vpn);
 
+void tlb_evict(uint64_t vpn, pte_t *pte);
+
 void tlb_init(void);
 
 void tlb_free(void);
 
+tlbe_t *tlb_find(uint64_t vpn);
+tlbe_t *tlb_victim(uint64_t vpn);
+void tlb_fill(tlbe_t *entry, uint64_t vpn, uint64_t pfn, uint8_t dirty);
+uint64_t tlb_translate(uint64_t vpn, uint64_t offset, char rw, stats_t *stats);
+void tlb_switch(uint32_t *asid, uint64_t *generation);
+void tlb_shootdown(uint32_t asid, uint64_t generation);
+uint64_t tlb_reach(void);
+
 #endif